@@ -0,0 +1,241 @@
+#include "buffer_pool.h"
+#include "liberror.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <errno.h>
+
+#include <algorithm>
+#include <utility>
+
+/*
+ * Cache de buffers libres de un thread para un pool en particular.
+ *
+ * Cada thread tiene su propia lista de caches (`thread_local`) así que
+ * acceder a ellos no requiere ningún mutex. Normalmente hay uno o dos
+ * pools por programa así que una búsqueda lineal alcanza.
+ * */
+struct ThreadCache {
+    uint64_t pool_id;
+    std::vector<char*> bufs;
+};
+
+static thread_local std::vector<ThreadCache> thread_caches;
+static std::atomic<uint64_t> next_pool_id(1);
+
+const size_t BufferPool::BATCH;
+
+static const size_t HUGEPAGE_SZ = 2 * 1024 * 1024;
+
+static size_t slab_size(size_t buf_sz, size_t buffers_per_slab, bool hugepages) {
+    size_t align = hugepages ? HUGEPAGE_SZ : sysconf(_SC_PAGESIZE);
+    size_t sz = buf_sz * std::max<size_t>(buffers_per_slab, 1);
+    return ((sz + align - 1) / align) * align;
+}
+
+BufferPool::BufferPool(
+        size_t buffer_sz,
+        size_t buffers_per_slab,
+        bool hugepages) :
+    buf_sz(buffer_sz),
+    slab_sz(slab_size(buffer_sz, buffers_per_slab, hugepages)),
+    hugepages(hugepages),
+    id(next_pool_id++),
+    trimmed(0),
+    in_use(0),
+    cached(0) {}
+
+std::vector<char*>& BufferPool::local_cache() {
+    for (auto& cache : thread_caches)
+        if (cache.pool_id == id)
+            return cache.bufs;
+
+    thread_caches.push_back({id, {}});
+    thread_caches.back().bufs.reserve(2 * BATCH);
+    return thread_caches.back().bufs;
+}
+
+/*
+ * Reserva un slab nuevo y agrega sus buffers a la lista global.
+ * Se llama con el mutex tomado.
+ * */
+void BufferPool::add_slab() {
+    void *mem = MAP_FAILED;
+    if (hugepages)
+        mem = mmap(nullptr, slab_sz, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (mem == MAP_FAILED) {
+        mem = mmap(nullptr, slab_sz, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            throw LibError(errno, "buffer pool mmap failed");
+
+        /*
+         * Es solo un consejo: si el kernel no tiene THP habilitado
+         * lo ignora y no pasa nada.
+         * */
+        if (hugepages)
+            madvise(mem, slab_sz, MADV_HUGEPAGE);
+    }
+
+    char *slab = (char*)mem;
+    slabs.push_back(slab);
+
+    for (size_t off = 0; off + buf_sz <= slab_sz; off += buf_sz)
+        free_list.push_back(slab + off);
+}
+
+/*
+ * Trae una tanda de buffers de la lista global al cache del thread.
+ * */
+void BufferPool::refill(std::vector<char*>& cache) {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (free_list.empty())
+        add_slab();
+
+    size_t n = std::min(BATCH, free_list.size());
+    cache.insert(cache.end(), free_list.end() - n, free_list.end());
+    free_list.resize(free_list.size() - n);
+
+    /*
+     * Los buffers "trimmeados" están siempre al principio de la lista
+     * global (véase `BufferPool::trim`) y sacamos del final.
+     * */
+    trimmed = std::min(trimmed, free_list.size());
+
+    cached += n;
+}
+
+/*
+ * Devuelve a la lista global los buffers del cache del thread
+ * dejando solo `keep`.
+ * */
+void BufferPool::drain(std::vector<char*>& cache, size_t keep) {
+    if (cache.size() <= keep)
+        return;
+
+    size_t n = cache.size() - keep;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        free_list.insert(free_list.end(), cache.end() - n, cache.end());
+    }
+
+    cache.resize(keep);
+    cached -= n;
+}
+
+char* BufferPool::acquire() {
+    std::vector<char*>& cache = local_cache();
+    if (cache.empty())
+        refill(cache);
+
+    char *buf = cache.back();
+    cache.pop_back();
+
+    --cached;
+    ++in_use;
+    return buf;
+}
+
+void BufferPool::release(char *buf) {
+    std::vector<char*>& cache = local_cache();
+    cache.push_back(buf);
+
+    ++cached;
+    --in_use;
+
+    /*
+     * Un thread que solo devuelve buffers (por ejemplo, pedidos por otro
+     * thread) no debe acumularlos para siempre.
+     * */
+    if (cache.size() >= 2 * BATCH)
+        drain(cache, BATCH);
+}
+
+size_t BufferPool::buffer_size() const {
+    return buf_sz;
+}
+
+BufferPoolStats BufferPool::stats() {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    BufferPoolStats st;
+    st.buffer_sz = buf_sz;
+    st.slabs = slabs.size();
+    st.mapped_bytes = slabs.size() * slab_sz;
+    st.in_use = in_use;
+    st.free_global = free_list.size();
+    st.free_cached = cached;
+    st.trimmed = trimmed;
+    return st;
+}
+
+size_t BufferPool::trim() {
+    const size_t page_sz = sysconf(_SC_PAGESIZE);
+    if (buf_sz % page_sz != 0)
+        return 0;
+
+    std::unique_lock<std::mutex> lock(mtx);
+
+    /*
+     * Los buffers de `[0, trimmed)` ya fueron trimmeados: solo hace
+     * falta hacerlo con el resto.
+     * */
+    for (size_t i = trimmed; i < free_list.size(); ++i)
+        madvise(free_list[i], buf_sz, MADV_DONTNEED);
+
+    size_t n = free_list.size() - trimmed;
+    trimmed = free_list.size();
+    return n;
+}
+
+BufferPool::~BufferPool() {
+    for (char *slab : slabs)
+        munmap(slab, slab_sz);
+}
+
+PooledBuffer::PooledBuffer() :
+    pool(nullptr),
+    buf(nullptr) {}
+
+PooledBuffer::PooledBuffer(BufferPool& pool) :
+    pool(&pool),
+    buf(pool.acquire()) {}
+
+char* PooledBuffer::data() const {
+    return buf;
+}
+
+PooledBuffer::operator bool() const {
+    return buf != nullptr;
+}
+
+void PooledBuffer::reset() {
+    if (buf)
+        pool->release(buf);
+
+    buf = nullptr;
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) :
+    pool(other.pool),
+    buf(other.buf) {
+    other.buf = nullptr;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) {
+    if (this == &other)
+        return *this;
+
+    reset();
+    pool = other.pool;
+    buf = other.buf;
+    other.buf = nullptr;
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer() {
+    reset();
+}
@@ -0,0 +1,173 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * Estadísticas de un `BufferPool`.
+ * */
+struct BufferPoolStats {
+    size_t buffer_sz;
+
+    /*
+     * Slabs reservados y bytes mapeados en total (memoria virtual,
+     * no necesariamente residente).
+     * */
+    size_t slabs;
+    size_t mapped_bytes;
+
+    /*
+     * Buffers en uso (prestados), libres en la lista global
+     * y libres en los caches de los threads.
+     * */
+    size_t in_use;
+    size_t free_global;
+    size_t free_cached;
+
+    /*
+     * Buffers libres cuya memoria se le devolvió al sistema
+     * operativo (véase `BufferPool::trim`).
+     * */
+    size_t trimmed;
+};
+
+/*
+ * Pool de buffers de tamaño fijo para I/O.
+ *
+ * Con 100 mil conexiones no podemos darnos el lujo de que cada una tenga
+ * su propio buffer de 4KB todo el tiempo (¡400MB!): la mayoría de las
+ * conexiones están inactivas la mayor parte del tiempo.
+ *
+ * La idea es que una conexión pida un buffer recién cuando este lista
+ * para leer y lo devuelva cuando ya no tenga nada pendiente.
+ *
+ * Los buffers se reservan de a muchos juntos (un "slab") con `mmap`,
+ * opcionalmente con páginas enormes (hugepages, 2MB en vez de 4KB) que
+ * reducen los fallos de TLB.
+ *
+ * Pedir y devolver un buffer no toma ningún mutex en el caso común:
+ * cada thread tiene su propio cache de buffers libres y solo cuando este
+ * se vacía (o se llena demasiado) se intercambian buffers, de a tandas,
+ * con la lista global (esa si, protegida por un mutex).
+ *
+ * Un buffer puede devolverse desde un thread distinto al que lo pidió.
+ *
+ * Los buffers que queden en el cache de un thread que termina no vuelven
+ * a la lista global (pero su memoria se libera al destruirse el pool).
+ * */
+class BufferPool {
+    private:
+    const size_t buf_sz;
+    const size_t slab_sz;
+    const bool hugepages;
+
+    /*
+     * Identificador único de este pool, para encontrar el cache
+     * de cada thread (véase `BufferPool::local_cache`).
+     * */
+    const uint64_t id;
+
+    std::mutex mtx;
+    std::vector<char*> slabs;
+    std::vector<char*> free_list;
+    size_t trimmed;
+
+    std::atomic<size_t> in_use;
+    std::atomic<size_t> cached;
+
+    std::vector<char*>& local_cache();
+    void refill(std::vector<char*>& cache);
+    void drain(std::vector<char*>& cache, size_t keep);
+    void add_slab();
+
+    public:
+    /*
+     * Cantidad de buffers que se mueven de una vez entre el cache
+     * de un thread y la lista global.
+     * */
+    static const size_t BATCH = 32;
+
+    /*
+     * `buffer_sz` es el tamaño de cada buffer y `buffers_per_slab`
+     * cuantos se reservan juntos.
+     *
+     * Con `hugepages` se intenta usar `MAP_HUGETLB` (requiere que el
+     * administrador haya reservado hugepages, véase
+     * `/proc/sys/vm/nr_hugepages`); si falla se usan páginas comunes
+     * pidiéndole al kernel que las junte en hugepages cuando pueda
+     * (Transparent Huge Pages, `MADV_HUGEPAGE`).
+     * */
+    explicit BufferPool(
+            size_t buffer_sz = 4096,
+            size_t buffers_per_slab = 256,
+            bool hugepages = false);
+
+    /*
+     * Pide un buffer de `BufferPool::buffer_size` bytes.
+     * */
+    char* acquire();
+
+    /*
+     * Devuelve un buffer pedido con `BufferPool::acquire`.
+     * */
+    void release(char *buf);
+
+    size_t buffer_size() const;
+
+    BufferPoolStats stats();
+
+    /*
+     * Le devuelve al sistema operativo la memoria de los buffers libres
+     * de la lista global (`MADV_DONTNEED`) sin desmapearla: el buffer
+     * sigue siendo valido y la memoria se vuelve a reservar (en cero)
+     * cuando se lo use. Así baja el RSS cuando la mayoría de las
+     * conexiones están inactivas.
+     *
+     * Solo tiene efecto si el tamaño de los buffers es múltiplo del
+     * tamaño de página. Retorna la cantidad de buffers afectados.
+     * */
+    size_t trim();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    BufferPool(BufferPool&&) = delete;
+    BufferPool& operator=(BufferPool&&) = delete;
+
+    ~BufferPool();
+};
+
+/*
+ * Un buffer prestado por un `BufferPool` que se devuelve solo
+ * al destruirse (RAII). Puede estar vacío (sin buffer).
+ * */
+class PooledBuffer {
+    private:
+    BufferPool *pool;
+    char *buf;
+
+    public:
+    PooledBuffer();
+    explicit PooledBuffer(BufferPool& pool);
+
+    char* data() const;
+    explicit operator bool() const;
+
+    /*
+     * Devuelve el buffer al pool (si lo hay) y queda vacío.
+     * */
+    void reset();
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    PooledBuffer(PooledBuffer&&);
+    PooledBuffer& operator=(PooledBuffer&&);
+
+    ~PooledBuffer();
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "buffered_socket.h"
+#include "liberror.h"
+#include "transport.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+template<typename Transport>
+BasicBufferedSocket<Transport>::BasicBufferedSocket(
+        Transport&& skt,
+        const BufferedSocketOptions& opts) :
+    skt(std::move(skt)),
+    rbuf(opts.read_buffer_sz),
+    max_read_buffer_sz(std::max(opts.max_read_buffer_sz, opts.read_buffer_sz)),
+    wbuf(opts.write_buffer_sz),
+    wlen(0),
+    flush_threshold(std::min(opts.flush_threshold, opts.write_buffer_sz)),
+    max_delay_ms(opts.max_delay_ms) {}
+
+template<typename Transport>
+Transport& BasicBufferedSocket<Transport>::socket() {
+    return skt;
+}
+
+template<typename Transport>
+int BasicBufferedSocket<Transport>::fill() {
+    if (rbuf.writable() == 0) {
+        if (rbuf.capacity() >= max_read_buffer_sz)
+            throw std::length_error("BufferedSocket read buffer is full");
+
+        rbuf.grow(std::min(2 * rbuf.capacity(), max_read_buffer_sz));
+    }
+
+    int sz = skt.recvsome(rbuf.write_ptr(), rbuf.writable());
+    if (sz > 0)
+        rbuf.commit(sz);
+
+    return sz;
+}
+
+template<typename Transport>
+std::string_view BasicBufferedSocket<Transport>::peek() const {
+    return rbuf.view();
+}
+
+template<typename Transport>
+std::string_view BasicBufferedSocket<Transport>::peek(size_t sz) {
+    if (sz > std::max(rbuf.capacity(), max_read_buffer_sz))
+        throw std::length_error("BufferedSocket peek larger than the read buffer");
+
+    while (rbuf.readable() < sz)
+        if (fill() <= 0)
+            break;
+
+    return peek();
+}
+
+template<typename Transport>
+void BasicBufferedSocket<Transport>::consume(size_t sz) {
+    rbuf.consume(std::min(sz, rbuf.readable()));
+}
+
+template<typename Transport>
+size_t BasicBufferedSocket<Transport>::buffered() const {
+    return rbuf.readable();
+}
+
+template<typename Transport>
+int BasicBufferedSocket<Transport>::recvsome(void *data, unsigned int sz) {
+    if (rbuf.readable() == 0) {
+        if (sz >= rbuf.capacity())
+            return skt.recvsome(data, sz);
+
+        int s = fill();
+        if (s <= 0)
+            return s;
+    }
+
+    unsigned int n = std::min<size_t>(sz, rbuf.readable());
+    memcpy(data, rbuf.read_ptr(), n);
+    rbuf.consume(n);
+    return n;
+}
+
+template<typename Transport>
+int BasicBufferedSocket<Transport>::recvall(void *data, unsigned int sz) {
+    unsigned int received = 0;
+
+    /* Véase `Socket::recvall` */
+    while (received < sz) {
+        int s = recvsome((char*)data + received, sz - received);
+        if (s == Socket::WOULD_BLOCK) {
+            throw LibError(
+                    EAGAIN,
+                    "socket received only %d of %d bytes (non-blocking)",
+                    received,
+                    sz);
+        } else if (s == 0) {
+            if (received)
+                throw LibError(
+                        EPIPE,
+                        "socket received only %d of %d bytes",
+                        received,
+                        sz);
+            return 0;
+        }
+
+        received += s;
+    }
+
+    return sz;
+}
+
+template<typename Transport>
+bool BasicBufferedSocket<Transport>::read_until(std::string_view delim, std::string& out) {
+    out.clear();
+
+    /*
+     * `scanned` es cuanto del buffer ya revisamos sin encontrar `delim`:
+     * no tiene sentido buscar ahí de nuevo (salvo los últimos bytes, donde
+     * podría empezar un `delim` que termine en los bytes que aun no llegaron).
+     * */
+    size_t scanned = 0;
+    while (true) {
+        std::string_view view = peek();
+        size_t from = scanned >= delim.size() ? scanned - delim.size() + 1 : 0;
+        size_t pos = view.find(delim, from);
+        if (pos != std::string_view::npos) {
+            out.append(view.data(), pos + delim.size());
+            consume(pos + delim.size());
+            return true;
+        }
+
+        scanned = view.size();
+
+        /*
+         * Buffer lleno y sin `delim`: pasamos a `out` todo salvo los
+         * últimos bytes (un `delim` podría haber quedado partido).
+         * */
+        if (rbuf.writable() == 0) {
+            size_t keep = std::min(view.size(), delim.size() - 1);
+            out.append(view.data(), view.size() - keep);
+            consume(view.size() - keep);
+            scanned = keep;
+        }
+
+        int s = fill();
+        if (s == 0) {
+            std::string_view rest = peek();
+            out.append(rest.data(), rest.size());
+            consume(rest.size());
+            return false;
+        }
+
+        if (s == Socket::WOULD_BLOCK)
+            throw LibError(EAGAIN, "socket read_until would block (non-blocking)");
+    }
+}
+
+template<typename Transport>
+void BasicBufferedSocket<Transport>::append(const void *data, size_t sz) {
+    if (wlen == 0)
+        wsince = Clock::now();
+
+    memcpy(wbuf.data() + wlen, data, sz);
+    wlen += sz;
+}
+
+template<typename Transport>
+void BasicBufferedSocket<Transport>::write(const void *data, size_t sz) {
+    struct iovec iov = { (void*)data, sz };
+    writev(&iov, 1);
+}
+
+template<typename Transport>
+void BasicBufferedSocket<Transport>::writev(const struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        total += iov[i].iov_len;
+
+    if (total > wbuf.size()) {
+        /*
+         * No entraría nunca: lo enviamos directamente, precedido
+         * por lo pendiente, todo con un único `Socket::sendall`.
+         * */
+        std::vector<struct iovec> all;
+        all.reserve(iovcnt + 1);
+        if (wlen)
+            all.push_back({ wbuf.data(), wlen });
+        all.insert(all.end(), iov, iov + iovcnt);
+
+        skt.sendall(all.data(), all.size());
+        wlen = 0;
+        return;
+    }
+
+    if (wlen + total > wbuf.size())
+        flush();
+
+    for (int i = 0; i < iovcnt; ++i)
+        append(iov[i].iov_base, iov[i].iov_len);
+
+    if (wlen >= flush_threshold)
+        flush();
+    else
+        flush_if_due();
+}
+
+template<typename Transport>
+void BasicBufferedSocket<Transport>::flush() {
+    if (wlen == 0)
+        return;
+
+    /*
+     * Si `Socket::sendall` falla, lo pendiente se pierde igual: no hay
+     * forma de saber cuanto llego al otro lado.
+     * */
+    size_t len = wlen;
+    wlen = 0;
+    skt.sendall(wbuf.data(), len);
+}
+
+template<typename Transport>
+void BasicBufferedSocket<Transport>::flush_if_due() {
+    if (wlen == 0 or max_delay_ms < 0)
+        return;
+
+    if (Clock::now() - wsince >= std::chrono::milliseconds(max_delay_ms))
+        flush();
+}
+
+template<typename Transport>
+size_t BasicBufferedSocket<Transport>::pending() const {
+    return wlen;
+}
+
+/*
+ * Instanciamos el template para cada transporte: así el código queda
+ * en este `.cpp` (y no en el header) y se compila una única vez.
+ * */
+template class BasicBufferedSocket<Socket>;
+template class BasicBufferedSocket<SocketPairTransport>;
+template class BasicBufferedSocket<MemoryTransport>;
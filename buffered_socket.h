@@ -0,0 +1,229 @@
+#ifndef BUFFERED_SOCKET_H
+#define BUFFERED_SOCKET_H
+
+#include <sys/uio.h>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "socket.h"
+#include "ring_buffer.h"
+
+/*
+ * Configuración de un `BufferedSocket`.
+ * */
+struct BufferedSocketOptions {
+    /*
+     * Tamaño del buffer de lectura anticipada (read-ahead). Se redondea
+     * hacia arriba a un múltiplo del tamaño de página.
+     * */
+    size_t read_buffer_sz;
+
+    /*
+     * Si el buffer de lectura se llena (por ejemplo, con los headers
+     * de una respuesta HTTP enorme) se agranda al doble, hasta este
+     * tamaño. Recién ahí `BufferedSocket::fill` lanza una excepción.
+     * */
+    size_t max_read_buffer_sz;
+
+    /*
+     * Tamaño del buffer de escritura.
+     * */
+    size_t write_buffer_sz;
+
+    /*
+     * Cuando lo pendiente de enviar llega a este tamaño se envía
+     * automáticamente. No puede ser mayor que `write_buffer_sz`.
+     * */
+    size_t flush_threshold;
+
+    /*
+     * Si lo pendiente de enviar tiene más de estos milisegundos
+     * se envía en la siguiente escritura (o en la siguiente llamada
+     * a `BufferedSocket::flush_if_due`). Negativo para deshabilitarlo.
+     * */
+    int max_delay_ms;
+
+    BufferedSocketOptions() :
+        read_buffer_sz(16384),
+        max_read_buffer_sz(1024 * 1024),
+        write_buffer_sz(16384),
+        flush_threshold(16384),
+        max_delay_ms(-1) {}
+};
+
+/*
+ * Socket con buffers en espacio de usuario, como un `FILE*` de C.
+ *
+ * Lectura: cada `Socket::recvsome` es una syscall y leer de a pocos
+ * bytes (por ejemplo, de a una línea) es caro. `BufferedSocket` lee
+ * de a mucho (read-ahead) y después sirve las lecturas chicas desde
+ * su buffer. Ademas permite "espiar" lo recibido sin consumirlo
+ * (`BufferedSocket::peek`), que es justo lo que necesita un parser.
+ *
+ * Escritura: cada `Socket::sendall` también es (al menos) una syscall
+ * y puede terminar en un segmento TCP por mensaje. `BufferedSocket`
+ * junta (coalesce) muchas escrituras chicas y las envía juntas.
+ *
+ * Lo escrito no se envía hasta que:
+ *  - se llame a `BufferedSocket::flush`,
+ *  - lo pendiente alcance `flush_threshold`,
+ *  - o lo pendiente sea más viejo que `max_delay_ms`.
+ *
+ * Ojo: leer *no* envía lo pendiente. Si enviamos un pedido y esperamos
+ * la respuesta hay que llamar a `BufferedSocket::flush` antes o nos
+ * quedaremos esperando una respuesta a un pedido que nunca salió.
+ *
+ * El lado de lectura y el de escritura no comparten estado: un thread
+ * puede escribir mientras otro lee.
+ *
+ * La escritura esta pensada para sockets bloqueantes (como
+ * `Socket::sendall`); la lectura soporta sockets no-bloqueantes
+ * (`BufferedSocket::fill` retorna `Socket::WOULD_BLOCK`).
+ *
+ * `BasicBufferedSocket` es un template: en vez de un `Socket` puede
+ * envolver cualquier otro "transporte" (véase `transport.h`).
+ * `BufferedSocket` es la versión para `Socket`, la de siempre.
+ * */
+template<typename Transport>
+class BasicBufferedSocket {
+    private:
+    typedef std::chrono::steady_clock Clock;
+
+    Transport skt;
+
+    /*
+     * Los bytes recibidos y aun no consumidos. Al ser un buffer
+     * espejado, siempre están contiguos y nunca hay que compactarlos
+     * (véase `MirroredRingBuffer`).
+     * */
+    MirroredRingBuffer rbuf;
+    size_t max_read_buffer_sz;
+
+    /*
+     * Los bytes a enviar están en `wbuf[0, wlen)`. `wsince` es cuando
+     * se escribió el primero de ellos.
+     * */
+    std::vector<char> wbuf;
+    size_t wlen;
+    size_t flush_threshold;
+    int max_delay_ms;
+    Clock::time_point wsince;
+
+    void append(const void *data, size_t sz);
+
+    public:
+    explicit BasicBufferedSocket(
+            Transport&& skt,
+            const BufferedSocketOptions& opts = BufferedSocketOptions());
+
+    /*
+     * El socket de abajo, para lo que `BufferedSocket` no ofrezca
+     * (opciones, modo no-bloqueante, `shutdown`, ...).
+     *
+     * No leas ni escribas directamente en él: te saltearías los buffers.
+     * */
+    Transport& socket();
+
+    /*
+     * Hace *un* `Socket::recvsome` para agregar datos al buffer de lectura.
+     *
+     * Retorna lo que haya retornado `Socket::recvsome`: la cantidad
+     * de bytes recibidos, 0 si la conexión se cerró o `Socket::WOULD_BLOCK`.
+     *
+     * Si el buffer de lectura esta lleno se agranda (invalidando las
+     * vistas retornadas por `BufferedSocket::peek`); si ya llego
+     * a `max_read_buffer_sz` se lanza una excepción.
+     * */
+    int fill();
+
+    /*
+     * Retorna los bytes recibidos aun no consumidos, sin hacer ninguna
+     * syscall. La vista es valida hasta la siguiente lectura.
+     * */
+    std::string_view peek() const;
+
+    /*
+     * Como el anterior pero se asegura de que haya al menos `sz` bytes
+     * (llamando a `BufferedSocket::fill` las veces que sean necesarias).
+     *
+     * Si la conexión se cierra antes se retornan los que haya.
+     * `sz` no puede superar `max_read_buffer_sz`.
+     * */
+    std::string_view peek(size_t sz);
+
+    /*
+     * Descarta (consume) los primeros `sz` bytes del buffer de lectura.
+     * */
+    void consume(size_t sz);
+
+    /*
+     * Cantidad de bytes recibidos aun no consumidos.
+     * */
+    size_t buffered() const;
+
+    /*
+     * Como `Socket::recvsome` y `Socket::recvall` pero sirviendo
+     * primero lo que haya en el buffer de lectura.
+     *
+     * Si el buffer esta vacío y el caller pide más de lo que entra en él,
+     * se recibe directamente en el buffer del caller (copiarlo dos veces
+     * no tendría sentido).
+     * */
+    int recvsome(void *data, unsigned int sz);
+    int recvall(void *data, unsigned int sz);
+
+    /*
+     * Lee hasta encontrar `delim` (incluido) y lo deja en `out`.
+     *
+     * Retorna `false` si la conexión se cerró antes de encontrar
+     * `delim` (en `out` queda lo que se haya leído).
+     *
+     * No hay límite en el largo de lo leído: si `delim` no aparece
+     * en el buffer, lo leído se va pasando a `out`.
+     * */
+    bool read_until(std::string_view delim, std::string& out);
+
+    /*
+     * Agrega datos al buffer de escritura. Si no entran, o si se alcanza
+     * algún límite (véase `BufferedSocketOptions`), se envían.
+     *
+     * Si lo escrito es más grande que el buffer entero se envía
+     * directamente (junto con lo pendiente, en una sola syscall)
+     * sin copiarlo.
+     * */
+    void write(const void *data, size_t sz);
+    void writev(const struct iovec *iov, int iovcnt);
+
+    /*
+     * Envía todo lo pendiente.
+     * */
+    void flush();
+
+    /*
+     * Envía lo pendiente solo si es más viejo que `max_delay_ms`.
+     * Útil para llamarlo periódicamente desde un event loop.
+     * */
+    void flush_if_due();
+
+    /*
+     * Cantidad de bytes escritos aun no enviados.
+     * */
+    size_t pending() const;
+
+    BasicBufferedSocket(const BasicBufferedSocket&) = delete;
+    BasicBufferedSocket& operator=(const BasicBufferedSocket&) = delete;
+
+    BasicBufferedSocket(BasicBufferedSocket&&) = default;
+    BasicBufferedSocket& operator=(BasicBufferedSocket&&) = default;
+};
+
+/*
+ * Los métodos están definidos en `buffered_socket.cpp` e instanciados
+ * ahí para cada transporte de `transport.h`.
+ * */
+typedef BasicBufferedSocket<Socket> BufferedSocket;
+
+#endif
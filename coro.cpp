@@ -0,0 +1,301 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "coro.h"
+#include "liberror.h"
+#include "resolver.h"
+
+#include <utility>
+
+Scheduler::Scheduler() :
+    live(0),
+    stopped(false) {}
+
+void Scheduler::spawn(Task<> task) {
+    auto h = task.release();
+    h.promise().detached_in = this;
+
+    ++live;
+    ready.push_back(h);
+}
+
+void Scheduler::schedule(std::coroutine_handle<> h) {
+    ready.push_back(h);
+}
+
+void Scheduler::task_done(std::exception_ptr error) {
+    --live;
+    if (error and not first_error)
+        first_error = error;
+}
+
+void Scheduler::run() {
+    stopped = false;
+    while (not stopped and live > 0) {
+        /*
+         * Retomar una corrutina puede encolar otras (por ejemplo una
+         * que lanza nuevas tareas): corremos hasta vaciar la cola.
+         * */
+        while (not ready.empty()) {
+            auto h = ready.front();
+            ready.pop_front();
+            h.resume();
+        }
+
+        if (first_error)
+            std::rethrow_exception(std::exchange(first_error, nullptr));
+
+        if (stopped or live == 0)
+            break;
+
+        /*
+         * Todas las tareas vivas están suspendidas esperando I/O:
+         * esperamos a que el reactor nos diga que algún socket esta
+         * listo (el handler encolara a la corrutina correspondiente).
+         * */
+        reactor_.run_once(-1);
+    }
+}
+
+void Scheduler::stop() {
+    stopped = true;
+}
+
+Reactor& Scheduler::reactor() {
+    return reactor_;
+}
+
+AsyncSocket::AsyncSocket(Scheduler& sched, Socket&& skt) :
+    skt(std::move(skt)),
+    waiters(new Waiters{&sched}) {
+    this->skt.set_nonblocking(true);
+
+    /*
+     * Nos registramos una única vez para todos los eventos en modo
+     * "edge-triggered" (`EPOLLET`): `epoll` nos avisa solo cuando el
+     * socket *pasa* a estar listo.
+     *
+     * Por eso toda operación se intenta primero sin esperar
+     * (`await_ready`) y solo si "bloquearía" la corrutina se suspende
+     * hasta el próximo evento. Si nadie esta esperando cuando llega un
+     * evento, no se pierde nada: la próxima operación lo "descubrirá"
+     * al intentarse.
+     * */
+    Waiters *w = waiters.get();
+    sched.reactor().add(this->skt, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+            [w](uint32_t events) {
+                const uint32_t failed = EPOLLERR | EPOLLHUP;
+
+                if (w->reader and (events & (EPOLLIN | EPOLLRDHUP | failed))
+                        and w->reader->try_complete()) {
+                    w->sched->schedule(std::exchange(w->reader, nullptr)->waiting);
+                }
+
+                if (w->writer and (events & (EPOLLOUT | failed))
+                        and w->writer->try_complete()) {
+                    w->sched->schedule(std::exchange(w->writer, nullptr)->waiting);
+                }
+            });
+}
+
+void AsyncSocket::wait_readable(IOWait *op) {
+    waiters->reader = op;
+}
+
+void AsyncSocket::wait_writable(IOWait *op) {
+    waiters->writer = op;
+}
+
+bool AsyncSocket::RecvAwaiter::try_complete() {
+    result = self.skt.try_recvsome(data, sz);
+    return not result.would_block();
+}
+
+int AsyncSocket::RecvAwaiter::await_resume() {
+    if (not result.ok())
+        throw LibError(result.error, "socket recv failed");
+
+    return result.value;
+}
+
+AsyncSocket::RecvAwaiter AsyncSocket::async_recvsome(void *data, unsigned int sz) {
+    return RecvAwaiter(*this, data, sz);
+}
+
+bool AsyncSocket::SendAwaiter::try_complete() {
+    while (true) {
+        result = self.skt.try_sendsome(data + sent, sz - sent);
+        if (result.would_block())
+            return false;
+
+        if (not result.ok() or result.value == 0)
+            return true;
+
+        sent += result.value;
+        if (not all or sent == sz)
+            return true;
+    }
+}
+
+int AsyncSocket::SendAwaiter::await_resume() {
+    /*
+     * Mismas reglas que `Socket::sendsome` y `Socket::sendall`:
+     * si la conexión se cerro se retorna 0 salvo que ya se hubiera
+     * enviado algo con `sendall`.
+     * */
+    if (not result.ok() and result.error != EPIPE)
+        throw LibError(result.error, "socket send failed");
+
+    if (result.value == 0) {
+        if (all and sent)
+            throw LibError(EPIPE, "socket sent only %d of %d bytes", sent, sz);
+        return 0;
+    }
+
+    return sent;
+}
+
+AsyncSocket::SendAwaiter AsyncSocket::async_sendsome(const void *data, unsigned int sz) {
+    return SendAwaiter(*this, data, sz, false);
+}
+
+AsyncSocket::SendAwaiter AsyncSocket::async_sendall(const void *data, unsigned int sz) {
+    return SendAwaiter(*this, data, sz, true);
+}
+
+bool AsyncSocket::AcceptAwaiter::try_complete() {
+    while (true) {
+        peer = self.skt.try_accept(error);
+        if (peer)
+            return true;
+
+        /*
+         * El cliente se fue antes de que lo aceptáramos: probamos
+         * con la siguiente conexión pendiente (si la hay).
+         * */
+        if (error == ECONNABORTED)
+            continue;
+
+        return not (error == EAGAIN or error == EWOULDBLOCK);
+    }
+}
+
+AsyncSocket AsyncSocket::AcceptAwaiter::await_resume() {
+    if (not peer)
+        throw LibError(error, "socket accept failed");
+
+    return AsyncSocket(*self.waiters->sched, std::move(*peer));
+}
+
+AsyncSocket::AcceptAwaiter AsyncSocket::async_accept() {
+    return AcceptAwaiter(*this);
+}
+
+/*
+ * Espera a que termine un `connect` no-bloqueante en curso.
+ *
+ * El socket se vuelve "escribible" cuando el `connect` termina, bien o
+ * mal: el resultado se lee con `getsockopt(SO_ERROR)`.
+ * */
+struct AsyncSocket::ConnectAwaiter : IOWait {
+    AsyncSocket& self;
+    int error;
+
+    explicit ConnectAwaiter(AsyncSocket& self) : self(self), error(0) {}
+
+    bool try_complete() override {
+        socklen_t len = sizeof(error);
+        if (getsockopt(self.skt.skt, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+            error = errno;
+        return true;
+    }
+
+    /*
+     * No podemos preguntar antes de tiempo: mientras el `connect`
+     * esta en curso `SO_ERROR` es 0 igual que si hubiera terminado bien.
+     * */
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) { waiting = h; self.wait_writable(this); }
+    int await_resume() { return error; }
+};
+
+Task<AsyncSocket> AsyncSocket::async_connect(
+        Scheduler& sched,
+        const char *hostname,
+        const char *servname) {
+    Resolver resolver(hostname, servname, false);
+    int saved_errno = 0;
+
+    while (resolver.has_next()) {
+        struct addrinfo *addr = resolver.next();
+
+        int fd = ::socket(addr->ai_family,
+                addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                addr->ai_protocol);
+        if (fd == -1) {
+            saved_errno = errno;
+            continue;
+        }
+
+        /*
+         * Si el `connect` no termina inmediatamente (lo normal) retorna
+         * `EINPROGRESS` y hay que esperar a que el socket sea escribible.
+         * */
+        int s = connect(fd, addr->ai_addr, addr->ai_addrlen);
+        if (s == -1 and errno != EINPROGRESS) {
+            saved_errno = errno;
+            ::close(fd);
+            continue;
+        }
+
+        AsyncSocket conn(sched, Socket(fd));
+        if (s == -1)
+            saved_errno = co_await ConnectAwaiter(conn);
+        else
+            saved_errno = 0;
+
+        if (saved_errno == 0)
+            co_return conn;
+    }
+
+    throw LibError(
+            saved_errno,
+            "socket construction failed (connect to %s:%s)",
+            (hostname ? hostname : ""),
+            (servname ? servname : ""));
+}
+
+Socket& AsyncSocket::socket() {
+    return skt;
+}
+
+AsyncSocket& AsyncSocket::operator=(AsyncSocket&& other) {
+    if (this == &other)
+        return *this;
+
+    if (waiters)
+        waiters->sched->reactor().remove(skt);
+
+    skt = std::move(other.skt);
+    waiters = std::move(other.waiters);
+    return *this;
+}
+
+AsyncSocket::~AsyncSocket() {
+    /*
+     * Si fuimos movidos, `waiters` es nulo y no hay nada que
+     * des-registrar. `Reactor::remove` lanza si algo falla: en un
+     * destructor no podemos hacer mucho más que ignorarlo.
+     * */
+    if (not waiters)
+        return;
+
+    try {
+        waiters->sched->reactor().remove(skt);
+    } catch (...) {
+    }
+}
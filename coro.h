@@ -0,0 +1,412 @@
+#ifndef CORO_H
+#define CORO_H
+
+/*
+ * Este header requiere C++20 (corrutinas): véase el target
+ * `echo_server_coro` en el Makefile.
+ * */
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "socket.h"
+#include "reactor.h"
+
+class Scheduler;
+
+/*
+ * Con sockets no-bloqueantes y callbacks (véase `echo_epoll.cpp`) el
+ * simple loop "recibir y reenviar" de `echo_server.cpp` se convierte en
+ * una máquina de estados: que quedo pendiente, a que evento hay que
+ * suscribirse, que hacer cuando llegue...
+ *
+ * Las corrutinas de C++20 nos permiten escribir el código como si fuera
+ * bloqueante:
+ *
+ *  Task<> echo(AsyncSocket peer) {
+ *      char buf[512];
+ *      while (true) {
+ *          int sz = co_await peer.async_recvsome(buf, sizeof(buf));
+ *          if (sz == 0)
+ *              break;
+ *          co_await peer.async_sendall(buf, sz);
+ *      }
+ *  }
+ *
+ * pero cada `co_await` que "bloquearía" en realidad *suspende* la
+ * corrutina (guardando su estado, variables locales incluidas) y le
+ * devuelve el control al `Scheduler`, que mientras tanto atiende a otras.
+ * Cuando el socket este listo el `Scheduler` la retoma donde quedo.
+ *
+ * Un único thread atiende así miles de conexiones, cada una con su código
+ * "lineal", sin un thread por conexión.
+ * */
+
+namespace coro_detail {
+/*
+ * Lo que tienen en común todos los `Task<T>::promise_type`.
+ *
+ * El "promise" es el objeto que C++ crea junto con el estado (frame) de
+ * la corrutina y a través del cual la corrutina y quien la espera se
+ * comunican: donde queda el resultado, la excepción, a quien retomar
+ * al terminar.
+ * */
+struct PromiseBase {
+    /*
+     * La corrutina que hizo `co_await` de esta y que hay que retomar
+     * cuando esta termine.
+     * */
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    /*
+     * Si la tarea fue "lanzada" con `Scheduler::spawn` nadie la espera:
+     * al terminar le avisa al scheduler y se destruye sola.
+     * */
+    Scheduler *detached_in = nullptr;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept;
+
+        void await_resume() noexcept {}
+    };
+
+    /*
+     * Las tareas son "perezosas": no empiezan hasta que alguien
+     * las espera (`co_await`) o las lanza (`Scheduler::spawn`).
+     * */
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { error = std::current_exception(); }
+};
+}
+
+/*
+ * Una corrutina que eventualmente retorna un `T` (o lanza una excepción).
+ *
+ * Se puede esperar con `co_await` desde otra corrutina o lanzar
+ * con `Scheduler::spawn` (solo `Task<void>`).
+ * */
+template<typename T = void>
+class Task {
+    public:
+    struct promise_type : coro_detail::PromiseBase {
+        std::optional<T> value;
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_value(T v) { value.emplace(std::move(v)); }
+    };
+
+    private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+    public:
+    bool await_ready() const noexcept { return false; }
+
+    /*
+     * "Transferencia simétrica": en vez de llamar a `resume` (y apilar
+     * un frame más en el stack por cada `co_await`) le decimos a C++ que
+     * salte directamente a la tarea esperada.
+     * */
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() {
+        if (handle.promise().error)
+            std::rethrow_exception(handle.promise().error);
+        return std::move(*handle.promise().value);
+    }
+
+    std::coroutine_handle<promise_type> release() {
+        return std::exchange(handle, nullptr);
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    Task(Task&& other) : handle(std::exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle)
+            handle.destroy();
+    }
+};
+
+template<>
+class Task<void> {
+    public:
+    struct promise_type : coro_detail::PromiseBase {
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_void() {}
+    };
+
+    private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+    public:
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume() {
+        if (handle.promise().error)
+            std::rethrow_exception(handle.promise().error);
+    }
+
+    std::coroutine_handle<promise_type> release() {
+        return std::exchange(handle, nullptr);
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    Task(Task&& other) : handle(std::exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle)
+            handle.destroy();
+    }
+};
+
+/*
+ * Scheduler de corrutinas de un único thread, sobre un `Reactor` (`epoll`).
+ *
+ * Mantiene una cola de corrutinas listas para correr; cuando se vacía
+ * espera en el reactor a que algún socket este listo y retoma a las
+ * corrutinas que lo esperaban.
+ * */
+class Scheduler {
+    private:
+    Reactor reactor_;
+    std::deque<std::coroutine_handle<>> ready;
+    size_t live;
+    bool stopped;
+    std::exception_ptr first_error;
+
+    friend struct coro_detail::PromiseBase;
+    void task_done(std::exception_ptr error);
+
+    public:
+    Scheduler();
+
+    /*
+     * Lanza una tarea "independiente": nadie la espera y el scheduler
+     * se hace cargo de ella. Empezara a correr en `Scheduler::run`.
+     * */
+    void spawn(Task<> task);
+
+    /*
+     * Encola una corrutina suspendida para ser retomada.
+     * */
+    void schedule(std::coroutine_handle<> h);
+
+    /*
+     * Corre hasta que no queden tareas vivas o alguien llame
+     * a `Scheduler::stop`.
+     *
+     * Si una tarea lanzada con `Scheduler::spawn` termina con una
+     * excepción, `Scheduler::run` la relanza (atrapalas dentro de
+     * la tarea si no queres eso).
+     * */
+    void run();
+    void stop();
+
+    Reactor& reactor();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+    Scheduler(Scheduler&&) = delete;
+    Scheduler& operator=(Scheduler&&) = delete;
+};
+
+template<typename Promise>
+std::coroutine_handle<> coro_detail::PromiseBase::FinalAwaiter::await_suspend(
+        std::coroutine_handle<Promise> h) noexcept {
+    PromiseBase& p = h.promise();
+    if (p.detached_in) {
+        Scheduler *sched = p.detached_in;
+        std::exception_ptr error = p.error;
+        h.destroy();
+        sched->task_done(error);
+        return std::noop_coroutine();
+    }
+
+    return p.continuation ? p.continuation : std::noop_coroutine();
+}
+
+/*
+ * Una operación de I/O en espera: la corrutina `waiting` esta suspendida
+ * hasta que `try_complete` (que reintenta la operación) retorne `true`.
+ * */
+struct IOWait {
+    std::coroutine_handle<> waiting;
+    virtual bool try_complete() = 0;
+
+    protected:
+    ~IOWait() = default;
+};
+
+/*
+ * Un `Socket` no-bloqueante registrado en un `Scheduler`, con
+ * operaciones "esperables" (`co_await`).
+ *
+ * Solo puede haber una corrutina esperando para leer (o aceptar)
+ * y una esperando para escribir a la vez.
+ * */
+class AsyncSocket {
+    private:
+    /*
+     * Quien espera poder leer y quien espera poder escribir. Viven en el
+     * heap para que el handler registrado en el reactor pueda guardarse
+     * un puntero a ellos aunque el `AsyncSocket` se mueva.
+     * */
+    struct Waiters {
+        Scheduler *sched;
+        IOWait *reader = nullptr;
+        IOWait *writer = nullptr;
+    };
+
+    Socket skt;
+    std::unique_ptr<Waiters> waiters;
+
+    void wait_readable(IOWait *op);
+    void wait_writable(IOWait *op);
+
+    struct RecvAwaiter;
+    struct SendAwaiter;
+    struct AcceptAwaiter;
+    struct ConnectAwaiter;
+
+    public:
+    /*
+     * Toma posesión de `skt`, lo pone en modo no-bloqueante
+     * y lo registra en el scheduler.
+     * */
+    AsyncSocket(Scheduler& sched, Socket&& skt);
+
+    /*
+     * Como `Socket::recvsome`: retorna la cantidad de bytes recibidos
+     * o 0 si la conexión se cerró. Si hay un error se lanza una excepción.
+     * */
+    RecvAwaiter async_recvsome(void *data, unsigned int sz);
+
+    /*
+     * Como `Socket::sendsome` y `Socket::sendall` respectivamente.
+     * */
+    SendAwaiter async_sendsome(const void *data, unsigned int sz);
+    SendAwaiter async_sendall(const void *data, unsigned int sz);
+
+    /*
+     * Como `Socket::accept` (el socket debe ser un socket aceptador).
+     * */
+    AcceptAwaiter async_accept();
+
+    /*
+     * Como `Socket::Socket(const char*, const char*)`: se conecta a
+     * `hostname:servname` probando cada dirección de a una, pero sin
+     * bloquear al thread mientras tanto.
+     * */
+    static Task<AsyncSocket> async_connect(
+            Scheduler& sched,
+            const char *hostname,
+            const char *servname);
+
+    Socket& socket();
+
+    AsyncSocket(const AsyncSocket&) = delete;
+    AsyncSocket& operator=(const AsyncSocket&) = delete;
+
+    AsyncSocket(AsyncSocket&&) = default;
+    AsyncSocket& operator=(AsyncSocket&&);
+
+    ~AsyncSocket();
+};
+
+struct AsyncSocket::RecvAwaiter : IOWait {
+    AsyncSocket& self;
+    void *data;
+    unsigned int sz;
+    IOResult result;
+
+    RecvAwaiter(AsyncSocket& self, void *data, unsigned int sz) :
+        self(self), data(data), sz(sz), result{-1, 0} {}
+
+    bool try_complete() override;
+
+    bool await_ready() { return try_complete(); }
+    void await_suspend(std::coroutine_handle<> h) { waiting = h; self.wait_readable(this); }
+    int await_resume();
+};
+
+struct AsyncSocket::SendAwaiter : IOWait {
+    AsyncSocket& self;
+    const char *data;
+    unsigned int sz;
+    unsigned int sent;
+    bool all;
+    IOResult result;
+
+    SendAwaiter(AsyncSocket& self, const void *data, unsigned int sz, bool all) :
+        self(self), data((const char*)data), sz(sz), sent(0), all(all), result{-1, 0} {}
+
+    bool try_complete() override;
+
+    bool await_ready() { return try_complete(); }
+    void await_suspend(std::coroutine_handle<> h) { waiting = h; self.wait_writable(this); }
+    int await_resume();
+};
+
+struct AsyncSocket::AcceptAwaiter : IOWait {
+    AsyncSocket& self;
+    std::optional<Socket> peer;
+    int error;
+
+    explicit AcceptAwaiter(AsyncSocket& self) : self(self), error(0) {}
+
+    bool try_complete() override;
+
+    bool await_ready() { return try_complete(); }
+    void await_suspend(std::coroutine_handle<> h) { waiting = h; self.wait_readable(this); }
+    AsyncSocket await_resume();
+};
+
+#endif
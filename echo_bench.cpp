@@ -0,0 +1,514 @@
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "socket.h"
+#include "reactor.h"
+#include "latency_histogram.h"
+#include "liberror.h"
+
+/*
+ * Generador de carga para `echo_server` (y `echo_server_coro`).
+ *
+ * Abre `conns` conexiones al servidor, le envía mensajes de `size` bytes
+ * y mide cuanto tarda cada uno en volver (el eco). Al final imprime
+ * un reporte en JSON (una línea) con la latencia (p50, p99, p99.9),
+ * los mensajes por segundo y los Gb/s.
+ *
+ *  ./echo_bench 127.0.0.1 8080 conns=64 size=64 mode=closed depth=1
+ *  ./echo_bench 127.0.0.1 8080 conns=64 size=64 mode=open rate=200000
+ *
+ * Hay dos formas de generar la carga:
+ *
+ *  - "closed loop" (`mode=closed`): cada conexión tiene siempre `depth`
+ *    mensajes en vuelo y envía uno nuevo recién cuando vuelve uno.
+ *    Mide cuanto *puede* dar el servidor: si el servidor se frena, el
+ *    generador también.
+ *
+ *  - "open loop" (`mode=open`): los mensajes se envían a un ritmo fijo
+ *    (`rate` mensajes por segundo en total) sin importar si el servidor
+ *    responde o no, como llegan los pedidos de usuarios reales.
+ *
+ * En un closed loop un servidor que se traba por 1 segundo arruina
+ * *una* medición: el generador también se traba y no envía nada
+ * mientras tanto. Las latencias de todos los mensajes que *debieron*
+ * haberse enviado en ese segundo nunca se miden ("coordinated omission").
+ *
+ * En el open loop la latencia de cada mensaje se mide desde el momento
+ * en que *debió* enviarse, no desde que efectivamente se envió: si el
+ * generador se atrasa (por ejemplo porque el buffer de envío se lleno)
+ * ese atraso se cuenta.
+ *
+ * Opciones (todas `clave=valor`, en cualquier orden):
+ *
+ *  - `conns`: cantidad de conexiones (64).
+ *  - `threads`: cantidad de threads; las conexiones se reparten entre
+ *    ellos (1).
+ *  - `size`: tamaño de cada mensaje en bytes (64).
+ *  - `mode`: `closed` u `open` (`closed`).
+ *  - `depth`: mensajes en vuelo por conexión en `mode=closed` (1).
+ *  - `rate`: mensajes por segundo en total en `mode=open` (10000).
+ *  - `duration`: segundos a medir (5).
+ *  - `warmup`: segundos previos que no se miden (1).
+ *  - `label`: texto libre que se copia al reporte (por ejemplo,
+ *    el modo del servidor).
+ * */
+
+struct BenchOptions {
+    const char *hostname;
+    const char *servname;
+    unsigned int conns = 64;
+    unsigned int threads = 1;
+    unsigned int size = 64;
+    bool open_loop = false;
+    unsigned int depth = 1;
+    double rate = 10000;
+    double duration = 5;
+    double warmup = 1;
+    std::string label;
+};
+
+/*
+ * Resultado de un thread del generador.
+ * */
+struct BenchResult {
+    LatencyHistogram latency;
+    uint64_t messages = 0;
+    uint64_t errors = 0;
+    SocketCounters io;
+};
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Una conexión del generador.
+ *
+ * El servidor devuelve los bytes en el mismo orden en que los
+ * enviamos: no hace falta marcar los mensajes, alcanza con contar bytes.
+ * Cuando los bytes recibidos completan un mensaje, el mensaje que
+ * completaron es el más viejo de `inflight`.
+ * */
+struct BenchConnection {
+    Socket skt;
+
+    /*
+     * El momento en que se envió (o debió enviarse) cada mensaje
+     * en vuelo, en orden.
+     * */
+    std::deque<int64_t> inflight;
+
+    /*
+     * Bytes que faltan enviar: `unsent_msgs` mensajes, del primero de
+     * los cuales ya se enviaron `out_off` bytes.
+     * */
+    uint64_t unsent_msgs = 0;
+    unsigned int out_off = 0;
+
+    /*
+     * Bytes recibidos del mensaje que todavía no termino de volver.
+     * */
+    unsigned int in_off = 0;
+
+    /*
+     * Cuando toca enviar el próximo mensaje (solo en `mode=open`).
+     * */
+    int64_t next_send_ns = 0;
+
+    bool waiting_writable = false;
+    bool failed = false;
+
+    explicit BenchConnection(Socket&& skt) : skt(std::move(skt)) {}
+};
+
+class BenchWorker {
+    private:
+    const BenchOptions& opts;
+    unsigned int nconns;
+
+    Reactor reactor;
+    std::list<BenchConnection> conns;
+
+    /*
+     * Todos los mensajes son iguales: `out` tiene varios seguidos así
+     * se pueden enviar muchos con un único `Socket::sendsome` y `in`
+     * es donde se reciben (y se descartan) los ecos.
+     * */
+    std::vector<char> out;
+    std::vector<char> in;
+
+    int64_t measure_from_ns;
+    int64_t interval_ns;
+
+    BenchResult result;
+
+    void issue(BenchConnection& conn, int64_t at) {
+        conn.inflight.push_back(at);
+        ++conn.unsent_msgs;
+    }
+
+    void fail(BenchConnection& conn) {
+        if (conn.failed)
+            return;
+
+        conn.failed = true;
+        ++result.errors;
+        reactor.remove(conn.skt);
+    }
+
+    void flush(BenchConnection& conn) {
+        const unsigned int size = opts.size;
+
+        while (conn.unsent_msgs > 0) {
+            /*
+             * `out` es periódico (el mismo mensaje repetido): empezando
+             * en `out_off` sigue siendo la continuación correcta.
+             * */
+            uint64_t pending = conn.unsent_msgs * size - conn.out_off;
+            unsigned int sz = std::min<uint64_t>(pending, out.size() - conn.out_off);
+
+            IOResult r = conn.skt.try_sendsome(out.data() + conn.out_off, sz);
+            if (r.would_block())
+                break;
+            if (r.value <= 0)
+                return fail(conn);
+
+            uint64_t sent = conn.out_off + r.value;
+            conn.unsent_msgs -= sent / size;
+            conn.out_off = sent % size;
+        }
+
+        /*
+         * Solo pedimos `EPOLLOUT` mientras haya algo trabado: si no
+         * `epoll` nos despertaría todo el tiempo.
+         * */
+        bool want = conn.unsent_msgs > 0;
+        if (want != conn.waiting_writable) {
+            reactor.modify(conn.skt, want ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+            conn.waiting_writable = want;
+        }
+    }
+
+    void receive(BenchConnection& conn) {
+        const unsigned int size = opts.size;
+
+        for (int i = 0; i < 8; ++i) {
+            IOResult r = conn.skt.try_recvsome(in.data(), in.size());
+            if (r.would_block())
+                break;
+            if (r.value <= 0)
+                return fail(conn);
+
+            int64_t now = now_ns();
+            uint64_t got = conn.in_off + r.value;
+            uint64_t done = got / size;
+            conn.in_off = got % size;
+
+            for (uint64_t m = 0; m < done and not conn.inflight.empty(); ++m) {
+                int64_t t0 = conn.inflight.front();
+                conn.inflight.pop_front();
+
+                if (t0 >= measure_from_ns) {
+                    result.latency.record(now - t0);
+                    ++result.messages;
+                }
+
+                if (not opts.open_loop)
+                    issue(conn, now);
+            }
+
+            /*
+             * Si no se lleno el buffer es que no había más: nos ahorramos
+             * el `recv` extra que solo nos diría `EAGAIN`.
+             * */
+            if ((size_t)r.value < in.size())
+                break;
+        }
+
+        flush(conn);
+    }
+
+    /*
+     * Envía los mensajes que ya debieron enviarse. Retorna cuanto falta
+     * para el próximo.
+     * */
+    int64_t pace(int64_t now) {
+        int64_t next = INT64_MAX;
+        for (auto& conn : conns) {
+            if (conn.failed)
+                continue;
+
+            bool issued = false;
+            while (conn.next_send_ns <= now) {
+                issue(conn, conn.next_send_ns);
+                conn.next_send_ns += interval_ns;
+                issued = true;
+            }
+
+            if (issued)
+                flush(conn);
+
+            next = std::min(next, conn.next_send_ns);
+        }
+
+        return next - now;
+    }
+
+    public:
+    BenchWorker(const BenchOptions& opts, unsigned int nconns) :
+        opts(opts),
+        nconns(nconns),
+        out(std::max<size_t>(opts.size, (65536 / opts.size) * opts.size), 'x'),
+        in(65536),
+        measure_from_ns(0),
+        interval_ns(0) {}
+
+    BenchResult run() {
+        if (nconns == 0)
+            return BenchResult();
+
+        /*
+         * Linux agrupa los despertares de los timers (por default con
+         * un margen de 50us) para ahorrar energía: una espera de 10us
+         * dura 60us. Nosotros queremos despertarnos a tiempo.
+         * */
+        prctl(PR_SET_TIMERSLACK, 1UL);
+
+        ConnectOptions copts;
+        copts.tuning.nodelay = true;
+
+        for (unsigned int i = 0; i < nconns; ++i) {
+            conns.emplace_back(Socket(opts.hostname, opts.servname, copts));
+
+            BenchConnection& conn = conns.back();
+            conn.skt.set_nonblocking(true);
+            reactor.add(conn.skt, EPOLLIN, [this, &conn](uint32_t events) {
+                if (events & (EPOLLERR | EPOLLHUP))
+                    return fail(conn);
+
+                if (events & EPOLLOUT)
+                    flush(conn);
+
+                if (not conn.failed and (events & EPOLLIN))
+                    receive(conn);
+            });
+        }
+
+        const int64_t start = now_ns();
+        measure_from_ns = start + (int64_t)(opts.warmup * 1e9);
+        const int64_t end = measure_from_ns + (int64_t)(opts.duration * 1e9);
+
+        if (opts.open_loop) {
+            /*
+             * Cada conexión envía a `rate / conns` mensajes por segundo.
+             * Las desfasamos para que no envíen todas a la vez.
+             * */
+            interval_ns = std::max<int64_t>(1, (int64_t)(opts.conns * 1e9 / opts.rate));
+            int64_t i = 0;
+            for (auto& conn : conns)
+                conn.next_send_ns = start + (i++ * interval_ns) / nconns;
+        } else {
+            for (auto& conn : conns) {
+                for (unsigned int d = 0; d < opts.depth; ++d)
+                    issue(conn, start);
+                flush(conn);
+            }
+        }
+
+        while (true) {
+            int64_t now = now_ns();
+            if (now >= end)
+                break;
+
+            /*
+             * En `mode=open` nos despertamos a tiempo para el próximo
+             * envío: con una resolución de milisegundos (`epoll_wait`)
+             * enviaríamos de a ráfagas.
+             * */
+            int64_t timeout_ns = end - now;
+            if (opts.open_loop)
+                timeout_ns = std::min(timeout_ns, pace(now));
+
+            reactor.run_once_ns(timeout_ns);
+        }
+
+        for (auto& conn : conns)
+            result.io += conn.skt.counters();
+
+        return result;
+    }
+
+    ~BenchWorker() {
+        for (auto& conn : conns)
+            if (not conn.failed)
+                reactor.remove(conn.skt);
+    }
+};
+
+static unsigned int parse_uint(const std::string& key, const std::string& value) {
+    char *end = nullptr;
+    unsigned long v = strtoul(value.c_str(), &end, 10);
+    if (value.empty() or *end != '\0' or v == 0)
+        throw std::runtime_error("invalid value for " + key + ": '" + value + "'");
+    return v;
+}
+
+static double parse_double(const std::string& key, const std::string& value) {
+    char *end = nullptr;
+    double v = strtod(value.c_str(), &end);
+    if (value.empty() or *end != '\0' or v < 0)
+        throw std::runtime_error("invalid value for " + key + ": '" + value + "'");
+    return v;
+}
+
+static BenchOptions parse_options(int argc, char *argv[]) {
+    BenchOptions opts;
+    opts.hostname = argv[1];
+    opts.servname = argv[2];
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("expected key=value, got '" + arg + "'");
+
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+
+        if (key == "conns")
+            opts.conns = parse_uint(key, value);
+        else if (key == "threads")
+            opts.threads = parse_uint(key, value);
+        else if (key == "size")
+            opts.size = parse_uint(key, value);
+        else if (key == "depth")
+            opts.depth = parse_uint(key, value);
+        else if (key == "rate")
+            opts.rate = parse_double(key, value);
+        else if (key == "duration")
+            opts.duration = parse_double(key, value);
+        else if (key == "warmup")
+            opts.warmup = parse_double(key, value);
+        else if (key == "label")
+            opts.label = value;
+        else if (key == "mode" and (value == "open" or value == "closed"))
+            opts.open_loop = (value == "open");
+        else
+            throw std::runtime_error("unknown option '" + arg + "'");
+    }
+
+    if (opts.open_loop and opts.rate <= 0)
+        throw std::runtime_error("rate must be positive in open loop mode");
+
+    opts.threads = std::min(opts.threads, opts.conns);
+    return opts;
+}
+
+static void print_json(std::ostream& out, const BenchOptions& opts, const BenchResult& r) {
+    const double secs = opts.duration;
+    const double msgs_per_sec = r.messages / secs;
+
+    /*
+     * Los Gb/s son de datos útiles (payload) en cada dirección: el
+     * servidor recibe y envía la misma cantidad.
+     * */
+    const double gbps = msgs_per_sec * opts.size * 8 / 1e9;
+
+    out << "{\"label\": \"" << opts.label << "\""
+        << ", \"mode\": \"" << (opts.open_loop ? "open" : "closed") << "\""
+        << ", \"conns\": " << opts.conns
+        << ", \"threads\": " << opts.threads
+        << ", \"size\": " << opts.size
+        << ", \"depth\": " << (opts.open_loop ? 0 : opts.depth)
+        << ", \"rate\": " << (opts.open_loop ? opts.rate : 0)
+        << ", \"duration_s\": " << secs
+        << ", \"messages\": " << r.messages
+        << ", \"msgs_per_s\": " << msgs_per_sec
+        << ", \"gbps\": " << gbps
+        << ", \"errors\": " << r.errors
+        << ", \"latency_ns\": {"
+        << "\"min\": " << r.latency.min()
+        << ", \"mean\": " << r.latency.mean()
+        << ", \"p50\": " << r.latency.percentile(50)
+        << ", \"p99\": " << r.latency.percentile(99)
+        << ", \"p999\": " << r.latency.percentile(99.9)
+        << ", \"max\": " << r.latency.max()
+        << "}"
+        << ", \"client_syscalls\": {"
+        << "\"send\": " << r.io.send_calls
+        << ", \"recv\": " << r.io.recv_calls
+        << ", \"recv_would_block\": " << r.io.recv_would_block
+        << "}}\n";
+}
+
+int main(int argc, char *argv[]) { try {
+    if (argc < 3) {
+        std::cerr << "Bad program call. Expected "
+                << argv[0]
+                << " <hostname> <servname> [conns=N] [threads=N] [size=B]"
+                << " [mode=closed|open] [depth=N] [rate=msgs/s]"
+                << " [duration=s] [warmup=s] [label=text]\n";
+        return -1;
+    }
+
+    BenchOptions opts = parse_options(argc, argv);
+
+    std::vector<BenchResult> results(opts.threads);
+    std::vector<std::exception_ptr> errors(opts.threads);
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < opts.threads; ++t) {
+        /*
+         * Repartimos las conexiones lo más parejo posible.
+         * */
+        unsigned int n = opts.conns / opts.threads + (t < opts.conns % opts.threads ? 1 : 0);
+        threads.emplace_back([&opts, &results, &errors, t, n]() {
+            try {
+                BenchWorker worker(opts, n);
+                results[t] = worker.run();
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& th : threads)
+        th.join();
+
+    for (auto& err : errors)
+        if (err)
+            std::rethrow_exception(err);
+
+    BenchResult total;
+    for (auto& r : results) {
+        total.latency += r.latency;
+        total.messages += r.messages;
+        total.errors += r.errors;
+        total.io += r.io;
+    }
+
+    print_json(std::cout, opts, total);
+    return 0;
+} catch (const std::exception& err) {
+    std::cerr
+        << "Something went wrong and an exception was caught: "
+        << err.what()
+        << "\n";
+    return -1;
+} catch (...) {
+    std::cerr << "Something went wrong and an unknown exception was caught.\n";
+    return -1;
+} }
@@ -0,0 +1,66 @@
+#ifndef ECHO_CONNECTION_H
+#define ECHO_CONNECTION_H
+
+#include <sys/epoll.h>
+#include <cstdint>
+
+#include <utility>
+
+#include "socket.h"
+#include "buffer_pool.h"
+
+/*
+ * Estado de cada conexión de los modos no-bloqueantes del echo server
+ * (`echo_epoll`, `echo_reuseport` y `echo_pool`).
+ *
+ * A diferencia del modo simple, acá no podemos quedarnos "trabados"
+ * en un `Socket::sendall`: si el cliente no lee lo que le enviamos
+ * el buffer de envío se llena y `Socket::sendsome` nos retorna
+ * `Socket::WOULD_BLOCK`.
+ *
+ * En ese caso nos guardamos lo que falta enviar (`pending_off`,
+ * `pending_len`) y le pedimos al reactor que nos avise cuando podamos
+ * volver a escribir (`EPOLLOUT`). Mientras tanto dejamos de leer del
+ * cliente: si no podemos hacer eco no tiene sentido seguir recibiendo.
+ * */
+struct EchoConnection {
+    Socket skt;
+    uint32_t interest;
+    unsigned int pending_off;
+    unsigned int pending_len;
+
+    /*
+     * El buffer lo pedimos al pool recién cuando hay algo para leer
+     * y lo devolvemos apenas no quede nada pendiente: una conexión
+     * inactiva no ocupa buffer.
+     * */
+    PooledBuffer buf;
+
+    explicit EchoConnection(Socket&& skt) :
+        skt(std::move(skt)),
+        interest(EPOLLIN),
+        pending_off(0),
+        pending_len(0) {}
+};
+
+/*
+ * Atiende una conexión lista para ser leída y/o escrita: envía lo
+ * pendiente y hace eco de lo que haya para leer (sin bloquearse).
+ *
+ * Retorna `false` si la conexión debe cerrarse. Al retornar `true`,
+ * `EchoConnection::pending_len` indica si hay que esperar a poder
+ * escribir (`EPOLLOUT`) o a poder leer (`EPOLLIN`).
+ *
+ * Puede llamarse desde cualquier thread (pero no concurrentemente
+ * para la misma conexión).
+ * */
+bool echo_serve(EchoConnection& conn);
+
+/*
+ * Estadísticas del pool de buffers compartido por todas las conexiones.
+ * Si la mayoría de los buffers están libres, le devuelve su memoria al
+ * sistema operativo (véase `BufferPool::trim`).
+ * */
+BufferPoolStats echo_buffers_stats_and_trim();
+
+#endif
@@ -0,0 +1,266 @@
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "socket.h"
+#include "reactor.h"
+#include "buffer_pool.h"
+#include "echo_connection.h"
+#include "liberror.h"
+#include "echo_modes.h"
+
+static const unsigned int ECHO_BUFFER_SZ = 4096;
+
+/*
+ * Pool de buffers compartido por todas las conexiones (y todos los
+ * threads, véase `echo_reuseport` y `echo_pool`).
+ * */
+static BufferPool echo_buffers(ECHO_BUFFER_SZ, 1024);
+
+/*
+ * Envía lo pendiente. Retorna `false` si el cliente cerró la conexión
+ * (o hubo un error).
+ *
+ * Usamos las versiones sin excepciones de `Socket` (`Socket::try_sendsome`
+ * y `Socket::try_recvsome`): con miles de clientes, que alguno se
+ * desconecte de golpe (`ECONNRESET`, `EPIPE`) es algo de todos los días.
+ * */
+static bool flush_pending(EchoConnection& conn) {
+    while (conn.pending_len > 0) {
+        IOResult r = conn.skt.try_sendsome(conn.buf.data() + conn.pending_off, conn.pending_len);
+        if (r.would_block())
+            return true;
+        if (r.value <= 0)
+            return false;
+
+        conn.pending_off += r.value;
+        conn.pending_len -= r.value;
+    }
+
+    return true;
+}
+
+bool echo_serve(EchoConnection& conn) {
+    if (not flush_pending(conn))
+        return false;
+
+    if (not conn.buf)
+        conn.buf = PooledBuffer(echo_buffers);
+
+    /*
+     * Leemos (y hacemos eco) algunas veces seguidas para ahorrarnos
+     * llamadas a `epoll_wait` pero sin acaparar al thread:
+     * hay otros clientes esperando.
+     * */
+    for (int i = 0; i < 8 and conn.pending_len == 0; ++i) {
+        IOResult r = conn.skt.try_recvsome(conn.buf.data(), ECHO_BUFFER_SZ);
+        if (r.would_block())
+            break;
+        if (r.value <= 0)
+            return false;
+
+        conn.pending_off = 0;
+        conn.pending_len = r.value;
+        if (not flush_pending(conn))
+            return false;
+    }
+
+    return true;
+}
+
+static void on_connection_event(
+        Reactor& reactor,
+        std::list<EchoConnection>& conns,
+        std::list<EchoConnection>::iterator it) {
+    EchoConnection& conn = *it;
+
+    bool alive = false;
+    try {
+        alive = echo_serve(conn);
+    } catch (const LibError&) {
+        /*
+         * Un error inesperado en una conexión no debe tirar abajo
+         * al servidor entero: solo cerramos esa conexión.
+         * */
+        alive = false;
+    }
+
+    if (not alive) {
+        reactor.remove(conn.skt);
+        conns.erase(it);
+        return;
+    }
+
+    if (conn.pending_len == 0)
+        conn.buf.reset();
+
+    uint32_t interest = conn.pending_len ? EPOLLOUT : EPOLLIN;
+    if (interest != conn.interest) {
+        reactor.modify(conn.skt, interest);
+        conn.interest = interest;
+    }
+}
+
+BufferPoolStats echo_buffers_stats_and_trim() {
+    BufferPoolStats st = echo_buffers.stats();
+
+    /*
+     * Si la mayoría de los buffers están libres, le devolvemos
+     * su memoria al sistema operativo.
+     * */
+    if (st.in_use * 4 < st.free_global)
+        echo_buffers.trim();
+
+    return st;
+}
+
+AcceptErrorHandler::AcceptErrorHandler() :
+    reserve_fd(-1),
+    suppressed(0) {
+    open_reserve();
+}
+
+void AcceptErrorHandler::open_reserve() {
+    reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+void AcceptErrorHandler::handle(Socket& srv, const LibError& err) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_log >= std::chrono::seconds(1)) {
+        std::cerr << "Accept failed: " << err.what();
+        if (suppressed)
+            std::cerr << " (and " << suppressed << " more times)";
+        std::cerr << "\n";
+
+        last_log = now;
+        suppressed = 0;
+    } else {
+        ++suppressed;
+    }
+
+    bool no_fds = err.code() == EMFILE or err.code() == ENFILE;
+    if (no_fds and reserve_fd != -1) {
+        ::close(reserve_fd);
+        reserve_fd = -1;
+
+        /*
+         * El `Socket` aceptado se destruye (y se cierra) al salir
+         * del `try`.
+         * */
+        try {
+            srv.try_accept();
+        } catch (const LibError&) {
+        }
+
+        open_reserve();
+        return;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+AcceptErrorHandler::~AcceptErrorHandler() {
+    if (reserve_fd != -1)
+        ::close(reserve_fd);
+}
+
+ListenerOptions echo_listener_options() {
+    ListenerOptions opts;
+    opts.backlog = 4096;
+    opts.nonblocking = true;
+    return opts;
+}
+
+void raise_nofile_limit() {
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == -1)
+        return;
+
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+}
+
+int echo_epoll(const char *servname) {
+    raise_nofile_limit();
+
+    Socket srv(servname, echo_listener_options());
+    echo_epoll_loop(srv);
+    return 0;
+}
+
+void echo_epoll_loop(Socket& srv) {
+    srv.set_nonblocking(true);
+
+    Reactor reactor;
+
+    /*
+     * Usamos una `std::list` por que sus iteradores (y referencias)
+     * no se invalidan al agregar o sacar otros elementos: cada
+     * handler puede quedarse con el iterador a *su* conexión.
+     * */
+    std::list<EchoConnection> conns;
+
+    auto last_report = std::chrono::steady_clock::now();
+    AcceptErrorHandler accept_errors;
+
+    reactor.add(srv, EPOLLIN, [&](uint32_t) {
+        /*
+         * Aceptamos todas las conexiones pendientes de a tandas,
+         * no solo una.
+         * */
+        std::vector<Socket> peers;
+        while (true) {
+            try {
+                if (srv.accept_batch(peers, 64) == 0)
+                    break;
+            } catch (const LibError& err) {
+                accept_errors.handle(srv, err);
+                break;
+            }
+
+            for (auto& peer : peers) {
+                conns.emplace_front(std::move(peer));
+                auto it = conns.begin();
+                try {
+                    reactor.add(it->skt, EPOLLIN, [&reactor, &conns, it](uint32_t) {
+                        on_connection_event(reactor, conns, it);
+                    });
+                } catch (const LibError& err) {
+                    /*
+                     * Sin registrarla (por ejemplo, `epoll_ctl` sin
+                     * memoria) nunca sabríamos de ella: la cerramos,
+                     * pero el servidor sigue.
+                     * */
+                    std::cerr << "epoll: dropping a connection: " << err.what() << "\n";
+                    conns.erase(it);
+                }
+            }
+            peers.clear();
+        }
+
+        /*
+         * Cada tanto reportamos cuanta memoria usan los buffers: gracias
+         * al pool es proporcional a las conexiones *activas*, no al total.
+         * */
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report >= std::chrono::seconds(10)) {
+            last_report = now;
+            BufferPoolStats st = echo_buffers_stats_and_trim();
+            std::cerr << "buffers: " << conns.size() << " connections, "
+                      << st.in_use << " in use, "
+                      << st.free_global + st.free_cached << " free, "
+                      << st.mapped_bytes / 1024 << " KB mapped\n";
+        }
+    });
+
+    reactor.run();
+}
@@ -0,0 +1,105 @@
+#ifndef ECHO_MODES_H
+#define ECHO_MODES_H
+
+#include <chrono>
+
+/*
+ * Distintas implementaciones ("modos") del echo server.
+ *
+ * Todas reciben el nombre del servicio (puerto) en el cual escuchar
+ * y retornan el código de retorno del programa.
+ *
+ * El modo más simple (un único cliente, todo bloqueante) esta
+ * implementado directamente en `echo_server.cpp`.
+ * */
+
+/*
+ * Un único thread, sockets no-bloqueantes y un `Reactor` (`epoll`)
+ * para atender a miles de clientes concurrentemente.
+ * */
+int echo_epoll(const char *servname);
+
+/*
+ * El event loop del modo `epoll` sobre un socket aceptador ya creado.
+ * No retorna nunca (salvo por una excepción).
+ * */
+class Socket;
+struct ListenerOptions;
+void echo_epoll_loop(Socket& srv);
+
+/*
+ * Qué hacer cuando `Socket::accept_batch` falla en los modos basados
+ * en `epoll`.
+ *
+ * El error típico es `EMFILE` (o `ENFILE`): no nos quedan file
+ * descriptors. La conexión sigue en la cola del socket aceptador así
+ * que `epoll` nos vuelve a avisar inmediatamente y, si solo imprimimos
+ * el error, el event loop gira al 100% de CPU llenando la terminal
+ * de mensajes (y el cliente espera para siempre).
+ *
+ * El truco clásico: guardar un file descriptor de reserva (`/dev/null`)
+ * y, cuando nos quedamos sin, cerrarlo, aceptar la conexión, cerrarla
+ * de inmediato y volver a abrir la reserva. El cliente se entera (la
+ * conexión se cierra) y la cola avanza.
+ *
+ * Si no hay reserva (o el error es otro) esperamos un poco antes de
+ * volver a intentar. Y el error se imprime a lo sumo una vez por
+ * segundo.
+ * */
+class LibError;
+class AcceptErrorHandler {
+    private:
+    int reserve_fd;
+    std::chrono::steady_clock::time_point last_log;
+    unsigned long suppressed;
+
+    void open_reserve();
+
+    public:
+    AcceptErrorHandler();
+
+    void handle(Socket& srv, const LibError& err);
+
+    AcceptErrorHandler(const AcceptErrorHandler&) = delete;
+    AcceptErrorHandler& operator=(const AcceptErrorHandler&) = delete;
+
+    ~AcceptErrorHandler();
+};
+
+/*
+ * Opciones de los sockets aceptadores de los modos basados en `epoll`:
+ * no-bloqueantes y con un backlog grande para soportar ráfagas
+ * de conexiones.
+ * */
+ListenerOptions echo_listener_options();
+
+/*
+ * Un thread por core, cada uno fijado (pinned) a su core y con su propio
+ * socket aceptador (`SO_REUSEPORT`) y su propio event loop `epoll`.
+ * Los threads no comparten nada.
+ * */
+int echo_reuseport(const char *servname);
+
+/*
+ * Un thread que solo acepta conexiones y espera eventos (`epoll` con
+ * `EPOLLONESHOT`, véase `SharedPoller`) y un pool de workers con work
+ * stealing (véase `WorkStealingPool`) que atiende a las conexiones listas.
+ * */
+int echo_pool(const char *servname);
+
+/*
+ * Un único thread y `io_uring` (véase `URing`): accept y recv multishot
+ * con buffers provistos al kernel y envíos encadenados.
+ *
+ * Cada 10 segundos reporta cuantas syscalls se hicieron por byte.
+ * */
+int echo_uring(const char *servname);
+
+/*
+ * Sube el límite de file descriptors abiertos al máximo permitido:
+ * cada conexión consume uno y el límite por default (típicamente 1024)
+ * es muy bajo para servidores de muchas conexiones.
+ * */
+void raise_nofile_limit();
+
+#endif
@@ -0,0 +1,164 @@
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "socket.h"
+#include "shared_poller.h"
+#include "work_pool.h"
+#include "echo_connection.h"
+#include "liberror.h"
+#include "echo_modes.h"
+
+/*
+ * Una conexión del modo `pool`: además del estado de eco recordamos
+ * en que worker corrió por última vez (su "casa").
+ * */
+struct PooledEchoConnection {
+    EchoConnection conn;
+    unsigned int home;
+
+    PooledEchoConnection(Socket&& skt, unsigned int home) :
+        conn(std::move(skt)),
+        home(home) {}
+};
+
+static std::atomic<size_t> live_connections(0);
+
+/*
+ * El trabajo que corre un worker cuando una conexión esta lista.
+ *
+ * Por `EPOLLONESHOT` nadie más toca a esta conexión hasta que la
+ * rearmemos: podemos atenderla, o cerrarla y liberarla, sin locks.
+ * */
+static void on_ready(SharedPoller& poller, WorkStealingPool& pool, PooledEchoConnection *pconn) {
+    EchoConnection& conn = pconn->conn;
+
+    bool alive = false;
+    try {
+        alive = echo_serve(conn);
+    } catch (const LibError&) {
+        alive = false;
+    }
+
+    if (alive) {
+        if (conn.pending_len == 0)
+            conn.buf.reset();
+
+        /*
+         * Si otro worker nos robo, los datos de la conexión ahora están
+         * en *su* cache: la próxima vez la encolamos a él.
+         * */
+        pconn->home = pool.current_worker();
+
+        conn.interest = conn.pending_len ? EPOLLOUT : EPOLLIN;
+        try {
+            poller.rearm(conn.skt, conn.interest, pconn);
+            return;
+        } catch (const LibError&) {
+            /*
+             * Si no la podemos rearmar nadie más nos avisara de esta
+             * conexión: la cerramos acá (y no dejamos que la excepción
+             * se escape al pool, que no sabe que hacer con ella).
+             * */
+        }
+    }
+
+    try {
+        poller.remove(conn.skt);
+    } catch (const LibError&) {
+        /* Al cerrar el socket (`delete`) el kernel lo saca igual. */
+    }
+
+    delete pconn;
+    --live_connections;
+}
+
+int echo_pool(const char *servname) {
+    raise_nofile_limit();
+
+    Socket srv(servname, echo_listener_options());
+
+    SharedPoller poller;
+    WorkStealingPool pool;
+
+    /*
+     * El socket aceptador no es una conexión: lo distinguimos por
+     * su cookie nulo.
+     * */
+    poller.add(srv, EPOLLIN, nullptr);
+
+    /*
+     * Este thread solo acepta conexiones y espera eventos: el trabajo
+     * de cada conexión lo hacen los workers del pool.
+     *
+     * Las conexiones nuevas se reparten entre los workers de a una
+     * (round-robin); después cada conexión vuelve siempre a su "casa"
+     * salvo que otro worker, ocioso, se la robe.
+     * */
+    unsigned int next_home = 0;
+    AcceptErrorHandler accept_errors;
+    std::vector<Socket> peers;
+    std::vector<PollEvent> ready(1024);
+
+    auto last_report = std::chrono::steady_clock::now();
+
+    while (true) {
+        int n = poller.wait(ready, 10000);
+
+        for (int i = 0; i < n; ++i) {
+            if (ready[i].cookie == nullptr) {
+                while (true) {
+                    try {
+                        if (srv.accept_batch(peers, 64) == 0)
+                            break;
+                    } catch (const LibError& err) {
+                        accept_errors.handle(srv, err);
+                        break;
+                    }
+
+                    for (auto& peer : peers) {
+                        auto *pconn = new PooledEchoConnection(std::move(peer), next_home++ % pool.size());
+                        ++live_connections;
+                        try {
+                            poller.add(pconn->conn.skt, EPOLLIN, pconn);
+                        } catch (const LibError& err) {
+                            /*
+                             * Sin registrarla (por ejemplo, `epoll_ctl`
+                             * sin memoria) nunca sabríamos de ella: la
+                             * cerramos, pero el servidor sigue.
+                             * */
+                            std::cerr << "pool: dropping a connection: " << err.what() << "\n";
+                            delete pconn;
+                            --live_connections;
+                        }
+                    }
+                    peers.clear();
+                }
+
+                poller.rearm(srv, EPOLLIN, nullptr);
+                continue;
+            }
+
+            auto *pconn = (PooledEchoConnection*)ready[i].cookie;
+            pool.submit(pconn->home, [&poller, &pool, pconn] {
+                on_ready(poller, pool, pconn);
+            });
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report >= std::chrono::seconds(10)) {
+            last_report = now;
+            BufferPoolStats st = echo_buffers_stats_and_trim();
+            std::cerr << "pool: " << live_connections << " connections, "
+                      << pool.jobs_executed() << " jobs, "
+                      << pool.jobs_stolen() << " stolen, "
+                      << st.in_use << " buffers in use\n";
+        }
+    }
+
+    return 0;
+}
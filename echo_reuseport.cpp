@@ -0,0 +1,113 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "socket.h"
+#include "liberror.h"
+#include "echo_modes.h"
+
+/*
+ * Fija (pin) el thread actual al core `cpu`.
+ *
+ * Así el thread, su socket y sus conexiones se quedan siempre en el mismo
+ * core: sus datos se mantienen "calientes" en la cache de ese core
+ * y el scheduler no los anda moviendo de un lado a otro.
+ * */
+static void pin_to_cpu(unsigned int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int s = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (s != 0)
+        throw LibError(s, "pthread_setaffinity_np failed for cpu %u", cpu);
+}
+
+/*
+ * Los cores en los que el proceso puede correr.
+ *
+ * No son necesariamente `0..hardware_concurrency()-1`: con `taskset`
+ * o con un cgroup (un container) el proceso puede estar restringido
+ * a unos pocos y fijar un thread a un core fuera de ese conjunto falla
+ * con `EINVAL`.
+ * */
+static std::vector<unsigned int> allowed_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == -1)
+        throw LibError(errno, "sched_getaffinity failed");
+
+    std::vector<unsigned int> cpus;
+    for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+
+    if (cpus.empty())
+        cpus.push_back(0);
+
+    return cpus;
+}
+
+static void worker(unsigned int cpu, Socket& srv) {
+    try {
+        pin_to_cpu(cpu);
+        echo_epoll_loop(srv);
+    } catch (const std::exception& err) {
+        /*
+         * Una excepción que escapa de un thread termina el programa
+         * (`std::terminate`). Preferimos reportarla y que los demás
+         * threads sigan atendiendo.
+         *
+         * Pero *tenemos* que cerrar nuestro socket aceptador: mientras
+         * siga escuchando el kernel le seguirá asignando conexiones
+         * (el reparto de `SO_REUSEPORT` no sabe que nadie las acepta)
+         * y esos clientes quedarían colgados. Al cerrarlo el kernel
+         * reparte entre los que quedan.
+         * */
+        std::cerr << "Worker on cpu " << cpu << " failed: " << err.what() << "\n";
+        try {
+            srv.close();
+        } catch (const std::exception& err) {
+            std::cerr << "Worker on cpu " << cpu << " could not close its listener: "
+                << err.what() << "\n";
+        }
+    }
+}
+
+int echo_reuseport(const char *servname) {
+    raise_nofile_limit();
+
+    std::vector<unsigned int> cpus = allowed_cpus();
+    unsigned int n = cpus.size();
+
+    /*
+     * Creamos todos los sockets aceptadores antes de lanzar los threads
+     * así, si alguno falla (por ejemplo si el puerto esta ocupado
+     * por otro programa), nos enteramos acá y no en un thread.
+     *
+     * Al escuchar todos en el mismo puerto con `SO_REUSEPORT` el kernel
+     * reparte las conexiones entrantes entre ellos: no hay un único
+     * `accept` por el que pasen todas las conexiones.
+     * */
+    ListenerOptions opts = echo_listener_options();
+    opts.reuse_port = true;
+
+    std::vector<Socket> listeners;
+    listeners.reserve(n);
+    for (unsigned int i = 0; i < n; ++i)
+        listeners.emplace_back(servname, opts);
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < n; ++i)
+        threads.emplace_back(worker, cpus[i], std::ref(listeners[i]));
+
+    for (auto& th : threads)
+        th.join();
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <exception>
+#include <string>
 #include "socket.h"
+#include "echo_modes.h"
 
 /*
  * Este programa es un mini echo server, un servidor TCP/IP que espera
@@ -23,18 +25,40 @@
  *
  *  nc 127.0.0.1 8080
  *
+ * Opcionalmente se puede elegir otro "modo" de servidor:
+ *
+ *  ./echo_server 8080 epoll
+ *
+ * Véase `echo_modes.h`.
  **/
 int main(int argc, char *argv[]) { try {
     int ret = -1;
 
     const char *servname = NULL;
+    std::string mode = "simple";
 
     if (argc == 2) {
         servname = argv[1];
+    } else if (argc == 3) {
+        servname = argv[1];
+        mode = argv[2];
     } else {
         std::cerr << "Bad program call. Expected "
                 << argv[0]
-                << " <servname>\n";
+                << " <servname> [simple|epoll|uring|reuseport|pool]\n";
+        return ret;
+    }
+
+    if (mode == "epoll") {
+        return echo_epoll(servname);
+    } else if (mode == "uring") {
+        return echo_uring(servname);
+    } else if (mode == "reuseport") {
+        return echo_reuseport(servname);
+    } else if (mode == "pool") {
+        return echo_pool(servname);
+    } else if (mode != "simple") {
+        std::cerr << "Unknown mode '" << mode << "'\n";
         return ret;
     }
 
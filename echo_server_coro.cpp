@@ -0,0 +1,75 @@
+#include <iostream>
+#include <exception>
+#include "socket.h"
+#include "coro.h"
+
+/*
+ * El mismo echo server de `echo_server.cpp` (modo `epoll`) pero escrito
+ * con corrutinas de C++20 (véase `coro.h`): un único thread atiende
+ * a todos los clientes y aun así el código de cada conexión se lee
+ * como si fuera bloqueante.
+ *
+ * Compara `echo` con el loop de `echo_server.cpp` y con la máquina
+ * de estados de `echo_epoll.cpp`.
+ *
+ *  ./echo_server_coro 8080
+ * */
+
+static Task<> echo(AsyncSocket peer) {
+    /*
+     * El buffer vive en el frame de la corrutina, no en el stack:
+     * sobrevive a cada suspensión.
+     * */
+    char buf[4096];
+
+    try {
+        while (true) {
+            int sz = co_await peer.async_recvsome(buf, sizeof(buf));
+            if (sz == 0)
+                break;
+
+            if (co_await peer.async_sendall(buf, sz) == 0)
+                break;
+        }
+    } catch (const std::exception& err) {
+        /*
+         * Un cliente que falla (por ejemplo un "connection reset")
+         * no debe tirar abajo al servidor entero.
+         * */
+        std::cerr << "Client failed: " << err.what() << "\n";
+    }
+}
+
+static Task<> serve(Scheduler& sched, AsyncSocket srv) {
+    while (true) {
+        AsyncSocket peer = co_await srv.async_accept();
+        sched.spawn(echo(std::move(peer)));
+    }
+}
+
+int main(int argc, char *argv[]) { try {
+    if (argc != 2) {
+        std::cerr << "Bad program call. Expected "
+                << argv[0]
+                << " <servname>\n";
+        return -1;
+    }
+
+    ListenerOptions opts;
+    opts.backlog = 4096;
+
+    Scheduler sched;
+    sched.spawn(serve(sched, AsyncSocket(sched, Socket(argv[1], opts))));
+    sched.run();
+
+    return 0;
+} catch (const std::exception& err) {
+    std::cerr
+        << "Something went wrong and an exception was caught: "
+        << err.what()
+        << "\n";
+    return -1;
+} catch (...) {
+    std::cerr << "Something went wrong and an unknown exception was caught.\n";
+    return -1;
+} }
@@ -0,0 +1,249 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <deque>
+#include <iostream>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "socket.h"
+#include "uring.h"
+#include "liberror.h"
+#include "echo_modes.h"
+
+/*
+ * Un bloque de datos recibido (vive en uno de los buffers del
+ * `BufferRing`) y que aun no terminamos de hacerle eco.
+ * */
+struct EchoChunk {
+    uint16_t bid;
+    unsigned int len;
+};
+
+/*
+ * Estado de cada conexión.
+ *
+ * Con `io_uring` los buffers en los que se recibe son del kernel
+ * (véase `BufferRing`): no podemos devolverlos hasta que el envío
+ * (el eco) de su contenido haya terminado.
+ *
+ * Por eso encolamos los bloques recibidos en `queue` y los enviamos
+ * en cadenas (`URing::async_send_chain`) de a una por vez: dos envíos
+ * independientes sobre el mismo socket podrían ejecutarse fuera
+ * de orden.
+ *
+ * Mientras haya pedidos en curso (`inflight`) el kernel puede
+ * llamarnos; recién cuando no quede ninguno podemos liberar la conexión.
+ * */
+struct UringConnection {
+    Socket skt;
+    std::deque<EchoChunk> queue;
+    bool sending;
+    bool closing;
+    int inflight;
+
+    explicit UringConnection(Socket&& skt) :
+        skt(std::move(skt)),
+        sending(false),
+        closing(false),
+        inflight(0) {}
+};
+
+/*
+ * Cantidad máxima de envíos por cadena.
+ * */
+static const int MAX_CHAIN = 16;
+
+class EchoUring {
+    private:
+    URing ring;
+    BufferRing buffers;
+    Socket srv;
+    std::list<UringConnection> conns;
+
+    /*
+     * Conexiones cuyo `recv` multishot termino por falta de buffers
+     * (`-ENOBUFS`). Las volvemos a armar cuando se libere alguno.
+     * */
+    std::vector<std::list<UringConnection>::iterator> starved;
+
+    unsigned long long echoed;
+    unsigned long long last_echoed;
+
+    typedef std::list<UringConnection>::iterator ConnIt;
+
+    void arm_accept() {
+        ring.async_accept(srv, true, [this](int res, uint32_t flags) {
+            if (res >= 0) {
+                conns.emplace_front(URing::adopt(res));
+                arm_recv(conns.begin());
+            } else {
+                std::cerr << "Accept failed: " << strerror(-res) << "\n";
+            }
+
+            if (not (flags & IORING_CQE_F_MORE))
+                arm_accept();
+        });
+    }
+
+    void arm_recv(ConnIt it) {
+        ++it->inflight;
+        ring.async_recv_multishot(it->skt, buffers, [this, it](int res, uint32_t flags) {
+            UringConnection& conn = *it;
+            bool more = flags & IORING_CQE_F_MORE;
+            if (not more)
+                --conn.inflight;
+
+            if (res > 0) {
+                conn.queue.push_back({BufferRing::buffer_id(flags), (unsigned)res});
+                echoed += res;
+                if (conn.closing)
+                    drop_queue(conn);
+                else
+                    send_queue(it);
+
+                if (not more and not conn.closing)
+                    arm_recv(it);
+            } else if (res == -ENOBUFS) {
+                if (not conn.closing)
+                    starved.push_back(it);
+            } else {
+                /*
+                 * Fin de la conexión (`res == 0`) o error.
+                 * */
+                close(it);
+            }
+
+            maybe_free(it);
+        });
+    }
+
+    void send_queue(ConnIt it) {
+        UringConnection& conn = *it;
+        if (conn.sending or conn.closing or conn.queue.empty())
+            return;
+
+        struct iovec iov[MAX_CHAIN];
+        int n = 0;
+        unsigned int expected = 0;
+        for (auto& chunk : conn.queue) {
+            if (n == MAX_CHAIN)
+                break;
+            iov[n].iov_base = buffers.buffer(chunk.bid);
+            iov[n].iov_len = chunk.len;
+            expected += chunk.len;
+            ++n;
+        }
+
+        conn.sending = true;
+        ++conn.inflight;
+        ring.async_send_chain(conn.skt, iov, n, [this, it, n, expected](int res, uint32_t) {
+            UringConnection& conn = *it;
+            conn.sending = false;
+            --conn.inflight;
+
+            for (int i = 0; i < n; ++i) {
+                buffers.recycle(conn.queue.front().bid);
+                conn.queue.pop_front();
+            }
+
+            /*
+             * Con `MSG_WAITALL` un envío parcial solo puede significar
+             * que la conexión tuvo un error.
+             * */
+            if (res < 0 or (unsigned)res != expected)
+                close(it);
+            else
+                send_queue(it);
+
+            rearm_starved();
+            maybe_free(it);
+        });
+    }
+
+    void rearm_starved() {
+        std::vector<ConnIt> pending;
+        pending.swap(starved);
+        for (auto it : pending)
+            if (not it->closing)
+                arm_recv(it);
+    }
+
+    void drop_queue(UringConnection& conn) {
+        /*
+         * Si hay una cadena en curso, sus buffers los devolverá
+         * su propio callback.
+         * */
+        if (conn.sending)
+            return;
+
+        for (auto& chunk : conn.queue)
+            buffers.recycle(chunk.bid);
+        conn.queue.clear();
+    }
+
+    void close(ConnIt it) {
+        UringConnection& conn = *it;
+        if (conn.closing)
+            return;
+
+        conn.closing = true;
+        drop_queue(conn);
+
+        /*
+         * Si el `recv` multishot sigue armado, el `shutdown` hace
+         * que termine (con un CQE sin `IORING_CQE_F_MORE`).
+         * */
+        try {
+            conn.skt.shutdown(2);
+        } catch (const LibError&) {
+            /* El socket ya estaba desconectado. */
+        }
+    }
+
+    void maybe_free(ConnIt it) {
+        if (it->closing and it->inflight == 0) {
+            drop_queue(*it);
+            conns.erase(it);
+        }
+    }
+
+    /*
+     * Cada tanto reportamos cuantas syscalls hicimos por cada byte
+     * al que le hicimos eco: ese es el costo que `io_uring` reduce.
+     * */
+    void arm_stats() {
+        ring.async_timeout(10000, [this](int, uint32_t) {
+            if (echoed != last_echoed) {
+                last_echoed = echoed;
+                std::cerr << "io_uring: " << ring.syscalls() << " syscalls, "
+                          << echoed << " bytes echoed, "
+                          << (double)echoed / ring.syscalls() << " bytes/syscall\n";
+            }
+            arm_stats();
+        });
+    }
+
+    public:
+    explicit EchoUring(const char *servname) :
+        ring(1024),
+        buffers(ring, 0, 4096, 4096),
+        srv(servname),
+        echoed(0),
+        last_echoed(0) {}
+
+    void run() {
+        arm_accept();
+        arm_stats();
+        ring.run();
+    }
+};
+
+int echo_uring(const char *servname) {
+    raise_nofile_limit();
+    EchoUring server(servname);
+    server.run();
+    return 0;
+}
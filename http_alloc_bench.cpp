@@ -0,0 +1,129 @@
+#include "http_protocol.h"
+#include "transport.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ * Cuenta cuantas veces se reserva memoria del heap (`operator new`)
+ * por cada pedido HTTP, en "régimen": luego de que los buffers y la cola
+ * del pipeline ya tienen su tamaño (véase `HTTPProtocol::async_request`).
+ *
+ *  ./http_alloc_bench [requests]
+ *
+ * No hay red de por medio: el "servidor" es un `MemoryTransport` que
+ * vuelve a servir siempre la misma respuesta (`MemoryTransport::rewind`).
+ * Así lo que se mide es solo el costo del protocolo.
+ *
+ * Imprime (en JSON, una línea) las reservas por envío (`async_request`),
+ * por pedido completo (envío y `wait_response`) y cuanto tarda cada
+ * pedido completo en nanosegundos.
+ * */
+
+/*
+ * Reemplazamos el `operator new` global (el que usan `new`, los
+ * `std::string`, los `std::vector`, ...) por uno que además cuenta.
+ * Los `new[]` y los `new` sin excepciones terminan llamando a este.
+ * */
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t sz) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(sz ? sz : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+static const char response[] =
+    "HTTP/1.1 201 Created\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 11\r\n"
+    "\r\n"
+    "{\"id\":1234}";
+
+int main(int argc, char *argv[]) { try {
+    if (argc > 2) {
+        std::cerr << "Bad program call. Expected "
+                  << argv[0]
+                  << " [requests]\n";
+        return -1;
+    }
+
+    const uint64_t requests = argc == 2 ? strtoull(argv[1], nullptr, 10) : 100000;
+    const uint64_t warmup = 1000;
+    if (requests == 0) {
+        std::cerr << "The amount of requests must be a positive number.\n";
+        return -1;
+    }
+
+    BasicHTTPProtocol<MemoryTransport> http(MemoryTransport(), "localhost", true);
+    http.transport().feed(response);
+
+    const std::vector<HTTPHeader> headers = {
+        { "Content-Type", "application/json" },
+        { "User-Agent", "http_alloc_bench" },
+    };
+    const std::string body(64, 'x');
+
+    uint64_t send_allocs = 0;
+    uint64_t total_allocs = 0;
+    std::chrono::steady_clock::time_point start;
+
+    for (uint64_t i = 0; i < warmup + requests; ++i) {
+        if (i == warmup) {
+            send_allocs = total_allocs = 0;
+            start = std::chrono::steady_clock::now();
+        }
+
+        http.transport().rewind();
+        http.transport().clear_written();
+
+        uint64_t before = allocations.load(std::memory_order_relaxed);
+        http.async_request("POST", "/items", headers, body);
+        uint64_t sent = allocations.load(std::memory_order_relaxed);
+
+        std::string payload = http.wait_response();
+        uint64_t received = allocations.load(std::memory_order_relaxed);
+
+        if (http.last_status() != 201 or payload != "{\"id\":1234}")
+            throw std::runtime_error("unexpected response");
+
+        send_allocs += sent - before;
+        total_allocs += received - before;
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+    std::cout << "{\"requests\": " << requests
+              << ", \"allocs_per_send\": " << double(send_allocs) / requests
+              << ", \"allocs_per_request\": " << double(total_allocs) / requests
+              << ", \"ns_per_request\": " << double(ns) / requests
+              << "}\n";
+    return 0;
+} catch (const std::exception& err) {
+    std::cerr
+        << "Something went wrong and an exception was caught: "
+        << err.what()
+        << "\n";
+    return -1;
+} catch (...) {
+    std::cerr << "Something went wrong and an unknown exception was caught.\n";
+    return -1;
+} }
@@ -0,0 +1,121 @@
+#include "http_protocol.h"
+#include "transport.h"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+/*
+ * Este programa prueba `BasicHTTPProtocol` sin red: el "servidor" es
+ * un `MemoryTransport` al que le cargamos de antemano las respuestas.
+ *
+ * Enviamos varios pedidos seguidos (pipelining) y le damos las
+ * respuestas de a pedazos de 1, 3, 7 y 64 bytes: el parser tiene que
+ * dar lo mismo sin importar por donde se corten. Cada respuesta
+ * ejercita un caso distinto del protocolo.
+ * */
+struct Expected {
+    const char *resource;
+    int status;
+    const char *body;
+};
+
+static const Expected expected[] = {
+    { "/length",   200, "hello" },
+    { "/chunked",  200, "Wikipedia" },
+    { "/empty",    204, "" },
+    { "/head",     200, "" },
+    { "/continue", 201, "ok" },
+    { "/close",    200, "until close" },
+};
+
+static const char responses[] =
+    /* payload de largo conocido */
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 5\r\n"
+    "\r\n"
+    "hello"
+    /* payload en chunks, con trailers al final */
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "4\r\nWiki\r\n"
+    "5\r\npedia\r\n"
+    "0\r\n"
+    "Expires: never\r\n"
+    "\r\n"
+    /* un 204 nunca tiene payload */
+    "HTTP/1.1 204 No Content\r\n"
+    "\r\n"
+    /* la respuesta a un HEAD tampoco, diga lo que diga el Content-Length */
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 1000\r\n"
+    "\r\n"
+    /* una respuesta intermedia (1xx) antes de la final */
+    "HTTP/1.1 100 Continue\r\n"
+    "\r\n"
+    "HTTP/1.1 201 Created\r\n"
+    "Content-Length: 2\r\n"
+    "\r\n"
+    "ok"
+    /* sin largo: el payload termina cuando el servidor cierra */
+    "HTTP/1.1 200 OK\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "until close";
+
+static void check(unsigned int chunk_sz) {
+    BasicHTTPProtocol<MemoryTransport> http(MemoryTransport(chunk_sz), "localhost", true);
+
+    http.async_get("/length", true);
+    http.async_get("/chunked", true);
+    http.async_request("DELETE", "/empty", {}, std::string_view(), true);
+    http.async_request("HEAD", "/head", {}, std::string_view(), true);
+    http.async_request("POST", "/continue", {{ "Expect", "100-continue" }}, "data", true);
+    http.async_get("/close");
+
+    http.transport().feed(responses);
+    http.transport().close_inbound();
+
+    for (const Expected& exp : expected) {
+        std::string resource;
+        std::string body = http.wait_response(resource);
+
+        if (resource != exp.resource or http.last_status() != exp.status or body != exp.body)
+            throw std::runtime_error("chunk " + std::to_string(chunk_sz)
+                    + ": unexpected response to " + exp.resource
+                    + " (got " + std::to_string(http.last_status())
+                    + " '" + body + "' for " + resource + ")");
+    }
+
+    if (http.is_reusable())
+        throw std::runtime_error("chunk " + std::to_string(chunk_sz)
+                + ": connection closed by the server still reusable");
+
+    std::cout << "chunk " << chunk_sz << ": "
+              << sizeof(expected) / sizeof(expected[0]) << " responses ok\n";
+}
+
+int main(int argc, char *argv[]) { try {
+    if (argc != 1) {
+        std::cerr << "Bad program call. Expected "
+                  << argv[0]
+                  << " without arguments.\n";
+        return -1;
+    }
+
+    for (unsigned int chunk_sz : { 1, 3, 7, 64 })
+        check(chunk_sz);
+
+    return 0;
+} catch (const std::exception& err) {
+    std::cerr
+        << "Something went wrong and an exception was caught: "
+        << err.what()
+        << "\n";
+    return -1;
+} catch (...) {
+    std::cerr << "Something went wrong and an unknown exception was caught.\n";
+    return -1;
+} }
@@ -0,0 +1,355 @@
+#include "http_parser.h"
+#include "simd_scan.h"
+
+#include <strings.h>
+
+#include <stdexcept>
+#include <string>
+
+static bool equals_nocase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() and strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (not s.empty() and (s.front() == ' ' or s.front() == '\t'))
+        s.remove_prefix(1);
+    while (not s.empty() and (s.back() == ' ' or s.back() == '\t'))
+        s.remove_suffix(1);
+    return s;
+}
+
+/*
+ * Retorna `true` si `token` esta en la lista separada por comas `list`
+ * (como en `Connection: keep-alive, Upgrade`).
+ * */
+static bool has_token(std::string_view list, std::string_view token) {
+    while (not list.empty()) {
+        size_t comma = list.find(',');
+        if (equals_nocase(trim(list.substr(0, comma)), token))
+            return true;
+        if (comma == std::string_view::npos)
+            break;
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+[[noreturn]] static void malformed(const char *what) {
+    throw std::runtime_error(std::string("HTTP response malformed: ") + what);
+}
+
+HTTPResponseParser::HTTPResponseParser() {
+    reset();
+}
+
+void HTTPResponseParser::reset(bool head_request) {
+    state = READING_HEAD;
+    no_body = head_request;
+    scanned = 0;
+    remaining = 0;
+    status_code = 0;
+    minor = 0;
+    length = 0;
+    head_len = 0;
+    reason_phrase = std::string_view();
+    persistent = false;
+
+    /*
+     * `clear` no libera la memoria del vector: de una respuesta
+     * a la otra no se vuelve a reservar.
+     * */
+    hdrs.clear();
+}
+
+/*
+ * Busca `delim` en `data` empezando donde quedo la búsqueda anterior
+ * (menos lo justo para no perder un `delim` cortado a la mitad).
+ * Si no lo encuentra recuerda hasta donde busco.
+ * */
+size_t HTTPResponseParser::find_from(std::string_view data, std::string_view delim) {
+    size_t from = scanned >= delim.size() ? scanned - (delim.size() - 1) : 0;
+    size_t pos = simd_find(data, delim, from);
+
+    scanned = (pos == std::string_view::npos) ? data.size() : 0;
+    return pos;
+}
+
+/*
+ * Parsea la línea de status y los headers. `head` termina con el
+ * "\r\n" de la última línea (sin la línea vacía).
+ *
+ * Retorna `false` si es una respuesta intermedia (1xx) a descartar.
+ * */
+bool HTTPResponseParser::parse_head(std::string_view head) {
+    size_t eol = head.find("\r\n");
+    std::string_view line = head.substr(0, eol);
+    head.remove_prefix(eol + 2);
+
+    /*
+     * "HTTP/1.1 200 OK": versión, código de 3 dígitos y una frase
+     * (que puede estar vacía y que nadie debería mirar).
+     * */
+    if (line.size() < 12 or line.compare(0, 7, "HTTP/1.") != 0
+            or line[7] < '0' or line[7] > '9' or line[8] != ' ')
+        malformed("bad status line");
+
+    minor = line[7] - '0';
+
+    status_code = 0;
+    for (int i = 9; i < 12; ++i) {
+        if (line[i] < '0' or line[i] > '9')
+            malformed("bad status code");
+        status_code = status_code * 10 + (line[i] - '0');
+    }
+
+    if (line.size() > 12 and line[12] != ' ')
+        malformed("bad status line");
+    reason_phrase = line.size() > 13 ? line.substr(13) : std::string_view();
+
+    while (not head.empty()) {
+        eol = head.find("\r\n");
+        line = head.substr(0, eol);
+        head.remove_prefix(eol + 2);
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos or colon == 0)
+            malformed("bad header line");
+
+        hdrs.push_back({line.substr(0, colon), trim(line.substr(colon + 1))});
+    }
+
+    /*
+     * Las respuestas 1xx son intermedias (como `100 Continue` o `103
+     * Early Hints`): la respuesta final viene detrás. El servidor puede
+     * enviarlas aunque no las hayamos pedido así que las descartamos.
+     *
+     * La excepción es `101 Switching Protocols`: es la última respuesta
+     * HTTP, luego la conexión habla otro protocolo (y no puede usarse
+     * para otro pedido).
+     * */
+    if (status_code >= 100 and status_code < 200 and status_code != 101)
+        return false;
+
+    /*
+     * ¿Como se delimita el payload?
+     *
+     * Las respuestas 101, 204 (No Content) y 304 (Not Modified) nunca
+     * tienen payload, tampoco las respuestas a un `HEAD`. Si no,
+     * `Transfer-Encoding: chunked` tiene prioridad sobre `Content-Length`
+     * y si no hay ninguno el payload termina cuando el servidor cierra
+     * la conexión.
+     * */
+    std::string_view connection = header("Connection");
+    persistent = (minor >= 1) ?
+        not has_token(connection, "close") :
+        has_token(connection, "keep-alive");
+    if (status_code == 101)
+        persistent = false;
+
+    std::string_view encoding = header("Transfer-Encoding");
+    std::string_view content_len = header("Content-Length");
+
+    if (no_body or status_code == 101 or status_code == 204 or status_code == 304) {
+        state = FINISHED;
+    } else if (not encoding.empty()) {
+        /*
+         * La última codificación de la lista tiene que ser `chunked`
+         * (si no, no hay forma de saber donde termina).
+         * */
+        size_t comma = encoding.rfind(',');
+        std::string_view last = trim(comma == std::string_view::npos ? encoding : encoding.substr(comma + 1));
+        if (equals_nocase(last, "chunked")) {
+            state = READING_CHUNK_SIZE;
+        } else {
+            state = READING_UNTIL_CLOSE;
+            persistent = false;
+        }
+    } else if (not content_len.empty()) {
+        for (char c : content_len) {
+            if (c < '0' or c > '9' or length > (UINT64_MAX - 9) / 10)
+                malformed("bad Content-Length");
+            length = length * 10 + (c - '0');
+        }
+        remaining = length;
+        state = remaining ? READING_BODY : FINISHED;
+    } else {
+        state = READING_UNTIL_CLOSE;
+        persistent = false;
+    }
+
+    return true;
+}
+
+/*
+ * "1a3f;extension=valor": el tamaño del chunk en hexadecimal,
+ * opcionalmente seguido de extensiones que ignoramos.
+ * */
+void HTTPResponseParser::parse_chunk_size(std::string_view line) {
+    remaining = 0;
+    size_t digits = 0;
+    for (char c : line) {
+        int v;
+        if (c >= '0' and c <= '9')
+            v = c - '0';
+        else if (c >= 'a' and c <= 'f')
+            v = c - 'a' + 10;
+        else if (c >= 'A' and c <= 'F')
+            v = c - 'A' + 10;
+        else if (c == ';' or c == ' ' or c == '\t')
+            break;
+        else
+            malformed("bad chunk size");
+
+        if (remaining >> 60)
+            malformed("chunk size too large");
+        remaining = (remaining << 4) | v;
+        ++digits;
+    }
+
+    if (digits == 0)
+        malformed("bad chunk size");
+}
+
+HTTPResponseParser::Event HTTPResponseParser::parse(
+        std::string_view data,
+        size_t& consumed,
+        std::string_view& body) {
+    consumed = 0;
+
+    while (true) {
+        std::string_view rest = data.substr(consumed);
+
+        switch (state) {
+            case READING_HEAD: {
+                size_t end = find_from(rest, "\r\n\r\n");
+                if (end == std::string_view::npos)
+                    return NEED_MORE;
+
+                bool final_response = parse_head(rest.substr(0, end + 2));
+                consumed += end + 4;
+                if (final_response) {
+                    head_len = end + 4;
+                    return HEAD;
+                }
+
+                /*
+                 * Seguimos buscando la línea de status de la respuesta
+                 * final, que empieza justo después.
+                 * */
+                hdrs.clear();
+                status_code = 0;
+                reason_phrase = std::string_view();
+                break;
+            }
+
+            case READING_BODY:
+            case READING_CHUNK:
+            case READING_UNTIL_CLOSE: {
+                if (rest.empty())
+                    return NEED_MORE;
+
+                size_t n = rest.size();
+                if (state != READING_UNTIL_CLOSE and remaining < n)
+                    n = remaining;
+
+                body = rest.substr(0, n);
+                consumed += n;
+
+                if (state != READING_UNTIL_CLOSE) {
+                    remaining -= n;
+                    if (remaining == 0)
+                        state = (state == READING_CHUNK) ? READING_CHUNK_END : FINISHED;
+                }
+                return BODY;
+            }
+
+            case READING_CHUNK_SIZE: {
+                size_t eol = find_from(rest, "\r\n");
+                if (eol == std::string_view::npos)
+                    return NEED_MORE;
+
+                parse_chunk_size(rest.substr(0, eol));
+                consumed += eol + 2;
+
+                /*
+                 * Un chunk de tamaño 0 indica el final. Luego pueden venir
+                 * más headers (trailers) terminados en una línea vacía.
+                 * */
+                state = remaining ? READING_CHUNK : READING_TRAILERS;
+                break;
+            }
+
+            case READING_CHUNK_END: {
+                if (rest.size() < 2)
+                    return NEED_MORE;
+                if (rest[0] != '\r' or rest[1] != '\n')
+                    malformed("missing CRLF after chunk");
+
+                consumed += 2;
+                state = READING_CHUNK_SIZE;
+                break;
+            }
+
+            case READING_TRAILERS: {
+                size_t eol = find_from(rest, "\r\n");
+                if (eol == std::string_view::npos)
+                    return NEED_MORE;
+
+                consumed += eol + 2;
+                if (eol == 0)
+                    state = FINISHED;
+                break;
+            }
+
+            case FINISHED:
+                return DONE;
+        }
+    }
+}
+
+bool HTTPResponseParser::finish() {
+    if (state == READING_UNTIL_CLOSE)
+        state = FINISHED;
+
+    return state == FINISHED;
+}
+
+bool HTTPResponseParser::is_done() const {
+    return state == FINISHED;
+}
+
+int HTTPResponseParser::status() const {
+    return status_code;
+}
+
+int HTTPResponseParser::minor_version() const {
+    return minor;
+}
+
+std::string_view HTTPResponseParser::reason() const {
+    return reason_phrase;
+}
+
+const std::vector<HTTPHeader>& HTTPResponseParser::headers() const {
+    return hdrs;
+}
+
+std::string_view HTTPResponseParser::header(std::string_view name) const {
+    for (const auto& h : hdrs)
+        if (equals_nocase(h.name, name))
+            return h.value;
+
+    return std::string_view();
+}
+
+size_t HTTPResponseParser::head_size() const {
+    return head_len;
+}
+
+uint64_t HTTPResponseParser::content_length() const {
+    return length;
+}
+
+bool HTTPResponseParser::keep_alive() const {
+    return persistent;
+}
@@ -0,0 +1,203 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/*
+ * Un header de una respuesta HTTP: nombre y valor (sin los espacios
+ * que los rodean).
+ * */
+struct HTTPHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+/*
+ * Parser incremental ("streaming") de respuestas HTTP/1.x.
+ *
+ * La forma fácil de parsear una respuesta es esperar a tenerla entera
+ * (o sea, hasta que el servidor cierre la conexión) y después buscar
+ * en ella. Pero:
+ *
+ *  - con keep-alive el servidor *no* cierra la conexión: hay que saber
+ *    donde termina la respuesta a medida que llega;
+ *  - buscar el final de los headers desde el principio cada vez que
+ *    llegan más bytes es O(n^2);
+ *  - guardar la respuesta entera para después copiar el payload
+ *    (`substr`) es copiar todo dos veces.
+ *
+ * `HTTPResponseParser` es una máquina de estados: se le pasan los bytes
+ * recibidos y aun no consumidos y consume lo que puede, recordando donde
+ * quedo. Nunca vuelve a mirar un byte ya consumido y solo vuelve a mirar
+ * uno no consumido en el peor caso una vez (los 3 últimos de un
+ * "\r\n\r\n" cortado a la mitad).
+ *
+ * El parser no copia nada: el status, los headers y los pedazos de
+ * payload que reporta son vistas (`std::string_view`) a los bytes que
+ * se le pasaron (típicamente el buffer de lectura de un `BufferedSocket`,
+ * véase `BufferedSocket::peek`).
+ *
+ * Uso:
+ *
+ *  parser.reset();
+ *  while (true) {
+ *      size_t used;
+ *      std::string_view body;
+ *      auto ev = parser.parse(skt.peek(), used, body);
+ *
+ *      if (ev == HTTPResponseParser::HEAD)
+ *          // parser.status(), parser.headers(), ... validos hasta
+ *          // consumir los `used` bytes
+ *      else if (ev == HTTPResponseParser::BODY)
+ *          // un pedazo del payload, valido hasta consumirlo
+ *
+ *      skt.consume(used);
+ *      if (ev == HTTPResponseParser::DONE)
+ *          break;
+ *
+ *      if (ev == HTTPResponseParser::NEED_MORE and skt.fill() <= 0) {
+ *          if (not parser.finish())
+ *              // la respuesta quedo truncada
+ *          break;
+ *      }
+ *  }
+ *
+ * El payload se delimita como dice HTTP/1.1: con `Transfer-Encoding:
+ * chunked`, con `Content-Length` o, si no hay ninguno, cuando el
+ * servidor cierra la conexión (véase `HTTPResponseParser::finish`).
+ *
+ * Las respuestas intermedias (1xx, como `100 Continue`) se descartan
+ * sin reportarlas: el evento `HEAD` es siempre el de la respuesta final.
+ *
+ * Los headers tienen que entrar enteros en el buffer (se parsean recién
+ * cuando llego la línea vacía que los termina); el payload no. Un
+ * `BufferedSocket` agranda su buffer de lectura para ello (véase
+ * `BufferedSocketOptions::max_read_buffer_sz`).
+ *
+ * Si la respuesta esta mal formada se lanza una excepción.
+ * */
+class HTTPResponseParser {
+    public:
+    /*
+     * Lo que encontró `HTTPResponseParser::parse`:
+     *
+     *  - `NEED_MORE`: hacen falta más bytes.
+     *  - `HEAD`: la línea de status y los headers están completos.
+     *  - `BODY`: un pedazo del payload.
+     *  - `DONE`: la respuesta termino.
+     * */
+    enum Event { NEED_MORE, HEAD, BODY, DONE };
+
+    private:
+    enum State {
+        READING_HEAD,
+        READING_BODY,
+        READING_UNTIL_CLOSE,
+        READING_CHUNK_SIZE,
+        READING_CHUNK,
+        READING_CHUNK_END,
+        READING_TRAILERS,
+        FINISHED
+    };
+
+    State state;
+
+    /*
+     * Cuantos bytes de la línea (o los headers) en curso ya fueron
+     * revisados buscando su final: la próxima búsqueda empieza ahí.
+     * */
+    size_t scanned;
+
+    /*
+     * Bytes del payload (o del chunk actual) que faltan.
+     * */
+    uint64_t remaining;
+
+    int status_code;
+    int minor;
+    uint64_t length;
+    size_t head_len;
+    std::string_view reason_phrase;
+    std::vector<HTTPHeader> hdrs;
+    bool persistent;
+    bool no_body;
+
+    size_t find_from(std::string_view data, std::string_view delim);
+    bool parse_head(std::string_view head);
+    void parse_chunk_size(std::string_view line);
+
+    public:
+    HTTPResponseParser();
+
+    /*
+     * Prepara al parser para la siguiente respuesta.
+     *
+     * La respuesta a un `HEAD` trae los mismos headers que traería la de
+     * un `GET` (incluido el `Content-Length`) pero nunca un payload: eso
+     * no se puede saber mirando la respuesta, hay que decírselo al parser
+     * con `head_request`.
+     * */
+    void reset(bool head_request = false);
+
+    /*
+     * Parsea lo que pueda de `data` (los bytes recibidos y aun no
+     * consumidos) hasta el próximo evento.
+     *
+     * En `consumed` queda cuantos bytes del principio de `data` ya
+     * no necesita (hay que descartarlos antes de volver a llamarlo)
+     * y, si el evento es `BODY`, en `body` el pedazo de payload.
+     * */
+    Event parse(std::string_view data, size_t& consumed, std::string_view& body);
+
+    /*
+     * Avisa que la conexión se cerró. Retorna `true` si eso completa
+     * la respuesta (porque ya estaba completa o porque el payload
+     * se delimita por el cierre) y `false` si la respuesta quedo
+     * truncada.
+     * */
+    bool finish();
+
+    bool is_done() const;
+
+    /*
+     * Validos a partir del evento `HEAD`. Las vistas apuntan al `data`
+     * de esa llamada a `HTTPResponseParser::parse`.
+     * */
+    int status() const;
+    int minor_version() const;
+    std::string_view reason() const;
+    const std::vector<HTTPHeader>& headers() const;
+
+    /*
+     * El valor del primer header con ese nombre (sin importar
+     * mayúsculas/minúsculas) o una vista vacía si no esta.
+     * */
+    std::string_view header(std::string_view name) const;
+
+    /*
+     * Cuantos bytes ocupan la línea de status y los headers (con la
+     * línea vacía) de la respuesta final: son los últimos de los
+     * consumidos en el evento `HEAD` (antes pueden estar los de las
+     * respuestas intermedias descartadas).
+     * */
+    size_t head_size() const;
+
+    /*
+     * El tamaño del payload según `Content-Length`, o 0 si no
+     * se conoce de antemano (por ejemplo, con `chunked`).
+     * */
+    uint64_t content_length() const;
+
+    /*
+     * `true` si el servidor dejara la conexión abierta luego de esta
+     * respuesta: en HTTP/1.1 salvo `Connection: close`, en HTTP/1.0
+     * solo con `Connection: keep-alive`, y nunca si el payload se
+     * delimita por el cierre.
+     * */
+    bool keep_alive() const;
+};
+
+#endif
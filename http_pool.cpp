@@ -0,0 +1,186 @@
+#include "http_pool.h"
+
+#include <exception>
+#include <string>
+#include <utility>
+
+HTTPConnectionPool::HTTPConnectionPool(const HTTPPoolOptions& opts) :
+    opts(opts) {}
+
+/*
+ * Saca del pool las conexiones inactivas hace demasiado tiempo.
+ *
+ * No las cerramos acá (estamos con el mutex tomado y cerrar un socket
+ * es una syscall): las movemos a `evicted` y el caller las destruirá
+ * luego de soltar el mutex.
+ * */
+void HTTPConnectionPool::evict_expired(std::list<IdleConnection>& evicted) {
+    const auto oldest = Clock::now() - std::chrono::milliseconds(opts.idle_timeout_ms);
+
+    while (not idle.empty() and idle.back().since < oldest) {
+        --per_host[idle.back().key];
+        evicted.splice(evicted.begin(), idle, std::prev(idle.end()));
+    }
+}
+
+HTTPConnectionPool::Lease HTTPConnectionPool::acquire(
+        const std::string& hostname,
+        const std::string& servname) {
+    const std::string key = hostname + ":" + servname;
+
+    while (true) {
+        std::unique_ptr<HTTPProtocol> candidate;
+        std::list<IdleConnection> evicted;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true) {
+                evict_expired(evicted);
+
+                /*
+                 * Preferimos la conexión usada más recientemente: es la
+                 * que con mayor probabilidad el servidor aun no cerró.
+                 * */
+                for (auto it = idle.begin(); it != idle.end(); ++it) {
+                    if (it->key == key) {
+                        candidate = std::move(it->http);
+                        idle.erase(it);
+                        break;
+                    }
+                }
+
+                if (candidate or per_host[key] < opts.max_per_host)
+                    break;
+
+                released.wait(lock);
+            }
+
+            if (not candidate)
+                ++per_host[key];
+        }
+
+        if (not candidate) {
+            /*
+             * Nueva conexión, establecida sin el mutex tomado: no queremos
+             * que el resto de los threads espere a nuestro handshake.
+             * */
+            try {
+                candidate.reset(new HTTPProtocol(hostname, servname, true));
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(mtx);
+                --per_host[key];
+                released.notify_one();
+                throw;
+            }
+            return Lease(this, key, std::move(candidate), false);
+        }
+
+        /*
+         * El servidor pudo haber cerrado la conexión mientras estaba
+         * inactiva: si es así la descartamos y probamos de nuevo.
+         * */
+        if (candidate->is_reusable())
+            return Lease(this, key, std::move(candidate), true);
+
+        candidate.reset();
+        std::unique_lock<std::mutex> lock(mtx);
+        --per_host[key];
+        released.notify_one();
+    }
+}
+
+void HTTPConnectionPool::release(
+        const std::string& key,
+        std::unique_ptr<HTTPProtocol> http) {
+    /*
+     * `HTTPProtocol::is_reusable` hace syscalls: lo llamamos
+     * antes de tomar el mutex.
+     * */
+    bool reusable = false;
+    try {
+        reusable = http->is_reusable();
+    } catch (const std::exception&) {
+        reusable = false;
+    }
+
+    std::list<IdleConnection> evicted;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (reusable) {
+            idle.push_front({key, std::move(http), Clock::now()});
+
+            while (idle.size() > opts.max_idle) {
+                --per_host[idle.back().key];
+                evicted.splice(evicted.begin(), idle, std::prev(idle.end()));
+            }
+        } else {
+            --per_host[key];
+        }
+
+        evict_expired(evicted);
+        released.notify_all();
+    }
+
+    /*
+     * Al salir de scope, `http` (si no fue reusada) y `evicted`
+     * cierran sus sockets, ya sin el mutex tomado.
+     * */
+}
+
+std::string HTTPConnectionPool::get(
+        const std::string& hostname,
+        const std::string& servname,
+        const std::string& resource,
+        bool include_headers) {
+    {
+        Lease http = acquire(hostname, servname);
+        try {
+            return http->get(resource, include_headers);
+        } catch (const std::exception&) {
+            if (not http.reused())
+                throw;
+        }
+    }
+
+    Lease http = acquire(hostname, servname);
+    return http->get(resource, include_headers);
+}
+
+size_t HTTPConnectionPool::idle_count() {
+    std::unique_lock<std::mutex> lock(mtx);
+    return idle.size();
+}
+
+HTTPConnectionPool::Lease::Lease(
+        HTTPConnectionPool *pool,
+        const std::string& key,
+        std::unique_ptr<HTTPProtocol> http,
+        bool was_reused) :
+    pool(pool),
+    key(key),
+    http(std::move(http)),
+    was_reused(was_reused) {}
+
+HTTPConnectionPool::Lease::Lease(Lease&& other) :
+    pool(other.pool),
+    key(std::move(other.key)),
+    http(std::move(other.http)),
+    was_reused(other.was_reused) {
+    other.pool = nullptr;
+}
+
+HTTPProtocol& HTTPConnectionPool::Lease::operator*() const {
+    return *http;
+}
+
+HTTPProtocol* HTTPConnectionPool::Lease::operator->() const {
+    return http.get();
+}
+
+bool HTTPConnectionPool::Lease::reused() const {
+    return was_reused;
+}
+
+HTTPConnectionPool::Lease::~Lease() {
+    if (pool and http)
+        pool->release(key, std::move(http));
+}
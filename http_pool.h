@@ -0,0 +1,163 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "http_protocol.h"
+
+/*
+ * Límites del pool de conexiones (véase `HTTPConnectionPool`).
+ * */
+struct HTTPPoolOptions {
+    /*
+     * Cantidad máxima de conexiones inactivas guardadas (entre
+     * todos los hosts). Si se supera, se cierran las más viejas.
+     * */
+    size_t max_idle;
+
+    /*
+     * Cantidad máxima de conexiones (activas más inactivas) por host.
+     * Si se alcanza, `HTTPConnectionPool::acquire` se bloquea hasta
+     * que otro thread devuelva una.
+     * */
+    size_t max_per_host;
+
+    /*
+     * Una conexión inactiva por más de este tiempo se cierra:
+     * es muy probable que el servidor ya la haya cerrado de su lado.
+     * */
+    int idle_timeout_ms;
+
+    HTTPPoolOptions() :
+        max_idle(64),
+        max_per_host(8),
+        idle_timeout_ms(30000) {}
+};
+
+/*
+ * Pool de conexiones HTTP persistentes (keep-alive), thread safe.
+ *
+ * Establecer una conexión TCP cuesta un round trip (el handshake)
+ * y ademas la conexión empieza enviando despacio (slow start).
+ * Si hacemos muchos pedidos a unos pocos hosts conviene reutilizar
+ * las conexiones en vez de abrir una nueva por pedido.
+ *
+ * `HTTPConnectionPool::acquire` nos da una conexión (`Lease`) a
+ * un host:port, reutilizando una inactiva si la hay. Cuando el `Lease`
+ * se destruye la conexión vuelve al pool si todavía sirve
+ * (véase `HTTPProtocol::is_reusable`) o se cierra si no.
+ *
+ * Típicamente:
+ *
+ *  HTTPConnectionPool pool;
+ *  {
+ *      auto http = pool.acquire("www.example.com", "http");
+ *      std::string page = http->get("/");
+ *  }   // <-- la conexión vuelve al pool
+ * */
+class HTTPConnectionPool {
+    private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct IdleConnection {
+        std::string key;
+        std::unique_ptr<HTTPProtocol> http;
+        Clock::time_point since;
+    };
+
+    const HTTPPoolOptions opts;
+
+    std::mutex mtx;
+    std::condition_variable released;
+
+    /*
+     * Conexiones inactivas, las más recientes al principio.
+     * */
+    std::list<IdleConnection> idle;
+
+    /*
+     * Cantidad de conexiones (activas más inactivas) por host:port.
+     * */
+    std::map<std::string, size_t> per_host;
+
+    void evict_expired(std::list<IdleConnection>& evicted);
+    void release(const std::string& key, std::unique_ptr<HTTPProtocol> http);
+
+    public:
+    /*
+     * Una conexión prestada por el pool: se usa como un puntero
+     * a `HTTPProtocol` y se devuelve al pool al destruirse (RAII).
+     * */
+    class Lease {
+        private:
+        HTTPConnectionPool *pool;
+        std::string key;
+        std::unique_ptr<HTTPProtocol> http;
+        bool was_reused;
+
+        friend class HTTPConnectionPool;
+
+        Lease(HTTPConnectionPool *pool,
+              const std::string& key,
+              std::unique_ptr<HTTPProtocol> http,
+              bool was_reused);
+
+        public:
+        HTTPProtocol& operator*() const;
+        HTTPProtocol* operator->() const;
+
+        /*
+         * `true` si la conexión ya había sido usada antes. Un pedido
+         * sobre una conexión reutilizada puede fallar si justo el servidor
+         * la cerro: en ese caso es seguro reintentarlo con una nueva.
+         * */
+        bool reused() const;
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        Lease(Lease&&);
+        Lease& operator=(Lease&&) = delete;
+
+        ~Lease();
+    };
+
+    explicit HTTPConnectionPool(const HTTPPoolOptions& opts = HTTPPoolOptions());
+
+    /*
+     * Retorna una conexión a `hostname:servname`, reutilizando una inactiva
+     * si la hay o estableciendo una nueva si no se alcanzo el límite por host.
+     *
+     * Si se alcanzo el límite se bloquea hasta que se devuelva una.
+     * */
+    Lease acquire(const std::string& hostname, const std::string& servname = "http");
+
+    /*
+     * Atajo para un GET: reintenta una vez, con una conexión nueva,
+     * si el pedido falla sobre una conexión reutilizada.
+     * */
+    std::string get(
+            const std::string& hostname,
+            const std::string& servname,
+            const std::string& resource,
+            bool include_headers = false);
+
+    /*
+     * Cantidad de conexiones inactivas en el pool.
+     * */
+    size_t idle_count();
+
+    HTTPConnectionPool(const HTTPConnectionPool&) = delete;
+    HTTPConnectionPool& operator=(const HTTPConnectionPool&) = delete;
+    HTTPConnectionPool(HTTPConnectionPool&&) = delete;
+    HTTPConnectionPool& operator=(HTTPConnectionPool&&) = delete;
+};
+
+#endif
@@ -1,7 +1,36 @@
 #include "http_protocol.h"
+#include "liberror.h"
+#include "simd_scan.h"
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
 #include <string>
-#include <sstream>
+#include <type_traits>
+#include <utility>
+
+static const uint64_t MAX_RESERVE = 64 * 1024 * 1024;
+
+/*
+ * Lanza `std::invalid_argument` si `field` tiene un '\r' o un '\n'.
+ * */
+static void check_no_crlf(std::string_view field, const char *what) {
+    if (field.find_first_of("\r\n") != std::string_view::npos)
+        throw std::invalid_argument(std::string("HTTP ") + what + " must not contain CR or LF");
+}
+
+/*
+ * Lo que va luego del recurso en la línea del pedido y los headers que
+ * no cambian de un pedido a otro. Todo pedido los lleva.
+ * */
+static std::string make_common_headers(const std::string& hostname, bool keep_alive) {
+    return std::string(" HTTP/1.1\r\n"
+            "Accept: */*\r\n"
+            "Connection: ") + (keep_alive ? "keep-alive" : "close") + "\r\n"
+            "Host: " + hostname + "\r\n";
+}
 
 /*
  * Este es un ejemplo práctico de la Member Initialization List.
@@ -42,11 +71,20 @@
  * sus atributos se destruirán automáticamente y no tendrás leaks.
  *
  * */
-HTTPProtocol::HTTPProtocol(
+template<typename Transport>
+template<typename T,
+    typename std::enable_if<std::is_constructible<T, const char*, const char*>::value, int>::type>
+BasicHTTPProtocol<Transport>::BasicHTTPProtocol(
         const std::string& hostname,
-        const std::string& servname) :
+        const std::string& servname,
+        bool keep_alive,
+        const BufferedSocketOptions& buffers) :
     hostname(hostname),  /* <-- construimos un `const std::string` */
-    skt(hostname.c_str(), servname.c_str()) /* <-- construimos un `Socket` */
+    skt(Transport(hostname.c_str(), servname.c_str()), buffers), /* <-- construimos un `Socket` (con buffers) */
+    keep_alive(keep_alive),
+    common_headers(make_common_headers(hostname, keep_alive)),
+    pipeline(new Pipeline()),
+    status(0)
 {
     /* Esto *no* funcionaría ya que estaríamos pisando `skt` ya creado,
      * no construyéndolo desde cero.
@@ -68,15 +106,91 @@ HTTPProtocol::HTTPProtocol(
  * (estrictamente hablando, `std::move` es solo un casteo, pero que fuerza
  * al compiler a llamar al constructor por movimiento y no el de copia.)
  * */
-HTTPProtocol::HTTPProtocol(
-        Socket&& skt,
-        const std::string& hostname) :
+template<typename Transport>
+BasicHTTPProtocol<Transport>::BasicHTTPProtocol(
+        Transport&& skt,
+        const std::string& hostname,
+        bool keep_alive,
+        const BufferedSocketOptions& buffers) :
     hostname(hostname),  /* <-- construimos un `const std::string` */
-    skt(std::move(skt)) /* <-- movemos el `Socket` y nos hacemos dueño de él. */
+    skt(std::move(skt), buffers), /* <-- movemos el `Socket` y nos hacemos dueño de él. */
+    keep_alive(keep_alive),
+    common_headers(make_common_headers(hostname, keep_alive)),
+    pipeline(new Pipeline()),
+    status(0)
 {
 }
 
-void HTTPProtocol::async_get(const std::string& resource) {
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::async_get(std::string_view resource, bool more) {
+    async_request("GET", resource, {}, std::string_view(), more);
+}
+
+/*
+ * Encola el pedido en el pipeline, esperando lugar en la ventana
+ * si hace falta (véase `HTTPProtocol::set_pipeline_window`).
+ * */
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::push_request(std::string_view resource, bool head) {
+    std::unique_lock<std::mutex> lock(pipeline->mtx);
+    Pipeline& pl = *pipeline;
+
+    if (pl.count > 0 and not keep_alive)
+        throw std::logic_error("HTTP pipelining requires keep-alive");
+
+    if (pl.window > 0 and pl.count >= pl.window) {
+        /*
+         * Antes de esperar enviamos lo que haya quedado en el buffer
+         * de escritura: si no, el servidor nunca recibiría los pedidos
+         * cuyas respuestas estamos esperando.
+         *
+         * Soltamos el lock mientras tanto: `flush` puede bloquearse
+         * y el thread que recibe necesita el lock para avisarnos.
+         * */
+        lock.unlock();
+        flush();
+        lock.lock();
+
+        /*
+         * La ventana puede cambiar mientras esperamos (0 es sin límite).
+         * */
+        pl.slot_freed.wait(lock, [&pl]() {
+                return pl.window == 0 or pl.count < pl.window or pl.server_closes;
+                });
+    }
+
+    if (pl.count > 0 and pl.server_closes)
+        throw std::runtime_error("HTTP connection is being closed by the server: request not sent");
+
+    /*
+     * Encolamos el pedido *antes* de enviarlo: así, cuando llegue
+     * su respuesta, el thread que recibe ya sabe de quien es.
+     *
+     * Si la cola esta llena la agrandamos, desenrollandola para que
+     * el más viejo quede primero.
+     * */
+    if (pl.count == pl.requested.size()) {
+        std::rotate(pl.requested.begin(), pl.requested.begin() + pl.head, pl.requested.end());
+        pl.head = 0;
+        pl.requested.resize(std::max<size_t>(4, pl.requested.size() * 2));
+    }
+
+    /*
+     * `assign` reutiliza la memoria que el string ya tenia.
+     * */
+    typename Pipeline::Request& req = pl.requested[(pl.head + pl.count) % pl.requested.size()];
+    req.resource.assign(resource);
+    req.head = head;
+    ++pl.count;
+}
+
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::async_request(
+        std::string_view method,
+        std::string_view resource,
+        const std::vector<HTTPHeader>& extra_headers,
+        std::string_view body,
+        bool more) {
     /*
      * HTTP/1.1 es un protocolo de texto en donde el cliente (nosotros)
      * le hace un pedido a un servidor.
@@ -85,52 +199,281 @@ void HTTPProtocol::async_get(const std::string& resource) {
      * un recurso es una página web HTML. Para muchos servidores HTTP
      * sucede lo mismo pero no te confundas: nada te impide usar HTTP
      * para otros fines que no sean páginas web HTML.
+     *
+     * El pedido tiene la forma:
+     *
+     *  GET /recurso HTTP/1.1\r\n
+     *  <headers comunes>               (`common_headers`)
+     *  <headers extra>
+     *  Content-Length: <n>\r\n         (si hay payload)
+     *  \r\n
+     *  <payload>
+     * */
+    static const char space[] = " ";
+    static const char colon[] = ": ";
+    static const char crlf[] = "\r\n";
+    static const char content_length[] = "Content-Length: ";
+
+    /*
+     * Un "\r\n" en el método, el recurso o un header terminaría la línea
+     * antes de tiempo y lo que siga se leería como otro header (o como
+     * otro pedido): alguien que controle el recurso podría inyectar lo
+     * que quiera. Lo rechazamos antes de encolar nada.
+     * */
+    check_no_crlf(method, "method");
+    check_no_crlf(resource, "resource");
+    for (const HTTPHeader& h : extra_headers) {
+        check_no_crlf(h.name, "header name");
+        check_no_crlf(h.value, "header value");
+    }
+
+    push_request(resource, method == "HEAD");
+
+    /*
+     * En vez de armar el pedido concatenando strings (y reservando
+     * memoria para ello) le pasamos a `BufferedSocket::writev` cada pedazo
+     * por separado: las partes constantes y los strings del caller.
+     *
+     * `BufferedSocket::writev` los junta en su buffer de escritura
+     * y `BufferedSocket::flush` los envía con una sola syscall.
+     *
+     * El array de `iovec` esta en el stack y alcanza para los pedidos
+     * con pocos headers extra; si no alcanza usamos uno en el heap.
+     * Así el pedido se escribe siempre entero, con un único `writev`.
+     *
+     * Notar el `- 1`: no queremos enviar el `\0` de los literales.
+     * */
+    struct iovec stack_iov[32];
+    std::vector<struct iovec> heap_iov;
+
+    const size_t needed = 9 + 4 * extra_headers.size();
+    struct iovec *request = stack_iov;
+    if (needed > sizeof(stack_iov) / sizeof(stack_iov[0])) {
+        heap_iov.resize(needed);
+        request = heap_iov.data();
+    }
+
+    int n = 0;
+    auto add = [&](const void *data, size_t sz) {
+        request[n++] = { (void*)data, sz };
+    };
+
+    add(method.data(), method.size());
+    add(space, sizeof(space) - 1);
+    add(resource.data(), resource.size());
+    add(common_headers.data(), common_headers.size());
+
+    for (const HTTPHeader& h : extra_headers) {
+        add(h.name.data(), h.name.size());
+        add(colon, sizeof(colon) - 1);
+        add(h.value.data(), h.value.size());
+        add(crlf, sizeof(crlf) - 1);
+    }
+
+    /*
+     * Un `GET` o un `HEAD` sin payload no llevan `Content-Length`;
+     * cualquier otro método lo lleva siempre (aunque sea 0).
+     *
+     * `std::to_chars` escribe el número en un buffer nuestro (en el
+     * stack), sin reservar memoria ni depender del locale.
      * */
-    std::ostringstream request;
-    request << "GET " << resource << " HTTP/1.1\r\n"
-            << "Accept: */*\r\n"
-               "Connection: close\r\n"
-               "Host: " << this->hostname << "\r\n"
-               "\r\n";
+    char length[24];
+    if (not body.empty() or (method != "GET" and method != "HEAD")) {
+        char *end = std::to_chars(length, length + sizeof(length), body.size()).ptr;
+
+        add(content_length, sizeof(content_length) - 1);
+        add(length, end - length);
+        add(crlf, sizeof(crlf) - 1);
+    }
+
+    add(crlf, sizeof(crlf) - 1);
+    if (not body.empty())
+        add(body.data(), body.size());
+
+    try {
+        skt.writev(request, n);
+        if (not more)
+            skt.flush();
+    } catch (...) {
+        /*
+         * El pedido ya estaba encolado pero no se envió (o se envió
+         * a medias): lo sacamos de la cola, así nadie espera su
+         * respuesta, y damos a la conexión por perdida.
+         * */
+        drop_newest_request();
+        throw;
+    }
 
     /*
-     * En C++ 20 podremos usar `view` para evitarnos una copia aquí.
+     * Si la conexión ya estaba cerrada `Socket::sendall` no falla:
+     * simplemente no envía nada (véase `BufferedSocket::flush`).
      * */
-    auto buf = request.str();
-    skt.sendall(buf.data(), buf.size());
+    if (skt.socket().is_stream_send_closed()) {
+        drop_newest_request();
+        throw std::runtime_error("HTTP request not sent: connection closed");
+    }
 }
 
-std::string HTTPProtocol::wait_response(bool include_headers) {
-    bool was_closed = false;
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::drop_newest_request() {
+    std::lock_guard<std::mutex> lock(pipeline->mtx);
+    if (pipeline->count > 0)
+        --pipeline->count;
+    pipeline->server_closes = true;
+    pipeline->slot_freed.notify_all();
+}
 
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::flush() {
     /*
-     * C++ tiene una librería bastante rica
-     * para el manejo de strings.
+     * Si falla, los pedidos que estaban en el buffer se perdieron
+     * (o salieron a medias): la conexión ya no sirve y nadie debe
+     * quedarse esperando lugar en la ventana.
+     * */
+    try {
+        skt.flush();
+    } catch (...) {
+        mark_server_closes();
+        throw;
+    }
+}
+
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::set_pipeline_window(unsigned int max_in_flight) {
+    std::lock_guard<std::mutex> lock(pipeline->mtx);
+    pipeline->window = max_in_flight;
+    pipeline->slot_freed.notify_all();
+}
+
+/*
+ * Marca que el servidor va a cerrar (o cerró) la conexión y despierta
+ * a quien este esperando lugar en la ventana: ya no lo habrá.
+ * */
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::mark_server_closes() {
+    std::lock_guard<std::mutex> lock(pipeline->mtx);
+    pipeline->server_closes = true;
+    pipeline->slot_freed.notify_all();
+}
+
+/*
+ * ¿El pedido más viejo aun sin responder fue un `HEAD`?
+ * */
+template<typename Transport>
+bool BasicHTTPProtocol<Transport>::oldest_is_head() {
+    std::lock_guard<std::mutex> lock(pipeline->mtx);
+    return pipeline->count > 0 and pipeline->requested[pipeline->head].head;
+}
+
+/*
+ * Saca de la cola al pedido más viejo (el que acabamos de ver
+ * respondido) y le deja lugar en la ventana al que envía.
+ *
+ * Con `swap` el caller se lleva el string y la cola se queda con el
+ * del caller: ninguno de los dos reserva memoria.
+ * */
+template<typename Transport>
+void BasicHTTPProtocol<Transport>::pop_request(std::string *resource) {
+    std::lock_guard<std::mutex> lock(pipeline->mtx);
+    Pipeline& pl = *pipeline;
+
+    if (pl.count == 0) {
+        if (resource)
+            resource->clear();
+        return;
+    }
+
+    if (resource)
+        resource->swap(pl.requested[pl.head].resource);
+
+    pl.head = (pl.head + 1) % pl.requested.size();
+    --pl.count;
+    pl.slot_freed.notify_all();
+}
+
+template<typename Transport>
+std::string BasicHTTPProtocol<Transport>::wait_response(bool include_headers) {
+    return receive_response(nullptr, include_headers);
+}
+
+template<typename Transport>
+std::string BasicHTTPProtocol<Transport>::wait_response(std::string& resource, bool include_headers) {
+    return receive_response(&resource, include_headers);
+}
+
+template<typename Transport>
+std::string BasicHTTPProtocol<Transport>::receive_response(std::string *resource, bool include_headers) {
+    std::string response;
+    parser.reset(oldest_is_head());
+    status = 0;
+
+    /*
+     * Le pasamos al parser lo recibido y aun no consumido; él nos dice
+     * cuanto ya no necesita y nosotros lo consumimos del buffer.
      *
-     * En este caso `std::ostringstream` permite ir guardando
-     * un string parcial y obtenerlo completo con `partial.str`
-     * al final.
+     * Los headers y los pedazos de payload que reporta son vistas al
+     * buffer de lectura de `skt`: los copiamos (una única vez) a
+     * `response` antes de consumirlos.
      * */
-    std::ostringstream partial;
-    while (not was_closed) {
-        char buf[512] = {0};
-        skt.recvsome(buf, sizeof(buf) - 1);
-        was_closed = skt.is_stream_recv_closed();
-        if (was_closed)
+    while (true) {
+        size_t used;
+        std::string_view body;
+        std::string_view view = skt.peek();
+        HTTPResponseParser::Event ev = parser.parse(view, used, body);
+
+        if (ev == HTTPResponseParser::HEAD) {
+            if (not parser.keep_alive())
+                mark_server_closes();
+
+            /*
+             * Si sabemos de antemano cuanto mide el payload reservamos
+             * la memoria de una vez (y no de a poco a medida que llega).
+             * Sin pasarnos: el `Content-Length` lo dice el servidor y
+             * podría ser cualquier cosa.
+             * */
+            response.reserve((include_headers ? parser.head_size() : 0)
+                    + std::min<uint64_t>(parser.content_length(), MAX_RESERVE));
+
+            if (include_headers)
+                response.append(view.data() + used - parser.head_size(), parser.head_size());
+        } else if (ev == HTTPResponseParser::BODY) {
+            response.append(body.data(), body.size());
+        }
+
+        skt.consume(used);
+
+        if (ev == HTTPResponseParser::DONE)
             break;
 
-        for (int i = 0; buf[i]; ++i)
-            if (not isascii(buf[i]))
-                buf[i] = '@';
+        if (ev == HTTPResponseParser::NEED_MORE and skt.fill() <= 0) {
+            mark_server_closes();
+            if (parser.finish())
+                break;
 
-        partial << buf;
-    }
+            if (parser.status() == 0) {
+                /*
+                 * El servidor cerró la conexión sin enviarnos siquiera
+                 * los headers completos: retornamos lo que haya y la
+                 * conexión ya no podrá reusarse.
+                 * */
+                std::string partial(skt.peek());
+                skt.consume(partial.size());
+                pop_request(resource);
+                return include_headers ? partial : "";
+            }
 
-    auto response = partial.str();
-    if (include_headers) {
-        return response;
+            throw std::runtime_error("HTTP response truncated: connection closed by the server");
+        }
     }
 
+    status = parser.status();
+
+    /*
+     * Lo que haya quedado sin consumir en `skt` es el comienzo
+     * de la siguiente respuesta (la del siguiente pedido en la cola).
+     * */
+    pop_request(resource);
+
     /*
      * La intención de toda clase protocolo es la de abstraer al código
      * cliente los detalles del protocolo.
@@ -140,30 +483,103 @@ std::string HTTPProtocol::wait_response(bool include_headers) {
      * Salvo que se pida explícitamente, `HTTPProtocol::wait_response`
      * va a retornar el payload de la respuesta HTTP.
      *
-     * El protocolo HTTP establece que dicho payload viene luego de los headers
-     * separado por una línea vacía.
-     *
      * En el caso de un server web, el payload es la página web,
      * típicamente HTML.
      *
-     * `HTTPProtocol` podría ademas parsear los headers y ver si la respuesta
-     * fue correcta (200 OK). Sino, el protocolo debería fallar (sea seteando
-     * algún flag que el cliente deberá chequear o lanzando una excepción).
+     * `HTTPProtocol` no falla si el status no es 200 (OK): el caller
+     * puede consultarlo con `HTTPProtocol::last_status`.
+     * */
+
+    /*
+     * Los bytes no-ASCII se reemplazan por '@' (para no ensuciar la
+     * terminal con un payload binario). Los demás, incluido el '\0',
+     * quedan como están: la respuesta no se corta en el primer '\0'.
+     * */
+    simd_sanitize_ascii(response.data(), response.size(), '@');
+
+    return response;
+}
+
+template<typename Transport>
+bool BasicHTTPProtocol<Transport>::is_reusable() {
+    {
+        std::lock_guard<std::mutex> lock(pipeline->mtx);
+        if (pipeline->server_closes or pipeline->count > 0)
+            return false;
+    }
+
+    if (not keep_alive or skt.buffered() > 0)
+        return false;
+
+    Transport& raw = skt.socket();
+    if (raw.is_stream_send_closed() or raw.is_stream_recv_closed())
+        return false;
+
+    /*
+     * El servidor puede haber cerrado una conexión inactiva en cualquier
+     * momento (típicamente luego de unos segundos).
+     *
+     * Si ese es el caso, el socket esta "listo para leer" y un `recv`
+     * no-bloqueante retorna 0; si no, retorna `Socket::WOULD_BLOCK`.
+     * Cualquier otra cosa (datos que nadie pidió) también inutiliza
+     * la conexión.
      *
-     * En este caso asumiré que no hay errores.
+     * Miramos con `Socket::peek_nonblocking` y no poniendo al socket en
+     * modo no-bloqueante: ese modo es del file descriptor y otro thread
+     * (en `wait_response`) se encontraría de golpe con un `EAGAIN`.
      * */
-    auto pos = response.find("\r\n\r\n");
+    char probe;
+    int sz = 0;
+    try {
+        sz = raw.peek_nonblocking(&probe, 1);
+    } catch (const LibError&) {
+        /* Típicamente un `ECONNRESET`: la conexión no sirve más. */
+    }
+
+    return sz == Socket::WOULD_BLOCK;
+}
+
 
-    if (pos == std::string::npos)
-        return "";
-    else
-        return response.substr(pos + 4);
+template<typename Transport>
+int BasicHTTPProtocol<Transport>::last_status() const {
+    return status;
 }
 
+template<typename Transport>
+Transport& BasicHTTPProtocol<Transport>::transport() {
+    return skt.socket();
+}
 
-std::string HTTPProtocol::get(
-        const std::string& resource,
+template<typename Transport>
+std::string BasicHTTPProtocol<Transport>::get(
+        std::string_view resource,
         bool include_headers) {
     async_get(resource);
     return wait_response(include_headers);
 }
+
+template<typename Transport>
+std::string BasicHTTPProtocol<Transport>::request(
+        std::string_view method,
+        std::string_view resource,
+        const std::vector<HTTPHeader>& extra_headers,
+        std::string_view body,
+        bool include_headers) {
+    async_request(method, resource, extra_headers, body);
+    return wait_response(include_headers);
+}
+
+/*
+ * Véase el final de `buffered_socket.cpp`.
+ * */
+template class BasicHTTPProtocol<Socket>;
+template class BasicHTTPProtocol<SocketPairTransport>;
+template class BasicHTTPProtocol<MemoryTransport>;
+
+/*
+ * El constructor que se conecta solo es un template en si mismo:
+ * `template class` no lo instancia. Lo hacemos acá, y solo para
+ * los transportes que saben conectarse (por ahora `Socket`).
+ * */
+template BasicHTTPProtocol<Socket>::BasicHTTPProtocol(
+        const std::string&, const std::string&, bool, const BufferedSocketOptions&);
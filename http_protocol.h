@@ -2,17 +2,111 @@
 #define HTTP_PROTOCOL_H
 
 #include "socket.h"
+#include "buffered_socket.h"
+#include "transport.h"
+#include "http_parser.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <type_traits>
+#include <vector>
 
 /*
  * Versión simplificada del protocolo HTTP desde el punto de vista
  * de un cliente HTTP (no del server).
+ *
+ * `BasicHTTPProtocol` es un template sobre el "transporte" por el que
+ * habla (véase `transport.h`); `HTTPProtocol` es la versión para
+ * `Socket`, la de siempre.
  * */
-class HTTPProtocol {
+template<typename Transport>
+class BasicHTTPProtocol {
     private:
     const std::string hostname;
-    Socket skt;
+    BasicBufferedSocket<Transport> skt;
+
+    /*
+     * Con `keep_alive` le pedimos al servidor que no cierre la conexión
+     * luego de responder (`Connection: keep-alive`) así la podemos
+     * reutilizar para el siguiente pedido.
+     *
+     * Pero entonces ya no podemos leer la respuesta "hasta que el servidor
+     * cierre": tenemos que saber donde termina. Para eso HTTP/1.1 tiene
+     * el header `Content-Length` o bien el `Transfer-Encoding: chunked`.
+     *
+     * Como `Socket::recvsome` puede traernos bytes de más (el comienzo
+     * de la siguiente respuesta), leemos a través de un `BufferedSocket`
+     * que se los guarda para la próxima.
+     * */
+    bool keep_alive;
+
+    /*
+     * La parte de los headers que es igual en todos los pedidos
+     * (versión, `Accept`, `Connection` y `Host`). Se arma una única
+     * vez, en el constructor.
+     * */
+    const std::string common_headers;
+
+    /*
+     * Pipelining: con keep-alive podemos enviar varios pedidos sin esperar
+     * las respuestas. El servidor responde en el mismo orden en que
+     * recibió los pedidos así que la primera respuesta que llega es la
+     * del pedido más viejo aun sin responder.
+     *
+     * `Pipeline` es lo que comparten el thread que envía los pedidos
+     * (`HTTPProtocol::async_get`) y el que recibe las respuestas
+     * (`HTTPProtocol::wait_response`):
+     *
+     *  - `requested`: los recursos pedidos y aun sin responder, en orden,
+     *    y si fueron pedidos con `HEAD` (su respuesta no tiene payload,
+     *    véase `HTTPResponseParser::reset`). Es una cola circular
+     *    (`head` es el más viejo, `count` cuantos hay) que reutiliza sus
+     *    strings: luego de las primeras vueltas encolar un pedido no
+     *    reserva memoria.
+     *  - `window`: cuantos pedidos pueden estar sin responder a la vez
+     *    (0 es sin límite). Con la ventana llena `async_get` se bloquea
+     *    hasta que llegue una respuesta (`slot_freed`).
+     *  - `server_closes`: el servidor dijo que va a cerrar la conexión
+     *    (o ya la cerró) o falló un envío. Los pedidos que estén detrás
+     *    nunca serán respondidos.
+     *
+     * El mutex y la condition variable no se pueden mover; por eso
+     * `Pipeline` vive en el heap y nosotros solo tenemos un puntero
+     * (así `HTTPProtocol` sigue siendo movible).
+     * */
+    struct Pipeline {
+        std::mutex mtx;
+        std::condition_variable slot_freed;
+
+        struct Request {
+            std::string resource;
+            bool head;
+        };
+        std::vector<Request> requested;
+        size_t head = 0;
+        size_t count = 0;
+
+        unsigned int window = 0;
+        bool server_closes = false;
+    };
+    std::unique_ptr<Pipeline> pipeline;
+
+    /*
+     * Las respuestas se parsean a medida que llegan, directamente sobre
+     * el buffer de lectura de `skt` (véase `HTTPResponseParser`).
+     * */
+    HTTPResponseParser parser;
+    int status;
+
+    void push_request(std::string_view resource, bool head);
+    void drop_newest_request();
+    void mark_server_closes();
+    bool oldest_is_head();
+    void pop_request(std::string *resource);
+    std::string receive_response(std::string *resource, bool include_headers);
 
     public:
     /*
@@ -32,10 +126,28 @@ class HTTPProtocol {
      * En esta implementación de `HTTPProtocol` usa la segunda categoría:
      * `HTTPProtocol` puede o bien crear su propio socket o recibirlo como
      * parámetro.
+     *
+     * Crear su propio "socket" solo tiene sentido si el transporte sabe
+     * conectarse a `hostname:servname` (como `Socket`). Para cualquier
+     * otro este constructor no existe: usarlo es un error de compilación.
+     *
+     * De eso se encarga `std::enable_if`: si la condición es falsa
+     * el tipo del segundo parámetro del template no existe y el
+     * compilador descarta al constructor (SFINAE). La condición depende
+     * de `T` (y no directamente de `Transport`) porque solo se puede
+     * descartar así a un template.
+     *
+     * Con `buffers` se configuran los buffers de `skt`; por ejemplo
+     * `BufferedSocketOptions::max_read_buffer_sz` acota el tamaño
+     * de los headers de una respuesta.
      * */
-    explicit HTTPProtocol(
+    template<typename T = Transport,
+        typename std::enable_if<std::is_constructible<T, const char*, const char*>::value, int>::type = 0>
+    explicit BasicHTTPProtocol(
             const std::string& hostname,
-            const std::string& servname = "http");
+            const std::string& servname = "http",
+            bool keep_alive = false,
+            const BufferedSocketOptions& buffers = BufferedSocketOptions());
 
     /*
      * Constructor de `HTTPProtocol` que recibe un `Socket` *ya* conectado.
@@ -55,12 +167,20 @@ class HTTPProtocol {
      *
      * Cambiar la implementación te da mucha mas flexibilidad pero con un costo:
      * tendrás que usar el heap, polimorfismo y punteros y/o templates.
-     * Nada de eso lo veremos en este hands-on, esto queda para más adelante.
+     *
+     * Acá elegimos templates: `BasicHTTPProtocol<Transport>` recibe un
+     * `Transport&&` y el compilador genera una versión del protocolo
+     * por cada transporte. Sin heap, sin punteros y sin métodos virtuales
+     * (pero el transporte se elige al compilar, no al ejecutar).
      * */
-    HTTPProtocol(Socket&& skt, const std::string& hostname);
+    BasicHTTPProtocol(
+            Transport&& skt,
+            const std::string& hostname,
+            bool keep_alive = false,
+            const BufferedSocketOptions& buffers = BufferedSocketOptions());
 
     /*
-     * API sincrónica para GET.
+     * API asincrónica para GET.
      *
      * Con `HTTPProtocol::async_get` se puede pedir un recurso.
      * El método retornara luego de haber enviado el pedido pero
@@ -74,12 +194,76 @@ class HTTPProtocol {
      * de recibir algún respuesta.
      *
      * Típicamente el caller usara un thread para enviar los pedidos
-     * y otro thread para recibir las respuesta.
+     * y otro thread para recibir las respuesta. Eso es seguro: un único
+     * thread llamando a `async_get` y un único thread (posiblemente otro)
+     * llamando a `wait_response`. El `BufferedSocket` tiene buffers
+     * separados para cada lado y el `Socket` de abajo no comparte estado
+     * entre el envío y la recepción salvo `stream_status`, que es
+     * atómico. (No así el timestamping, véase `Socket::enable_timestamping`.)
+     *
+     * Enviar varios pedidos antes de recibir las respuestas (pipelining)
+     * requiere `keep_alive`: sin él, el servidor cierra la conexión luego
+     * de la primera respuesta y `async_get` lanza una excepción.
+     *
+     * Cada `wait_response` retorna la respuesta al pedido más viejo aun
+     * sin responder; la sobrecarga con `resource` además dice cual era.
+     *
+     * Con `more` en `true` el pedido queda en el buffer de escritura
+     * sin enviarse (véase `HTTPProtocol::flush`): así varios pedidos
+     * chicos salen juntos en un único segmento TCP.
      *
      * Véase `HTTPProtocol::get` para una implementación sincrónica de GET
+     * y `HTTPProtocol::set_pipeline_window` para acotar cuantos pedidos
+     * puede haber sin responder.
      * */
-    void async_get(const std::string& resource);
+    void async_get(std::string_view resource, bool more = false);
     std::string wait_response(bool include_headers=false);
+    std::string wait_response(std::string& resource, bool include_headers=false);
+
+    /*
+     * Como `HTTPProtocol::async_get` pero con cualquier método ("GET",
+     * "HEAD", "POST", ...), headers adicionales y, opcionalmente,
+     * un payload (se agrega el `Content-Length` correspondiente).
+     *
+     * Si el método, el recurso o algún header contiene un '\r' o un '\n'
+     * se lanza `std::invalid_argument` sin enviar nada.
+     *
+     * El pedido se escribe directamente en el buffer de escritura, sin
+     * armar strings intermedios: luego de los primeros pedidos (cuando
+     * los buffers y la cola del pipeline ya tienen su tamaño) enviar un
+     * pedido no reserva memoria. La excepción es un pedido que no entra
+     * en el buffer de escritura (típicamente por un payload grande) o uno
+     * con muchos headers extra (más de 5).
+     *
+     * Véase `HTTPProtocol::request` para la versión sincrónica.
+     * */
+    void async_request(
+            std::string_view method,
+            std::string_view resource,
+            const std::vector<HTTPHeader>& extra_headers = {},
+            std::string_view body = std::string_view(),
+            bool more = false);
+
+    /*
+     * Envía los pedidos que quedaron en el buffer de escritura
+     * por `async_get(..., true)`.
+     * */
+    void flush();
+
+    /*
+     * Limita a `max_in_flight` los pedidos sin responder (0, el default,
+     * es sin límite). Con la ventana llena `HTTPProtocol::async_get`
+     * se bloquea hasta que otro thread reciba una respuesta con
+     * `HTTPProtocol::wait_response`.
+     *
+     * Sin ventana un cliente que envía mucho más rápido de lo que recibe
+     * termina llenando los buffers del kernel (los suyos y los del
+     * servidor) y `async_get` se bloquea igual, pero en un `send`.
+     *
+     * Cuidado: si se usa un único thread, nunca pedir más que `max_in_flight`
+     * sin leer las respuestas o se bloqueara para siempre.
+     * */
+    void set_pipeline_window(unsigned int max_in_flight);
 
     /*
      * API sincrónica para GET.
@@ -92,13 +276,49 @@ class HTTPProtocol {
      * las respuestas y recibirlas concurrentemente (posiblemente en otro
      * thread), véase `HTTPProtocol::async_get` y `HTTPProtocol::wait_response`.
      * */
-    std::string get(const std::string& resource, bool include_headers=false);
+    std::string get(std::string_view resource, bool include_headers=false);
+
+    /*
+     * Versión sincrónica de `HTTPProtocol::async_request`.
+     * */
+    std::string request(
+            std::string_view method,
+            std::string_view resource,
+            const std::vector<HTTPHeader>& extra_headers = {},
+            std::string_view body = std::string_view(),
+            bool include_headers = false);
+
+    /*
+     * El código de status (200, 404, ...) de la última respuesta
+     * recibida o 0 si no se recibió ninguna completa.
+     * */
+    int last_status() const;
+
+    /*
+     * Retorna `true` si la conexión puede usarse para otro pedido:
+     * pedimos `keep_alive`, el servidor no dijo que la iba a cerrar,
+     * leímos completas todas las respuestas pedidas (una excepción
+     * a mitad de una respuesta deja la conexión inservible) y el
+     * servidor no la cerro mientras tanto.
+     *
+     * Véase `HTTPConnectionPool`.
+     * */
+    bool is_reusable();
+
+    /*
+     * El transporte de abajo. Por ejemplo, en un benchmark, para volver
+     * a servir la misma respuesta (`MemoryTransport::rewind`) sin
+     * crear un protocolo nuevo.
+     *
+     * No leas ni escribas directamente en él: romperías el protocolo.
+     * */
+    Transport& transport();
 
     /*
      * No queremos permitir que alguien haga copias
      * */
-    HTTPProtocol(const HTTPProtocol&) = delete;
-    HTTPProtocol& operator=(const HTTPProtocol&) = delete;
+    BasicHTTPProtocol(const BasicHTTPProtocol&) = delete;
+    BasicHTTPProtocol& operator=(const BasicHTTPProtocol&) = delete;
 
     /*
      * Queremos permitir mover a los objetos (move semantics).
@@ -106,8 +326,14 @@ class HTTPProtocol {
      * Como todos nuestros atributos son movibles, la implementación
      * por default de C++ nos alcanza.
      * */
-    HTTPProtocol(HTTPProtocol&&) = default;
-    HTTPProtocol& operator=(HTTPProtocol&&) = default;
+    BasicHTTPProtocol(BasicHTTPProtocol&&) = default;
+    BasicHTTPProtocol& operator=(BasicHTTPProtocol&&) = default;
 };
 
+/*
+ * Los métodos están definidos en `http_protocol.cpp` e instanciados
+ * ahí para cada transporte de `transport.h`.
+ * */
+typedef BasicHTTPProtocol<Socket> HTTPProtocol;
+
 #endif
@@ -0,0 +1,111 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cstring>
+
+const unsigned int LatencyHistogram::SUB_BITS;
+const unsigned int LatencyHistogram::SUB_BUCKETS;
+const unsigned int LatencyHistogram::BUCKETS;
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+unsigned int LatencyHistogram::bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS)
+        return ns;
+
+    /*
+     * `exp` es la posición del bit más significativo: `ns` esta
+     * en `[2^exp, 2^(exp+1))`. Los `SUB_BITS` bits siguientes
+     * indican en cual de los sub-baldes.
+     * */
+    unsigned int exp = 63 - __builtin_clzll(ns);
+    unsigned int sub = (ns >> (exp - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return exp * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(unsigned int bucket) {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    unsigned int exp = bucket / SUB_BUCKETS;
+    unsigned int sub = bucket % SUB_BUCKETS;
+    return ((uint64_t)(SUB_BUCKETS + sub + 1) << (exp - SUB_BITS)) - 1;
+}
+
+void LatencyHistogram::record(int64_t ns) {
+    if (ns < 0)
+        ns = 0;
+
+    ++counts[bucket_of(ns)];
+    ++total;
+    sum_ns += ns;
+    min_ns = std::min(min_ns, ns);
+    max_ns = std::max(max_ns, ns);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return total;
+}
+
+int64_t LatencyHistogram::min() const {
+    return total ? min_ns : 0;
+}
+
+int64_t LatencyHistogram::max() const {
+    return max_ns;
+}
+
+double LatencyHistogram::mean() const {
+    return total ? (double)(sum_ns / total) : 0;
+}
+
+int64_t LatencyHistogram::percentile(double p) const {
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)((p / 100.0) * total + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, total));
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min<int64_t>(bucket_upper_bound(i), max_ns);
+    }
+
+    return max_ns;
+}
+
+void LatencyHistogram::reset() {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    min_ns = INT64_MAX;
+    max_ns = 0;
+    sum_ns = 0;
+}
+
+LatencyHistogram& LatencyHistogram::operator+=(const LatencyHistogram& other) {
+    for (unsigned int i = 0; i < BUCKETS; ++i)
+        counts[i] += other.counts[i];
+
+    total += other.total;
+    sum_ns += other.sum_ns;
+    min_ns = std::min(min_ns, other.min_ns);
+    max_ns = std::max(max_ns, other.max_ns);
+    return *this;
+}
+
+void LatencyHistogram::print(std::ostream& out) const {
+    out << "n=" << count()
+        << " min=" << min() << "ns"
+        << " p50=" << percentile(50) << "ns"
+        << " p99=" << percentile(99) << "ns"
+        << " max=" << max() << "ns";
+}
+
+std::ostream& operator<<(std::ostream& out, const LatencyHistogram& h) {
+    h.print(out);
+    return out;
+}
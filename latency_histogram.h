@@ -0,0 +1,75 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Histograma de latencias (en nanosegundos).
+ *
+ * Guardar cada medición para después ordenarlas y calcular percentiles
+ * no escala: un socket puede hacer millones de envíos. En vez de eso
+ * contamos cuantas mediciones caen en cada "balde" (bucket) y los
+ * percentiles se calculan a partir de los conteos.
+ *
+ * Los baldes crecen exponencialmente: el balde `i` cuenta las latencias
+ * en `[2^i, 2^(i+1))` ns, cada uno partido a su vez en `SUB_BUCKETS`
+ * baldes iguales. Así el error relativo de un percentil es acotado
+ * (menor a 1/SUB_BUCKETS) tanto para 500ns como para 2s, con una
+ * cantidad de memoria fija y chica.
+ * */
+class LatencyHistogram {
+    public:
+    static const unsigned int SUB_BITS = 3;
+    static const unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+
+    private:
+    static const unsigned int BUCKETS = 64 * SUB_BUCKETS;
+
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    int64_t min_ns;
+    int64_t max_ns;
+    long double sum_ns;
+
+    static unsigned int bucket_of(uint64_t ns);
+    static uint64_t bucket_upper_bound(unsigned int bucket);
+
+    public:
+    LatencyHistogram();
+
+    /*
+     * Registra una medición. Las negativas (relojes desfasados)
+     * se cuentan como 0.
+     * */
+    void record(int64_t ns);
+
+    uint64_t count() const;
+    int64_t min() const;
+    int64_t max() const;
+    double mean() const;
+
+    /*
+     * Latencia por debajo de la cual están el `p` por ciento
+     * (0 a 100) de las mediciones (aproximada hacia arriba).
+     * */
+    int64_t percentile(double p) const;
+
+    void reset();
+
+    /*
+     * Suma las mediciones de `other` (por ejemplo, para juntar los
+     * histogramas de varios threads).
+     * */
+    LatencyHistogram& operator+=(const LatencyHistogram& other);
+
+    /*
+     * Imprime un resumen de una línea (cantidad, min, p50, p99, max).
+     * */
+    void print(std::ostream& out) const;
+};
+
+std::ostream& operator<<(std::ostream& out, const LatencyHistogram& h);
+
+#endif
@@ -24,15 +24,21 @@
 
 #include "liberror.h"
 
-LibError::LibError(int error_code, const char* fmt, ...) noexcept {
+LibError::LibError(int error_code, const char* msg) noexcept :
+    errcode(error_code),
+    pending_msg(msg) {
+    msg_error[0] = '\0';
+}
+
+void LibError::format_va(const char *fmt, ...) const noexcept {
     /* Aquí empieza la magia arcana proveniente de C.
      *
      * En C (y en C++) las funciones y métodos pueden recibir un número
      * arbitrario de argumentos. Esto se especifica con las elipsis
      * en la firma de la función.
      *
-     * Tanto `error_code` como `fmt` son argumentos formales. A continuación
-     * le siguen cero o más argumentos, los llamados variadicos.
+     * `fmt` es un argumento formal. A continuación le siguen cero
+     * o más argumentos, los llamados variadicos.
      *
      * Internamente los argumentos variadicos son cargados en el stack
      * y para marcar el principio de estos debemos llamar `va_start`
@@ -42,6 +48,16 @@ LibError::LibError(int error_code, const char* fmt, ...) noexcept {
     va_list args;
     va_start(args, fmt);
 
+    format(fmt, args);
+
+    /* Una vez que hemos usado los argumentos variadicos hay que liberarlos.
+     * Conceptualmente es como si estuvieran guardados en una lista
+     * aunque internamente están en el stack del programa.
+     * */
+    va_end(args);
+}
+
+void LibError::format(const char *fmt, va_list args) const noexcept {
     /*
      * `vsnprintf` es una función similar a `printf` que guarda en
      * un buffer `msg_error` el string `fmt` formateado con los
@@ -53,12 +69,6 @@ LibError::LibError(int error_code, const char* fmt, ...) noexcept {
      * */
     int s = vsnprintf(msg_error, sizeof(msg_error), fmt, args);
 
-    /* Una vez que hemos usado los argumentos variadicos hay que liberarlos.
-     * Conceptualmente es como si estuvieran guardados en una lista
-     * aunque internamente están en el stack del programa.
-     * */
-    va_end(args);
-
     if (s < 0) {
         /* Algo falló al llamar a `vsnprintf` pero no podemos hacer nada.
          *
@@ -95,7 +105,7 @@ LibError::LibError(int error_code, const char* fmt, ...) noexcept {
     }
 
     /*
-     * `strerror_r` toma el `error_code` y lo traduce a un mensaje entendible
+     * `strerror_r` toma el `errcode` y lo traduce a un mensaje entendible
      * por el humano y lo escribe en el buffer. A diferencia de `strerror`,
      * `strerror_r` es thread safe ya que usa un buffer local (`msg_error`)
      * y no uno `static` (aka, global).
@@ -104,7 +114,7 @@ LibError::LibError(int error_code, const char* fmt, ...) noexcept {
      * y es exactamente lo que queremos: queremos escribir a continuación
      * de lo escrito por `vsnprintf` pisándole el `\0`.
      * */
-    strerror_r(error_code, msg_error+s, sizeof(msg_error)-s);
+    strerror_r(errcode, msg_error+s, sizeof(msg_error)-s);
 
     /*
      * `strerror_r` garantiza que el string termina siempre en un `\0`
@@ -114,7 +124,21 @@ LibError::LibError(int error_code, const char* fmt, ...) noexcept {
     msg_error[sizeof(msg_error)-1] = 0;
 }
 
+int LibError::code() const noexcept {
+    return errcode;
+}
+
 const char* LibError::what() const noexcept {
+    if (pending_msg) {
+        /*
+         * El mensaje no tiene argumentos pero lo pasamos igual por
+         * `LibError::format` como `"%s"` (por si tuviera algún `%`).
+         * */
+        const char *msg = pending_msg;
+        pending_msg = nullptr;
+        format_va("%s", msg);
+    }
+
     return msg_error;
 }
 
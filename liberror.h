@@ -1,6 +1,7 @@
 #ifndef LIB_ERROR_H
 #define LIB_ERROR_H
 
+#include <cstdarg>
 #include <exception>
 
 /*
@@ -9,7 +10,20 @@
  * de decodificar el `errno` en un mensaje más entendible.
  * */
 class LibError : public std::exception {
-    char msg_error[256];
+    int errcode;
+
+    /*
+     * Mensaje aun sin formatear (véase el constructor de 2 argumentos)
+     * o `nullptr` si `msg_error` ya esta listo.
+     *
+     * `LibError::what` es `const` pero formatea (y escribe) `msg_error`
+     * la primera vez que se lo llama: de ahí el `mutable`.
+     * */
+    mutable const char *pending_msg;
+    mutable char msg_error[256];
+
+    void format(const char *fmt, va_list args) const noexcept;
+    void format_va(const char *fmt, ...) const noexcept;
 
     public:
     /*
@@ -19,14 +33,49 @@ class LibError : public std::exception {
      * ya se haya detectado el error.
      *
      * El constructor `LibError` es variadico y recibe, ademas del `errno`,
-     * un format-string (como `printf`) y cero o más argumentos que
+     * un format-string (como `printf`) y uno o más argumentos que
      * formaran parte del mensaje.
      *
      * int ret = foo();
      * if (ret == -1)
      *      throw LibError(errno, "The function %s has failed: ", "foo");
+     *
+     * Los argumentos variadicos solo son validos durante esta llamada
+     * (y podrían ser punteros a strings que no sobrevivan a la excepción)
+     * así que este constructor formatea el mensaje inmediatamente.
+     *
+     * Es un template (y no una función variadica de C) solo para que
+     * no se confunda con el constructor de 2 argumentos (véase más abajo):
+     * exige al menos un argumento extra.
      *  */
-    LibError(int error_code, const char* fmt, ...) noexcept;
+    template<typename Arg, typename... Args>
+    LibError(int error_code, const char* fmt, Arg arg, Args... args) noexcept :
+        errcode(error_code),
+        pending_msg(nullptr) {
+        format_va(fmt, arg, args...);
+    }
+
+    /*
+     * Formatear el mensaje (`vsnprintf` más `strerror_r`) no es gratis
+     * y muchas veces nadie lo va a leer: la excepción es atrapada y
+     * se la ignora (o se mira solo el `errno`, véase `LibError::code`).
+     *
+     * Cuando el mensaje no tiene argumentos, este constructor solo guarda
+     * el `errno` y el puntero al mensaje y lo formatea recién cuando se llama
+     * a `LibError::what`.
+     *
+     * Por eso `msg` debe ser un string literal (o vivir al menos tanto como
+     * la excepción): no se hace una copia.
+     *
+     * Ojo: la primer llamada a `LibError::what` escribe el mensaje así que
+     * dos threads no deben llamarlo a la vez sobre la *misma* excepción.
+     * */
+    LibError(int error_code, const char* msg) noexcept;
+
+    /*
+     * El `errno` con el que se construyo la excepción.
+     * */
+    int code() const noexcept;
 
     virtual const char* what() const noexcept;
 
@@ -0,0 +1,150 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "reactor.h"
+#include "liberror.h"
+
+#include <stdexcept>
+#include <utility>
+
+Reactor::Reactor(int max_events) :
+    epfd(-1),
+    stopped(false),
+    events(max_events)
+{
+    /*
+     * `EPOLL_CLOEXEC` evita que el file descriptor de `epoll` se
+     * "filtre" a procesos hijos si hacemos un `fork` + `exec`.
+     * */
+    this->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epfd == -1)
+        throw LibError(errno, "epoll_create1 failed");
+}
+
+void Reactor::add(Socket& skt, uint32_t events, Handler handler) {
+    chk_epfd_or_fail();
+    skt.chk_skt_or_fail();
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = skt.skt;
+
+    if (epoll_ctl(this->epfd, EPOLL_CTL_ADD, skt.skt, &ev) == -1)
+        throw LibError(errno, "epoll_ctl(ADD) failed for fd %d", skt.skt);
+
+    /*
+     * Si el file descriptor fue reusado por el sistema operativo
+     * (un socket se cerro y otro nuevo obtuvo el mismo número)
+     * simplemente pisamos al handler viejo.
+     * */
+    handlers[skt.skt] = std::make_shared<Handler>(std::move(handler));
+}
+
+void Reactor::modify(Socket& skt, uint32_t events) {
+    chk_epfd_or_fail();
+    skt.chk_skt_or_fail();
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = skt.skt;
+
+    if (epoll_ctl(this->epfd, EPOLL_CTL_MOD, skt.skt, &ev) == -1)
+        throw LibError(errno, "epoll_ctl(MOD) failed for fd %d", skt.skt);
+}
+
+void Reactor::remove(Socket& skt) {
+    chk_epfd_or_fail();
+    skt.chk_skt_or_fail();
+
+    /*
+     * Antes de Linux 2.6.9 `EPOLL_CTL_DEL` requería un puntero no nulo
+     * aunque lo ignoraba; pasamos uno por las dudas.
+     * */
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if (epoll_ctl(this->epfd, EPOLL_CTL_DEL, skt.skt, &ev) == -1)
+        throw LibError(errno, "epoll_ctl(DEL) failed for fd %d", skt.skt);
+
+    handlers.erase(skt.skt);
+}
+
+int Reactor::run_once(int timeout_ms) {
+    chk_epfd_or_fail();
+
+    int n = epoll_wait(this->epfd, events.data(), events.size(), timeout_ms);
+    return dispatch(n);
+}
+
+int Reactor::run_once_ns(int64_t timeout_ns) {
+    chk_epfd_or_fail();
+
+    if (timeout_ns < 0)
+        return run_once(-1);
+
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ns / 1000000000;
+    timeout.tv_nsec = timeout_ns % 1000000000;
+
+    int n = epoll_pwait2(this->epfd, events.data(), events.size(), &timeout, nullptr);
+    if (n == -1 and errno == ENOSYS) {
+        /*
+         * Kernel anterior a 5.11: redondeamos hacia arriba al
+         * milisegundo (mejor esperar de más que despertarnos antes).
+         * */
+        return run_once((timeout_ns + 999999) / 1000000);
+    }
+
+    return dispatch(n);
+}
+
+int Reactor::dispatch(int n) {
+    if (n == -1) {
+        /*
+         * Una señal interrumpió la espera. No es un error.
+         * */
+        if (errno == EINTR)
+            return 0;
+        throw LibError(errno, "epoll_wait failed");
+    }
+
+    for (int i = 0; i < n; ++i) {
+        /*
+         * El handler de un evento anterior pudo haber des-registrado
+         * a este socket. En tal caso simplemente lo ignoramos.
+         * */
+        auto it = handlers.find(events[i].data.fd);
+        if (it == handlers.end())
+            continue;
+
+        std::shared_ptr<Handler> handler = it->second;
+        (*handler)(events[i].events);
+    }
+
+    return n;
+}
+
+void Reactor::run() {
+    this->stopped = false;
+    while (not this->stopped) {
+        run_once(-1);
+    }
+}
+
+void Reactor::stop() {
+    this->stopped = true;
+}
+
+Reactor::~Reactor() {
+    if (this->epfd != -1)
+        ::close(this->epfd);
+}
+
+void Reactor::chk_epfd_or_fail() const {
+    if (epfd == -1) {
+        throw std::runtime_error("reactor with invalid epoll file descriptor (-1)");
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/epoll.h>
+#include <cstdint>
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "socket.h"
+
+/*
+ * Reactor (o "event loop") basado en `epoll`.
+ *
+ * La idea es simple: en vez de bloquearnos en un `recv` o `accept`
+ * de *un* socket, registramos *muchos* sockets (en modo no-bloqueante)
+ * y le pedimos al sistema operativo que nos avise cuales de ellos
+ * están listos para ser leídos o escritos.
+ *
+ * Por cada socket "listo", el reactor llama al callback (handler)
+ * registrado para ese socket. El handler nunca debería bloquearse:
+ * debe hacer lo que pueda y retornar (véase `Socket::set_nonblocking`).
+ *
+ * Así un único thread puede atender decenas de miles de conexiones.
+ *
+ * Lease manpage de `epoll`, `epoll_ctl` y `epoll_wait`.
+ * */
+class Reactor {
+    public:
+    /*
+     * El handler recibe la máscara de eventos (`EPOLLIN`, `EPOLLOUT`,
+     * `EPOLLERR`, `EPOLLHUP`, ...) que el socket tiene listos.
+     * */
+    typedef std::function<void(uint32_t events)> Handler;
+
+    private:
+    int epfd;
+    bool stopped;
+
+    /*
+     * Un handler puede querer des-registrarse a si mismo (por ejemplo
+     * cuando la conexión se cerró). Si lo destruyéramos inmediatamente
+     * estaríamos destruyendo el `std::function` que se esta ejecutando
+     * en ese momento.
+     *
+     * Por eso los guardamos en un `std::shared_ptr`: mientras se despacha
+     * un evento el reactor mantiene una referencia extra al handler
+     * y este recién se destruye al terminar.
+     * */
+    std::unordered_map<int, std::shared_ptr<Handler>> handlers;
+
+    std::vector<struct epoll_event> events;
+
+    void chk_epfd_or_fail() const;
+
+    /*
+     * Despacha los `n` eventos que retorno `epoll_wait`.
+     * */
+    int dispatch(int n);
+
+    public:
+    /*
+     * Crea el reactor. `max_events` es la cantidad máxima de eventos
+     * que se procesaran por cada llamada a `epoll_wait`.
+     *
+     * En caso de error se lanza una excepción.
+     * */
+    explicit Reactor(int max_events = 1024);
+
+    /*
+     * Registra al socket para ser notificado de los eventos `events`
+     * (típicamente `EPOLLIN` y/o `EPOLLOUT`). El `handler` se llamara
+     * cada vez que el socket tenga alguno de esos eventos listos.
+     *
+     * El socket *no* es copiado ni movido: es responsabilidad
+     * del caller mantenerlo vivo y llamar a `Reactor::remove`
+     * *antes* de destruirlo o cerrarlo.
+     * */
+    void add(Socket& skt, uint32_t events, Handler handler);
+
+    /*
+     * Cambia los eventos de interés de un socket ya registrado.
+     * Por ejemplo para esperar a `EPOLLOUT` cuando el buffer de envío
+     * se lleno y volver a `EPOLLIN` una vez que se vació.
+     * */
+    void modify(Socket& skt, uint32_t events);
+
+    /*
+     * Des-registra al socket. Es seguro llamarlo desde el propio handler.
+     * */
+    void remove(Socket& skt);
+
+    /*
+     * Espera a lo sumo `timeout_ms` milisegundos (-1 para esperar
+     * indefinidamente) a que haya eventos y los despacha.
+     *
+     * Retorna la cantidad de eventos despachados.
+     * */
+    int run_once(int timeout_ms = -1);
+
+    /*
+     * Como `Reactor::run_once` pero con un timeout en nanosegundos
+     * (`epoll_pwait2`, Linux 5.11): para cuando un milisegundo
+     * es demasiado (por ejemplo, para enviar a un ritmo fijo,
+     * véase `echo_bench.cpp`).
+     * */
+    int run_once_ns(int64_t timeout_ns);
+
+    /*
+     * Despacha eventos hasta que alguien llame a `Reactor::stop`.
+     * */
+    void run();
+    void stop();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    /*
+     * Por simplicidad `Reactor` no es movible: los handlers suelen
+     * capturar una referencia al reactor.
+     * */
+    Reactor(Reactor&&) = delete;
+    Reactor& operator=(Reactor&&) = delete;
+
+    ~Reactor();
+};
+#endif
@@ -17,7 +17,8 @@
 Resolver::Resolver(
         const char* hostname,
         const char* servname,
-        bool is_passive) {
+        bool is_passive,
+        int family) {
     struct addrinfo hints;
     this->result = this->_next = nullptr;
 
@@ -31,10 +32,10 @@ Resolver::Resolver(
      * que le indicaran que tipo de direcciones queremos.
      *
      * Para nuestros fines queremos direcciones de internet IPv4
-     * y para servicios de TCP.
+     * (salvo que se pida otra familia) y para servicios de TCP.
      * */
     memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_INET;       /* IPv4 (or AF_INET6 for IPv6)     */
+    hints.ai_family = family;        /* IPv4 (or AF_INET6 for IPv6)     */
     hints.ai_socktype = SOCK_STREAM; /* TCP  (or SOCK_DGRAM for UDP)    */
     hints.ai_flags = is_passive ? AI_PASSIVE : 0;
 
@@ -9,7 +9,7 @@
  * "Resolvedor" de hostnames y service names.
  *
  * Por simplificación este TDA se enfocara solamente
- * en direcciones IPv4 para TCP.
+ * en direcciones para TCP (IPv4 por default).
  * */
 class Resolver {
     private:
@@ -38,12 +38,17 @@ class Resolver {
  * las direcciones retornadas serán aptas para hacer un `bind`
  * y poner al socket en modo escucha para recibir conexiones.
  *
+ * Por default solo se buscan direcciones IPv4 (`AF_INET`).
+ * Con `family` se pueden pedir direcciones IPv6 (`AF_INET6`)
+ * o ambas (`AF_UNSPEC`).
+ *
  * En caso de error se lanza una excepción.
  * */
 Resolver(
         const char* hostname,
         const char* servname,
-        bool is_passive);
+        bool is_passive,
+        int family = AF_INET);
 
 /*
  * Deshabilitamos el constructor por copia y operador asignación por copia
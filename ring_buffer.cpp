@@ -0,0 +1,176 @@
+#include "ring_buffer.h"
+#include "liberror.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <errno.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+MirroredRingBuffer::MirroredRingBuffer(size_t min_capacity) :
+    base(nullptr),
+    rpos(0),
+    len(0) {
+    const size_t page_sz = sysconf(_SC_PAGESIZE);
+    cap = ((min_capacity + page_sz - 1) / page_sz) * page_sz;
+    if (cap == 0)
+        cap = page_sz;
+
+    int fd = memfd_create("ring-buffer", MFD_CLOEXEC);
+    if (fd == -1)
+        throw LibError(errno, "memfd_create failed");
+
+    if (ftruncate(fd, cap) == -1) {
+        int saved_errno = errno;
+        ::close(fd);
+        throw LibError(saved_errno, "ring buffer ftruncate failed");
+    }
+
+    /*
+     * Primero reservamos `2*cap` bytes de direcciones virtuales
+     * contiguas (sin memoria detrás, `PROT_NONE`) y después mapeamos
+     * el memfd dos veces *encima* de esa reserva (`MAP_FIXED`).
+     *
+     * Si mapeáramos el memfd dos veces sin la reserva, el kernel podría
+     * ponerlos en cualquier lado y no necesariamente uno a continuación
+     * del otro.
+     * */
+    void *region = mmap(nullptr, 2 * cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        int saved_errno = errno;
+        ::close(fd);
+        throw LibError(saved_errno, "ring buffer mmap (reserve) failed");
+    }
+
+    base = (char*)region;
+    for (int i = 0; i < 2; ++i) {
+        void *half = mmap(base + i * cap, cap,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        if (half == MAP_FAILED) {
+            int saved_errno = errno;
+            ::close(fd);
+            release();
+            throw LibError(saved_errno, "ring buffer mmap (mirror) failed");
+        }
+    }
+
+    /*
+     * Los mapeos mantienen viva la memoria: el file descriptor
+     * ya no nos hace falta.
+     * */
+    ::close(fd);
+}
+
+size_t MirroredRingBuffer::capacity() const {
+    return cap;
+}
+
+const char* MirroredRingBuffer::read_ptr() const {
+    return base + rpos;
+}
+
+size_t MirroredRingBuffer::readable() const {
+    return len;
+}
+
+std::string_view MirroredRingBuffer::view() const {
+    return std::string_view(base + rpos, len);
+}
+
+void MirroredRingBuffer::consume(size_t sz) {
+    if (sz > len)
+        throw std::out_of_range("ring buffer consume past the readable bytes");
+
+    /*
+     * `rpos` siempre queda dentro del primer mapeo: lo que esta
+     * "después" lo vemos a través del segundo.
+     * */
+    rpos = (rpos + sz) % cap;
+    len -= sz;
+
+    if (len == 0)
+        rpos = 0;
+}
+
+char* MirroredRingBuffer::write_ptr() const {
+    return base + ((rpos + len) % cap);
+}
+
+size_t MirroredRingBuffer::writable() const {
+    return cap - len;
+}
+
+void MirroredRingBuffer::commit(size_t sz) {
+    if (sz > cap - len)
+        throw std::out_of_range("ring buffer commit past the writable bytes");
+
+    len += sz;
+}
+
+int MirroredRingBuffer::recv_from(Socket& skt) {
+    /*
+     * Un `recvsome` de 0 bytes retornaría 0, que es lo mismo que
+     * retorna cuando el otro extremo cerró la conexión.
+     * */
+    if (writable() == 0)
+        throw std::length_error("ring buffer is full");
+
+    int sz = skt.recvsome(write_ptr(), writable());
+    if (sz > 0)
+        commit(sz);
+
+    return sz;
+}
+
+void MirroredRingBuffer::grow(size_t min_capacity) {
+    if (min_capacity <= cap)
+        return;
+
+    /*
+     * Los legibles son contiguos (gracias al espejado) así que alcanza
+     * con un único `memcpy`; en el buffer nuevo quedan al principio.
+     * */
+    MirroredRingBuffer bigger(min_capacity);
+    memcpy(bigger.base, base + rpos, len);
+    bigger.len = len;
+
+    *this = std::move(bigger);
+}
+
+void MirroredRingBuffer::release() {
+    if (base)
+        munmap(base, 2 * cap);
+    base = nullptr;
+}
+
+MirroredRingBuffer::MirroredRingBuffer(MirroredRingBuffer&& other) :
+    base(other.base),
+    cap(other.cap),
+    rpos(other.rpos),
+    len(other.len) {
+    other.base = nullptr;
+    other.rpos = other.len = 0;
+}
+
+MirroredRingBuffer& MirroredRingBuffer::operator=(MirroredRingBuffer&& other) {
+    if (this == &other)
+        return *this;
+
+    release();
+
+    base = other.base;
+    cap = other.cap;
+    rpos = other.rpos;
+    len = other.len;
+
+    other.base = nullptr;
+    other.rpos = other.len = 0;
+    return *this;
+}
+
+MirroredRingBuffer::~MirroredRingBuffer() {
+    release();
+}
@@ -0,0 +1,102 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <cstddef>
+#include <string_view>
+
+#include "socket.h"
+
+/*
+ * Buffer circular "espejado" (mirrored o double-mapped ring buffer).
+ *
+ * Un buffer circular común tiene un problema: los datos pueden quedar
+ * partidos en dos, una parte al final del buffer y otra al principio.
+ * Un parser que quiera buscar un `"\r\n\r\n"` tiene que contemplar
+ * el corte o bien copiar (compactar) los datos para juntarlos.
+ *
+ * El truco: mapear la *misma* memoria física dos veces, una a continuación
+ * de la otra, en el espacio de direcciones virtual.
+ *
+ *        base              base + capacity       base + 2*capacity
+ *         |  memoria física    |  la misma memoria    |
+ *         |   [0, capacity)    |  física, de nuevo    |
+ *
+ * Así leer o escribir pasado el final del primer mapeo es leer o escribir
+ * en el principio del buffer: cualquier región de hasta `capacity` bytes
+ * es siempre contigua y nunca hay que copiar nada.
+ *
+ * La memoria física se obtiene de un `memfd_create` (un "archivo"
+ * anónimo en memoria) y se mapea dos veces con `mmap`.
+ *
+ * Lease manpage de `memfd_create` y `mmap`.
+ * */
+class MirroredRingBuffer {
+    private:
+    char *base;
+    size_t cap;
+
+    /*
+     * Los bytes legibles están en `[base + rpos, base + rpos + len)`,
+     * región siempre contigua gracias al espejado.
+     * */
+    size_t rpos;
+    size_t len;
+
+    void release();
+
+    public:
+    /*
+     * Crea el buffer con al menos `min_capacity` bytes (se redondea
+     * hacia arriba a un múltiplo del tamaño de página).
+     * */
+    explicit MirroredRingBuffer(size_t min_capacity);
+
+    size_t capacity() const;
+
+    /*
+     * Lado de lectura: `readable` bytes contiguos a partir de `read_ptr`.
+     * `consume` los descarta.
+     * */
+    const char* read_ptr() const;
+    size_t readable() const;
+    std::string_view view() const;
+    void consume(size_t sz);
+
+    /*
+     * Lado de escritura: `writable` bytes contiguos libres a partir
+     * de `write_ptr`. Luego de escribir en ellos hay que llamar a `commit`.
+     * */
+    char* write_ptr() const;
+    size_t writable() const;
+    void commit(size_t sz);
+
+    /*
+     * Hace un `Socket::recvsome` directamente en el espacio libre:
+     * el kernel escribe en el buffer y no hay copias intermedias.
+     *
+     * Retorna lo mismo que `Socket::recvsome`. Si el buffer esta lleno
+     * lanza una excepción (no hay donde recibir y un 0 se confundiría
+     * con el cierre de la conexión).
+     * */
+    int recv_from(Socket& skt);
+
+    /*
+     * Agranda el buffer a al menos `min_capacity` bytes (si ya es
+     * así de grande no hace nada).
+     *
+     * Un buffer espejado no se puede agrandar en el lugar: se crea uno
+     * nuevo y se copian los bytes legibles. Los punteros y vistas
+     * obtenidos antes dejan de ser validos.
+     * */
+    void grow(size_t min_capacity);
+
+    MirroredRingBuffer(const MirroredRingBuffer&) = delete;
+    MirroredRingBuffer& operator=(const MirroredRingBuffer&) = delete;
+
+    MirroredRingBuffer(MirroredRingBuffer&&);
+    MirroredRingBuffer& operator=(MirroredRingBuffer&&);
+
+    ~MirroredRingBuffer();
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "shared_poller.h"
+#include "liberror.h"
+
+#include <vector>
+
+SharedPoller::SharedPoller() :
+    epfd(-1) {
+    this->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epfd == -1)
+        throw LibError(errno, "epoll_create1 failed");
+}
+
+void SharedPoller::ctl(int op, Socket& skt, uint32_t events, void *cookie) {
+    skt.chk_skt_or_fail();
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = cookie;
+
+    if (epoll_ctl(this->epfd, op, skt.skt, &ev) == -1)
+        throw LibError(errno, "epoll_ctl failed for fd %d", skt.skt);
+}
+
+void SharedPoller::add(Socket& skt, uint32_t events, void *cookie) {
+    ctl(EPOLL_CTL_ADD, skt, events, cookie);
+}
+
+void SharedPoller::rearm(Socket& skt, uint32_t events, void *cookie) {
+    ctl(EPOLL_CTL_MOD, skt, events, cookie);
+}
+
+void SharedPoller::remove(Socket& skt) {
+    skt.chk_skt_or_fail();
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if (epoll_ctl(this->epfd, EPOLL_CTL_DEL, skt.skt, &ev) == -1)
+        throw LibError(errno, "epoll_ctl(DEL) failed for fd %d", skt.skt);
+}
+
+int SharedPoller::wait(std::vector<PollEvent>& ready, int timeout_ms) {
+    /*
+     * Varios threads pueden estar esperando a la vez: cada uno
+     * con su propio buffer de eventos.
+     * */
+    static thread_local std::vector<struct epoll_event> events;
+    events.resize(ready.size());
+
+    int n = epoll_wait(this->epfd, events.data(), events.size(), timeout_ms);
+    if (n == -1) {
+        if (errno == EINTR)
+            return 0;
+        throw LibError(errno, "epoll_wait failed");
+    }
+
+    for (int i = 0; i < n; ++i)
+        ready[i] = {events[i].data.ptr, events[i].events};
+
+    return n;
+}
+
+SharedPoller::~SharedPoller() {
+    if (this->epfd != -1)
+        ::close(this->epfd);
+}
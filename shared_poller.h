@@ -0,0 +1,84 @@
+#ifndef SHARED_POLLER_H
+#define SHARED_POLLER_H
+
+#include <sys/epoll.h>
+#include <cstdint>
+
+#include <vector>
+
+#include "socket.h"
+
+/*
+ * Un socket listo reportado por `SharedPoller::wait`.
+ * */
+struct PollEvent {
+    void *cookie;
+    uint32_t events;
+};
+
+/*
+ * Envoltorio de `epoll` para ser usado desde *varios* threads a la vez.
+ *
+ * `Reactor` guarda un handler por socket y los llama él mismo: pensado
+ * para un único thread. Acá, en cambio, un thread espera los eventos
+ * (`SharedPoller::wait`) y los reparte a otros threads que los atienden
+ * y luego vuelven a registrar al socket (`SharedPoller::rearm`).
+ *
+ * Todos los sockets se registran con `EPOLLONESHOT`: luego de reportar
+ * un evento, `epoll` no vuelve a reportar nada de ese socket hasta que
+ * se lo "rearme". Así nunca hay dos threads atendiendo al mismo socket
+ * a la vez y quien lo esta atendiendo puede incluso cerrarlo (previo
+ * `SharedPoller::remove`) sin miedo a que otro lo este usando.
+ *
+ * `SharedPoller` no guarda nada por socket: cada uno se registra con
+ * un `cookie` (típicamente un puntero al estado de la conexión) que es
+ * lo que se reporta cuando el socket esta listo. Las llamadas a `epoll_ctl`
+ * y `epoll_wait` son thread-safe así que `SharedPoller` también lo es.
+ *
+ * Lease manpage de `epoll_ctl` (`EPOLLONESHOT`).
+ * */
+class SharedPoller {
+    private:
+    int epfd;
+
+    void ctl(int op, Socket& skt, uint32_t events, void *cookie);
+
+    public:
+    SharedPoller();
+
+    /*
+     * Registra al socket para ser notificado (una vez) de los eventos
+     * `events` (`EPOLLONESHOT` se agrega solo).
+     *
+     * Como con `Reactor::add`, el socket no es copiado ni movido.
+     * */
+    void add(Socket& skt, uint32_t events, void *cookie);
+
+    /*
+     * Vuelve a habilitar la notificación de un socket ya reportado.
+     * */
+    void rearm(Socket& skt, uint32_t events, void *cookie);
+
+    /*
+     * Des-registra al socket.
+     * */
+    void remove(Socket& skt);
+
+    /*
+     * Espera a lo sumo `timeout_ms` milisegundos (-1 para esperar
+     * indefinidamente) a que haya sockets listos y los guarda en `ready`
+     * (a lo sumo `ready.size()`).
+     *
+     * Retorna la cantidad de eventos guardados.
+     * */
+    int wait(std::vector<PollEvent>& ready, int timeout_ms = -1);
+
+    SharedPoller(const SharedPoller&) = delete;
+    SharedPoller& operator=(const SharedPoller&) = delete;
+    SharedPoller(SharedPoller&&) = delete;
+    SharedPoller& operator=(SharedPoller&&) = delete;
+
+    ~SharedPoller();
+};
+
+#endif
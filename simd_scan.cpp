@@ -0,0 +1,227 @@
+#include "simd_scan.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SCAN_X86 1
+#endif
+
+/*
+ * Versiones escalares: la referencia y lo que se usa para las colas
+ * (los últimos bytes que no llenan un vector entero).
+ * */
+static size_t find_scalar(std::string_view data, std::string_view delim, size_t from) {
+    return data.find(delim, from);
+}
+
+static size_t sanitize_scalar(char *data, size_t sz, char replacement) {
+    size_t n = 0;
+    for (size_t i = 0; i < sz; ++i) {
+        if ((unsigned char)data[i] > 127) {
+            data[i] = replacement;
+            ++n;
+        }
+    }
+    return n;
+}
+
+#ifdef SIMD_SCAN_X86
+/*
+ * Revisa los candidatos de `mask` (el bit `b` encendido significa que
+ * en `base + b` empiezan los dos primeros bytes de `delim`) y retorna
+ * la posición del primero que coincida entero.
+ * */
+static size_t check_candidates(
+        std::string_view data,
+        std::string_view delim,
+        size_t base,
+        uint32_t mask) {
+    while (mask) {
+        size_t pos = base + __builtin_ctz(mask);
+        if (pos + delim.size() <= data.size()
+                and memcmp(data.data() + pos + 2, delim.data() + 2, delim.size() - 2) == 0)
+            return pos;
+        mask &= mask - 1;
+    }
+    return std::string_view::npos;
+}
+
+/*
+ * La idea (para ambas versiones): comparamos un vector de bytes con el
+ * primer byte de `delim` y el vector que empieza un byte después con el
+ * segundo. Donde ambas comparaciones den verdadero puede empezar `delim`.
+ *
+ * Para "\r\n" eso ya es una coincidencia; para "\r\n\r\n" hay que
+ * verificar el resto, pero los candidatos son pocos.
+ * */
+__attribute__((target("sse2")))
+static size_t find_sse2(std::string_view data, std::string_view delim, size_t from) {
+    if (delim.size() < 2)
+        return find_scalar(data, delim, from);
+
+    const char *p = data.data();
+    const __m128i first = _mm_set1_epi8(delim[0]);
+    const __m128i second = _mm_set1_epi8(delim[1]);
+
+    size_t i = from;
+    for (; i + 16 + 1 <= data.size(); i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 1));
+        uint32_t mask = _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, second)));
+
+        size_t pos = check_candidates(data, delim, i, mask);
+        if (pos != std::string_view::npos)
+            return pos;
+    }
+
+    return find_scalar(data, delim, i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_avx2(std::string_view data, std::string_view delim, size_t from) {
+    if (delim.size() < 2)
+        return find_scalar(data, delim, from);
+
+    const char *p = data.data();
+    const __m256i first = _mm256_set1_epi8(delim[0]);
+    const __m256i second = _mm256_set1_epi8(delim[1]);
+
+    size_t i = from;
+
+    /*
+     * De a 64 bytes por vuelta: la mayoría de los bloques no tienen
+     * ningún candidato y con un único salto descartamos dos vectores.
+     * */
+    for (; i + 64 + 1 <= data.size(); i += 64) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(p + i + 1));
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(p + i + 32));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(p + i + 33));
+        __m256i m0 = _mm256_and_si256(_mm256_cmpeq_epi8(a0, first), _mm256_cmpeq_epi8(b0, second));
+        __m256i m1 = _mm256_and_si256(_mm256_cmpeq_epi8(a1, first), _mm256_cmpeq_epi8(b1, second));
+
+        if (_mm256_testz_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m0, m1)))
+            continue;
+
+        size_t pos = check_candidates(data, delim, i, _mm256_movemask_epi8(m0));
+        if (pos == std::string_view::npos)
+            pos = check_candidates(data, delim, i + 32, _mm256_movemask_epi8(m1));
+        if (pos != std::string_view::npos)
+            return pos;
+    }
+
+    for (; i + 32 + 1 <= data.size(); i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + i + 1));
+        uint32_t mask = _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, second)));
+
+        size_t pos = check_candidates(data, delim, i, mask);
+        if (pos != std::string_view::npos)
+            return pos;
+    }
+
+    return find_sse2(data, delim, i);
+}
+
+/*
+ * Un byte es no-ASCII si tiene el bit más significativo encendido, o
+ * sea, si visto como entero *con signo* es negativo.
+ *
+ * SSE2 no tiene "elegir byte a byte entre dos vectores según una
+ * máscara" así que lo armamos con and/andnot/or.
+ * */
+__attribute__((target("sse2")))
+static size_t sanitize_sse2(char *data, size_t sz, char replacement) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i repl = _mm_set1_epi8(replacement);
+
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 16 <= sz; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i high = _mm_cmplt_epi8(v, zero);
+
+        uint32_t mask = _mm_movemask_epi8(high);
+        if (mask == 0)
+            continue;
+
+        v = _mm_or_si128(_mm_andnot_si128(high, v), _mm_and_si128(high, repl));
+        _mm_storeu_si128((__m128i*)(data + i), v);
+        n += __builtin_popcount(mask);
+    }
+
+    return n + sanitize_scalar(data + i, sz - i, replacement);
+}
+
+/*
+ * AVX2 si tiene esa instrucción (`blendv`): elige cada byte de `repl`
+ * o de `v` según el bit más significativo del byte de la máscara, que
+ * es justamente el mismo `v`.
+ * */
+__attribute__((target("avx2")))
+static size_t sanitize_avx2(char *data, size_t sz, char replacement) {
+    const __m256i repl = _mm256_set1_epi8(replacement);
+
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 32 <= sz; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+
+        uint32_t mask = _mm256_movemask_epi8(v);
+        if (mask == 0)
+            continue;
+
+        _mm256_storeu_si256((__m256i*)(data + i), _mm256_blendv_epi8(v, repl, v));
+        n += __builtin_popcount(mask);
+    }
+
+    return n + sanitize_sse2(data + i, sz - i, replacement);
+}
+#endif
+
+/*
+ * Las implementaciones elegidas. Se eligen una única vez, la primera
+ * vez que se usan (C++ garantiza que la inicialización de una variable
+ * `static` local ocurre una sola vez, aun con varios threads).
+ * */
+struct SimdScanImpl {
+    const char *name;
+    size_t (*find)(std::string_view, std::string_view, size_t);
+    size_t (*sanitize)(char*, size_t, char);
+};
+
+static const SimdScanImpl& impl() {
+    static const SimdScanImpl chosen = []() -> SimdScanImpl {
+#ifdef SIMD_SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return { "avx2", find_avx2, sanitize_avx2 };
+        if (__builtin_cpu_supports("sse2"))
+            return { "sse2", find_sse2, sanitize_sse2 };
+#endif
+        return { "scalar", find_scalar, sanitize_scalar };
+    }();
+
+    return chosen;
+}
+
+size_t simd_find(std::string_view data, std::string_view delim, size_t from) {
+    if (from > data.size())
+        return std::string_view::npos;
+    if (delim.empty())
+        return from;
+
+    return impl().find(data, delim, from);
+}
+
+size_t simd_sanitize_ascii(char *data, size_t sz, char replacement) {
+    return impl().sanitize(data, sz, replacement);
+}
+
+const char* simd_scan_impl() {
+    return impl().name;
+}
@@ -0,0 +1,48 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+#include <string_view>
+
+/*
+ * Búsqueda de delimitadores y saneamiento de bytes, vectorizados.
+ *
+ * Parsear HTTP es, sobre todo, buscar "\r\n" y mirar byte por byte.
+ * Con respuestas grandes esos loops se notan en el perfil.
+ *
+ * Las instrucciones SIMD (Single Instruction, Multiple Data) de x86
+ * comparan 16 (SSE2) o 32 (AVX2) bytes de una sola vez: en vez de
+ * preguntar "¿este byte es un '\r'?" preguntamos "¿cuales de estos
+ * 32 bytes son un '\r'?" y obtenemos una máscara de bits.
+ *
+ * No todos los procesadores tienen AVX2: compilamos las tres versiones
+ * (AVX2, SSE2 y una escalar, byte a byte) y elegimos la mejor *al
+ * ejecutar*, según lo que soporte la CPU (`__builtin_cpu_supports`).
+ * Así el binario corre en cualquier x86-64 sin compilar con `-mavx2`.
+ *
+ * En otras arquitecturas solo existe la versión escalar.
+ *
+ * Todas las funciones trabajan con largos explícitos: un byte 0 en el
+ * medio de los datos es un byte más.
+ * */
+
+/*
+ * Retorna la posición de la primera aparición de `delim` en `data`
+ * a partir de `from`, o `std::string_view::npos` si no esta.
+ *
+ * Es lo mismo que `data.find(delim, from)`.
+ * */
+size_t simd_find(std::string_view data, std::string_view delim, size_t from = 0);
+
+/*
+ * Reemplaza por `replacement` todos los bytes no-ASCII (mayores
+ * a 127) de `data[0, sz)`. Retorna cuantos reemplazo.
+ * */
+size_t simd_sanitize_ascii(char *data, size_t sz, char replacement);
+
+/*
+ * La implementación elegida: "avx2", "sse2" o "scalar".
+ * */
+const char* simd_scan_impl();
+
+#endif
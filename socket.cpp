@@ -8,18 +8,208 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 
 #include "socket.h"
 #include "resolver.h"
 #include "liberror.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <chrono>
+#include <deque>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 #define STREAM_SEND_CLOSED 0x01
 #define STREAM_RECV_CLOSED 0x02
 #define STREAM_BOTH_CLOSED 0x03
 #define STREAM_BOTH_OPEN 0x00
 
+static int64_t timespec_ns(const struct timespec& t) {
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/*
+ * El kernel marca los paquetes con `CLOCK_REALTIME`: para restar
+ * nuestras marcas con las suyas tenemos que usar el mismo reloj.
+ * */
+static int64_t realtime_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return timespec_ns(t);
+}
+
+const unsigned int SocketCounters::RECV_SIZE_BUCKETS;
+
+SocketCounters& SocketCounters::operator+=(const SocketCounters& other) {
+    bytes_sent += other.bytes_sent;
+    bytes_received += other.bytes_received;
+    send_calls += other.send_calls;
+    recv_calls += other.recv_calls;
+    short_sends += other.short_sends;
+    short_recvs += other.short_recvs;
+    send_would_block += other.send_would_block;
+    recv_would_block += other.recv_would_block;
+    epipe += other.epipe;
+    eof += other.eof;
+    send_errors += other.send_errors;
+    recv_errors += other.recv_errors;
+
+    for (unsigned int i = 0; i < RECV_SIZE_BUCKETS; ++i)
+        recv_sizes[i] += other.recv_sizes[i];
+
+    return *this;
+}
+
+void SocketCounters::print(std::ostream& out) const {
+    out << "sent " << bytes_sent << " bytes in " << send_calls << " calls"
+        << " (short " << short_sends
+        << ", would block " << send_would_block
+        << ", epipe " << epipe << ")\n"
+        << "recv " << bytes_received << " bytes in " << recv_calls << " calls"
+        << " (short " << short_recvs
+        << ", would block " << recv_would_block
+        << ", eof " << eof << ")\n"
+        << "errors " << send_errors << " sending, " << recv_errors << " receiving\n"
+        << "recv sizes:";
+
+    for (unsigned int i = 0; i < RECV_SIZE_BUCKETS; ++i)
+        if (recv_sizes[i])
+            out << " " << (1ull << i)
+                << (i == RECV_SIZE_BUCKETS - 1 ? "+" : "")
+                << ":" << recv_sizes[i];
+    out << "\n";
+}
+
+std::ostream& operator<<(std::ostream& out, const SocketCounters& c) {
+    c.print(out);
+    return out;
+}
+
+/*
+ * Los contadores de los sockets ya destruidos (véase
+ * `Socket::process_counters`). Solo se toma el mutex una vez por
+ * socket, al destruirlo, no en cada envío o recepción.
+ * */
+static std::mutex process_io_mtx;
+static SocketCounters process_io;
+
+static void add_to_process_counters(const SocketCounters& c) {
+    if (c.send_calls == 0 and c.recv_calls == 0)
+        return;
+
+    std::unique_lock<std::mutex> lock(process_io_mtx);
+    process_io += c;
+}
+
+static size_t iov_size(const struct iovec *iov, int iovcnt) {
+    size_t sz = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        sz += iov[i].iov_len;
+    return sz;
+}
+
+/*
+ * Estado del timestamping de un socket (véase `Socket::enable_timestamping`).
+ * */
+struct Socket::TimestampState {
+    /*
+     * Con `SOF_TIMESTAMPING_OPT_ID` en TCP el kernel identifica a cada
+     * envío por la posición de su último byte en el stream (contando
+     * desde que se habilito el timestamping). Llevamos la misma cuenta.
+     * */
+    uint32_t bytes_sent;
+    uint32_t last_id;
+    int64_t last_rx_ns;
+
+    /*
+     * Envíos aun no confirmados (en orden de id) y ya confirmados
+     * esperando a ser leídos con `Socket::take_tx_timestamps`.
+     *
+     * Ambas colas están acotadas: si nadie lee las marcas (o el kernel
+     * no las reporta) descartamos las más viejas.
+     * */
+    std::deque<TxTimestamps> pending;
+    std::deque<TxTimestamps> done;
+    static const size_t MAX_QUEUED = 4096;
+
+    SocketLatency latency;
+
+    TimestampState() : bytes_sent(0), last_id(0), last_rx_ns(0) {}
+
+    void sent(int s, int64_t t0) {
+        bytes_sent += s;
+        last_id = bytes_sent - 1;
+
+        pending.push_back({last_id, t0, 0, 0, 0});
+        if (pending.size() > MAX_QUEUED)
+            pending.pop_front();
+    }
+
+    void received(uint32_t type, uint32_t id, int64_t ns) {
+        auto it = pending.begin();
+        while (it != pending.end() and it->id != id)
+            ++it;
+
+        if (it == pending.end())
+            return;
+
+        /*
+         * Los envíos hechos sin marca de usuario (`sent_ns` 0, por
+         * ejemplo los de `Socket::sendfile`) no suman a los histogramas.
+         * */
+        int64_t since_sent = it->sent_ns ? ns - it->sent_ns : -1;
+        switch (type) {
+            case SCM_TSTAMP_SCHED:
+                it->sched_ns = ns;
+                if (since_sent >= 0)
+                    latency.tx_sched.record(since_sent);
+                return;
+
+            case SCM_TSTAMP_SND:
+                it->software_ns = ns;
+                if (since_sent >= 0)
+                    latency.tx_software.record(since_sent);
+                return;
+
+            case SCM_TSTAMP_ACK:
+                it->ack_ns = ns;
+                if (since_sent >= 0)
+                    latency.tx_ack.record(since_sent);
+                break;
+
+            default:
+                return;
+        }
+
+        /*
+         * Los ACKs de TCP son acumulativos: confirmado este envío,
+         * también lo están todos los anteriores.
+         * */
+        ++it;
+        done.insert(done.end(), pending.begin(), it);
+        pending.erase(pending.begin(), it);
+
+        while (done.size() > MAX_QUEUED)
+            done.pop_front();
+    }
+};
+
+const size_t Socket::TimestampState::MAX_QUEUED;
+
 Socket::Socket(
         const char *hostname,
         const char *servname) {
@@ -29,6 +219,9 @@ Socket::Socket(
     int skt = -1;
     this->closed = true;
     this->stream_status = STREAM_BOTH_CLOSED;
+    this->nonblocking = false;
+    this->zc_enabled = false;
+    this->zc_next = this->zc_done = 0;
 
     /*
      * Por cada dirección obtenida tenemos que ver cual es realmente funcional.
@@ -101,20 +294,274 @@ Socket::Socket(
             (servname ? servname : ""));
 }
 
-Socket::Socket(const char *servname) {
+/*
+ * Aplica a `skt` las opciones de `opts` que tengan valor.
+ *
+ * Retorna `nullptr` si pudo aplicarlas todas o el nombre de la opción
+ * que fallo (con `errno` seteado): los constructores no siempre quieren
+ * lanzar una excepción ante un error (véase `Socket::apply`).
+ * */
+static const char* set_socket_options(int skt, const SocketOptions& opts) {
+    struct Option {
+        const char *name;
+        int level;
+        int optname;
+        std::optional<int> value;
+    };
+
+    /*
+     * El orden importa: `SO_KEEPALIVE` antes que sus parámetros.
+     * */
+    const Option table[] = {
+        { "TCP_NODELAY", IPPROTO_TCP, TCP_NODELAY, opts.nodelay },
+        { "TCP_CORK", IPPROTO_TCP, TCP_CORK, opts.cork },
+        { "TCP_QUICKACK", IPPROTO_TCP, TCP_QUICKACK, opts.quickack },
+        { "SO_SNDBUF", SOL_SOCKET, SO_SNDBUF, opts.sndbuf },
+        { "SO_RCVBUF", SOL_SOCKET, SO_RCVBUF, opts.rcvbuf },
+        { "TCP_NOTSENT_LOWAT", IPPROTO_TCP, TCP_NOTSENT_LOWAT, opts.notsent_lowat },
+        { "SO_KEEPALIVE", SOL_SOCKET, SO_KEEPALIVE, opts.keepalive },
+        { "TCP_KEEPIDLE", IPPROTO_TCP, TCP_KEEPIDLE, opts.keepidle_secs },
+        { "TCP_KEEPINTVL", IPPROTO_TCP, TCP_KEEPINTVL, opts.keepintvl_secs },
+        { "TCP_KEEPCNT", IPPROTO_TCP, TCP_KEEPCNT, opts.keepcnt },
+        { "SO_PRIORITY", SOL_SOCKET, SO_PRIORITY, opts.priority },
+    };
+
+    for (const auto& opt : table) {
+        if (not opt.value)
+            continue;
+
+        int optval = *opt.value;
+        if (setsockopt(skt, opt.level, opt.optname, &optval, sizeof(optval)) == -1)
+            return opt.name;
+    }
+
+    return nullptr;
+}
+
+/*
+ * Intercala las direcciones por familia (IPv6, IPv4, IPv6, IPv4, ...)
+ * empezando por la familia de la primera dirección, tal como recomienda
+ * el RFC 8305: si una familia entera esta "rota" (muy común con IPv6)
+ * no tendremos que esperar a que fallen *todas* sus direcciones antes
+ * de probar con la otra.
+ * */
+static std::vector<struct addrinfo*> interleave_families(Resolver& resolver) {
+    std::vector<struct addrinfo*> first;
+    std::vector<struct addrinfo*> second;
+
+    while (resolver.has_next()) {
+        struct addrinfo *addr = resolver.next();
+        if (first.empty() or first[0]->ai_family == addr->ai_family)
+            first.push_back(addr);
+        else
+            second.push_back(addr);
+    }
+
+    std::vector<struct addrinfo*> addrs;
+    for (size_t i = 0; i < first.size() or i < second.size(); ++i) {
+        if (i < first.size())
+            addrs.push_back(first[i]);
+        if (i < second.size())
+            addrs.push_back(second[i]);
+    }
+
+    return addrs;
+}
+
+Socket::Socket(
+        const char *hostname,
+        const char *servname,
+        const ConnectOptions& opts) {
+    typedef std::chrono::steady_clock Clock;
+
+    Resolver resolver(hostname, servname, false, opts.family);
+    std::vector<struct addrinfo*> addrs = interleave_families(resolver);
+
+    this->closed = true;
+    this->stream_status = STREAM_BOTH_CLOSED;
+    this->nonblocking = false;
+    this->zc_enabled = false;
+    this->zc_next = this->zc_done = 0;
+
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::milliseconds(opts.timeout_ms);
+    const auto delay = std::chrono::milliseconds(opts.attempt_delay_ms);
+
+    /*
+     * Intentos de conexión "en vuelo": un `pollfd` por cada uno.
+     * */
+    std::vector<struct pollfd> inflight;
+    size_t next = 0;
+    auto next_attempt = start;
+    int saved_errno = ETIMEDOUT;
+
+    while (true) {
+        auto now = Clock::now();
+        if (opts.timeout_ms >= 0 and now >= deadline) {
+            saved_errno = ETIMEDOUT;
+            break;
+        }
+
+        /*
+         * Es hora de lanzar el próximo intento?
+         * */
+        if (next < addrs.size() and now >= next_attempt) {
+            struct addrinfo *addr = addrs[next++];
+            next_attempt = now + delay;
+
+            int skt = socket(addr->ai_family,
+                    addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    addr->ai_protocol);
+            if (skt == -1) {
+                saved_errno = errno;
+                next_attempt = now;
+                continue;
+            }
+
+            /*
+             * Una opción invalida es un error de configuración, no
+             * de conexión: no tiene sentido seguir intentando.
+             * */
+            const char *failed = set_socket_options(skt, opts.tuning);
+            if (failed) {
+                saved_errno = errno;
+                ::close(skt);
+                for (auto& pfd : inflight)
+                    ::close(pfd.fd);
+                throw LibError(saved_errno, "socket setsockopt(%s) failed", failed);
+            }
+
+            /*
+             * En modo no-bloqueante `connect` retorna inmediatamente
+             * con `EINPROGRESS`: el handshake sigue en el kernel y
+             * nos enteraremos del resultado cuando el socket este
+             * listo para escritura (`POLLOUT`).
+             * */
+            int s = connect(skt, addr->ai_addr, addr->ai_addrlen);
+            if (s == 0) {
+                inflight.push_back({skt, POLLOUT, POLLOUT});
+            } else if (errno == EINPROGRESS) {
+                inflight.push_back({skt, POLLOUT, 0});
+            } else {
+                /*
+                 * Fallo inmediato: no tiene sentido esperar para
+                 * lanzar el siguiente intento.
+                 * */
+                saved_errno = errno;
+                ::close(skt);
+                next_attempt = now;
+                continue;
+            }
+        }
+
+        if (inflight.empty()) {
+            if (next >= addrs.size())
+                break;
+            continue;
+        }
+
+        /*
+         * Esperamos a que algún intento termine pero no más allá
+         * del próximo intento a lanzar ni de la deadline.
+         * */
+        int wait_ms = -1;
+        if (next < addrs.size())
+            wait_ms = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                    next_attempt - now).count());
+        if (opts.timeout_ms >= 0) {
+            int left_ms = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - now).count());
+            if (wait_ms < 0 or left_ms < wait_ms)
+                wait_ms = left_ms;
+        }
+
+        bool ready = false;
+        for (auto& pfd : inflight)
+            ready = ready or pfd.revents;
+
+        if (not ready) {
+            int s = poll(inflight.data(), inflight.size(), wait_ms);
+            if (s == -1 and errno != EINTR)
+                throw LibError(errno, "socket poll failed");
+        }
+
+        for (size_t i = 0; i < inflight.size(); ) {
+            if (inflight[i].revents == 0) {
+                ++i;
+                continue;
+            }
+
+            /*
+             * El intento termino; `SO_ERROR` nos dice si fue exitoso.
+             * */
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(inflight[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+                err = errno;
+
+            if (err == 0) {
+                /*
+                 * Conexión exitosa! Cerramos los demás intentos.
+                 * */
+                for (size_t j = 0; j < inflight.size(); ++j)
+                    if (j != i)
+                        ::close(inflight[j].fd);
+
+                this->closed = false;
+                this->stream_status = STREAM_BOTH_OPEN;
+                this->skt = inflight[i].fd;
+                this->nonblocking = true;
+                set_nonblocking(false);
+                return;
+            }
+
+            saved_errno = err;
+            ::close(inflight[i].fd);
+            inflight.erase(inflight.begin() + i);
+
+            /*
+             * Un intento fallo: lanzamos el siguiente ya.
+             * */
+            next_attempt = Clock::now();
+        }
+    }
+
+    for (auto& pfd : inflight)
+        ::close(pfd.fd);
+
+    throw LibError(
+            saved_errno,
+            "socket construction failed (connect to %s:%s)",
+            (hostname ? hostname : ""),
+            (servname ? servname : ""));
+}
+
+Socket::Socket(const char *servname) : Socket(servname, ListenerOptions()) {}
+
+Socket::Socket(const char *servname, const ListenerOptions& opts) {
     Resolver resolver(nullptr, servname, true);
 
     int s = -1;
     int skt = -1;
     this->closed = true;
     this->stream_status = STREAM_BOTH_CLOSED;
+    this->nonblocking = false;
+    this->zc_enabled = false;
+    this->zc_next = this->zc_done = 0;
     while (resolver.has_next()) {
         struct addrinfo *addr = resolver.next();
 
         if (skt != -1)
             ::close(skt);
 
-        skt = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        /*
+         * Si se pidió, el socket nace no-bloqueante (`SOCK_NONBLOCK`): así
+         * no hay un `fcntl` luego que pueda fallar con el socket ya creado.
+         * */
+        skt = socket(
+                addr->ai_family,
+                addr->ai_socktype | (opts.nonblocking ? SOCK_NONBLOCK : 0),
+                addr->ai_protocol);
         if (skt == -1) {
             continue;
         }
@@ -156,6 +603,22 @@ Socket::Socket(const char *servname) {
             continue;
         }
 
+        /*
+         * `SO_REUSEPORT` va más allá que `SO_REUSEADDR`: permite que
+         * varios sockets *activos* hagan `bind` en el mismo puerto.
+         *
+         * Cada uno tiene su propia cola de conexiones pendientes y el kernel
+         * distribuye las conexiones nuevas entre ellos (por un hash
+         * de las direcciones). Así N threads pueden aceptar conexiones
+         * en paralelo sin pelearse por un único socket.
+         * */
+        if (opts.reuse_port) {
+            s = setsockopt(skt, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+            if (s == -1) {
+                continue;
+            }
+        }
+
         /*
          * Hacemos le bind: enlazamos el socket a una dirección local.
          * A diferencia de lo que hacemos en `Socket::init_for_connection`
@@ -172,12 +635,57 @@ Socket::Socket(const char *servname) {
         }
 
         /*
-         * Ponemos el socket a escuchar. Ese 20 (podría ser otro valor)
-         * indica cuantas conexiones a la espera de ser aceptadas se toleraran
+         * Con `TCP_DEFER_ACCEPT` el kernel completa el handshake pero
+         * no pone la conexión en la cola de `accept` hasta que lleguen
+         * datos: un servidor como el nuestro no tiene nada que hacer
+         * con una conexión que aun no envío nada.
+         * */
+        if (opts.defer_accept_secs > 0) {
+            s = setsockopt(skt, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                    &opts.defer_accept_secs, sizeof(opts.defer_accept_secs));
+            if (s == -1) {
+                continue;
+            }
+        }
+
+        /*
+         * TCP Fast Open le permite a un cliente que ya se conecto antes
+         * enviar datos en el mismo SYN, ahorrándose un round trip.
+         * El valor es el largo de la cola de estas conexiones
+         * (debe configurarse antes del `listen`).
+         * */
+        if (opts.fastopen_qlen > 0) {
+            s = setsockopt(skt, IPPROTO_TCP, TCP_FASTOPEN,
+                    &opts.fastopen_qlen, sizeof(opts.fastopen_qlen));
+            if (s == -1) {
+                continue;
+            }
+        }
+
+        /*
+         * Como al conectarnos: una opción invalida es un error de
+         * configuración (no de esta dirección) así que no tiene sentido
+         * probar con la siguiente y el error dice cual opción fallo.
+         * */
+        const char *failed = set_socket_options(skt, opts.tuning);
+        if (failed) {
+            int saved_errno = errno;
+            ::close(skt);
+            throw LibError(
+                    saved_errno,
+                    "socket setsockopt(%s) failed (listen on %s)",
+                    failed,
+                    (servname ? servname : ""));
+        }
+
+        /*
+         * Ponemos el socket a escuchar. El backlog (20 por default, podría
+         * ser otro valor) indica cuantas conexiones a la espera de ser
+         * aceptadas se toleraran
          *
          * No tiene nada q ver con cuantas conexiones totales el server tendrá.
          * */
-        s = listen(skt, 20);
+        s = listen(skt, opts.backlog);
         if (s == -1) {
             continue;
         }
@@ -187,6 +695,7 @@ Socket::Socket(const char *servname) {
          * */
         this->closed = false;
         this->stream_status = STREAM_BOTH_OPEN;
+        this->nonblocking = opts.nonblocking;
         this->skt = skt;
         return;
     }
@@ -202,11 +711,119 @@ Socket::Socket(const char *servname) {
             (servname ? servname : ""));
 }
 
+/*
+ * Arma la `sockaddr_un` de `addr` y retorna su largo.
+ *
+ * Un nombre abstracto empieza con un byte nulo y su largo es el
+ * del `addrlen`, no hasta el primer nulo: por eso hay que calcularlo.
+ * */
+static socklen_t unix_sockaddr(const UnixAddress& addr, struct sockaddr_un& sun) {
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+
+    const size_t offset = addr.is_abstract ? 1 : 0;
+    if (addr.name.empty() or addr.name.size() + offset >= sizeof(sun.sun_path))
+        throw LibError(ENAMETOOLONG, "invalid unix socket name '%s'", addr.name.c_str());
+
+    memcpy(sun.sun_path + offset, addr.name.data(), addr.name.size());
+    return offsetof(struct sockaddr_un, sun_path) + offset + addr.name.size()
+        + (addr.is_abstract ? 0 : 1);
+}
+
+Socket::Socket(const UnixAddress& peer) {
+    /*
+     * Como en los constructores TCP: hasta tener el socket conectado
+     * el objeto esta cerrado.
+     * */
+    this->skt = -1;
+    this->closed = true;
+    this->stream_status = STREAM_BOTH_CLOSED;
+    this->nonblocking = false;
+    this->zc_enabled = false;
+    this->zc_next = this->zc_done = 0;
+
+    struct sockaddr_un sun;
+    socklen_t len = unix_sockaddr(peer, sun);
+
+    int skt = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (skt == -1)
+        throw LibError(errno, "unix socket construction failed");
+
+    if (connect(skt, (struct sockaddr*)&sun, len) == -1) {
+        int saved_errno = errno;
+        ::close(skt);
+        throw LibError(
+                saved_errno,
+                "unix socket construction failed (connect to %s%s)",
+                (peer.is_abstract ? "@" : ""),
+                peer.name.c_str());
+    }
+
+    this->closed = false;
+    this->stream_status = STREAM_BOTH_OPEN;
+    this->skt = skt;
+}
+
+Socket::Socket(const UnixAddress& local, const ListenerOptions& opts) {
+    this->skt = -1;
+    this->closed = true;
+    this->stream_status = STREAM_BOTH_CLOSED;
+    this->nonblocking = false;
+    this->zc_enabled = false;
+    this->zc_next = this->zc_done = 0;
+
+    struct sockaddr_un sun;
+    socklen_t len = unix_sockaddr(local, sun);
+
+    int skt = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | (opts.nonblocking ? SOCK_NONBLOCK : 0), 0);
+    if (skt == -1)
+        throw LibError(errno, "unix socket construction failed");
+
+    /*
+     * Si quedo el archivo de un socket anterior el `bind` fallaría
+     * con `EADDRINUSE`. Solo lo borramos si *es* un socket: no queremos
+     * borrar un archivo cualquiera por un error en el nombre.
+     * */
+    struct stat st;
+    if (not local.is_abstract and stat(local.name.c_str(), &st) == 0 and S_ISSOCK(st.st_mode))
+        unlink(local.name.c_str());
+
+    if (bind(skt, (struct sockaddr*)&sun, len) == -1 or listen(skt, opts.backlog) == -1) {
+        int saved_errno = errno;
+        ::close(skt);
+        throw LibError(
+                saved_errno,
+                "unix socket construction failed (listen on %s%s)",
+                (local.is_abstract ? "@" : ""),
+                local.name.c_str());
+    }
+
+    this->closed = false;
+    this->stream_status = STREAM_BOTH_OPEN;
+    this->nonblocking = opts.nonblocking;
+    this->skt = skt;
+}
+
+std::pair<Socket, Socket> Socket::pair() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+        throw LibError(errno, "socketpair failed");
+
+    return std::pair<Socket, Socket>(Socket(fds[0]), Socket(fds[1]));
+}
+
 Socket::Socket(Socket&& other) {
     /* Nos copiamos del otro socket... */
     this->skt = other.skt;
     this->closed = other.closed;
-    this->stream_status = other.stream_status;
+    this->stream_status = other.stream_status.load();
+    this->nonblocking = other.nonblocking;
+    this->zc_enabled = other.zc_enabled;
+    this->zc_next = other.zc_next;
+    this->zc_done = other.zc_done;
+    this->zc_pending = std::move(other.zc_pending);
+    this->ts = std::move(other.ts);
+    this->io = std::exchange(other.io, SocketCounters());
 
     /* ...pero luego le sacamos al otro socket
      * el ownership del recurso.
@@ -222,6 +839,10 @@ Socket::Socket(Socket&& other) {
     other.skt = -1;
     other.closed = true;
     other.stream_status = STREAM_BOTH_CLOSED;
+    other.nonblocking = false;
+    other.zc_enabled = false;
+    other.zc_next = other.zc_done = 0;
+    other.zc_pending.clear();
 }
 
 Socket& Socket::operator=(Socket&& other) {
@@ -241,14 +862,26 @@ Socket& Socket::operator=(Socket&& other) {
         ::shutdown(this->skt, 2);
         ::close(this->skt);
     }
+    add_to_process_counters(this->io);
 
     /* Ahora hacemos los mismos pasos que en el move constructor */
     this->skt = other.skt;
     this->closed = other.closed;
-    this->stream_status = other.stream_status;
+    this->stream_status = other.stream_status.load();
+    this->nonblocking = other.nonblocking;
+    this->zc_enabled = other.zc_enabled;
+    this->zc_next = other.zc_next;
+    this->zc_done = other.zc_done;
+    this->zc_pending = std::move(other.zc_pending);
+    this->ts = std::move(other.ts);
+    this->io = std::exchange(other.io, SocketCounters());
     other.skt = -1;
     other.closed = true;
     other.stream_status = STREAM_BOTH_CLOSED;
+    other.nonblocking = false;
+    other.zc_enabled = false;
+    other.zc_next = other.zc_done = 0;
+    other.zc_pending.clear();
 
     return *this;
 }
@@ -258,7 +891,7 @@ int Socket::recvsome(
         unsigned int sz
     ) {
     chk_skt_or_fail();
-    int s = recv(this->skt, (char*)data, sz, 0);
+    int s = recv_fd(data, sz);
     if (s == 0) {
         /*
          * Puede ser o no un error, dependerá del protocolo.
@@ -269,6 +902,13 @@ int Socket::recvsome(
         stream_status |= STREAM_RECV_CLOSED;
         return 0;
     } else if (s == -1) {
+        /*
+         * En modo no-bloqueante, `EAGAIN`/`EWOULDBLOCK` no es un error:
+         * simplemente no hay nada para recibir *ahora*.
+         * */
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+
         /*
          * 99% casi seguro que es un error real
          * */
@@ -280,7 +920,8 @@ int Socket::recvsome(
 
 int Socket::sendsome(
         const void *data,
-        unsigned int sz
+        unsigned int sz,
+        bool more
     ) {
     chk_skt_or_fail();
     /*
@@ -300,7 +941,9 @@ int Socket::sendsome(
      * Esta en nosotros luego hace el chequeo correspondiente
      * (ver más abajo).
      * */
-    int s = send(this->skt, (char*)data, sz, MSG_NOSIGNAL);
+    int64_t t0 = ts_now();
+    int s = send(this->skt, (char*)data, sz, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    on_sent(s, sz, t0);
     if (s == -1) {
         /*
          * Este es un caso especial: cuando enviamos algo pero en el medio
@@ -317,6 +960,13 @@ int Socket::sendsome(
             return 0;
         }
 
+        /*
+         * El buffer de envío del sistema operativo esta lleno.
+         * (véase el comentario en `Socket::recvsome`)
+         * */
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+
         /* En cualquier otro caso supondremos un error
          * y lanzamos una excepción.
          * */
@@ -332,6 +982,70 @@ int Socket::sendsome(
     }
 }
 
+IOResult Socket::try_recvsome(
+        void *data,
+        unsigned int sz
+    ) noexcept {
+    if (skt == -1)
+        return {-1, EBADF};
+
+    /*
+     * Véase `Socket::recvsome`: es lo mismo pero sin excepciones.
+     * */
+    int s = recv_fd(data, sz);
+    if (s == -1)
+        return {-1, errno};
+
+    if (s == 0)
+        stream_status |= STREAM_RECV_CLOSED;
+
+    return {s, 0};
+}
+
+int Socket::peek_nonblocking(
+        void *data,
+        unsigned int sz
+    ) {
+    chk_skt_or_fail();
+
+    ssize_t s = recv(this->skt, (char*)data, sz, MSG_PEEK | MSG_DONTWAIT);
+    if (s == -1) {
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+        throw LibError(errno, "socket recv (peek) failed");
+    }
+
+    return s;
+}
+
+IOResult Socket::try_sendsome(
+        const void *data,
+        unsigned int sz,
+        bool more
+    ) noexcept {
+    if (skt == -1)
+        return {-1, EBADF};
+
+    /*
+     * Véase `Socket::sendsome`: es lo mismo pero sin excepciones.
+     * */
+    int64_t t0 = ts_now();
+    int s = send(this->skt, (char*)data, sz, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    on_sent(s, sz, t0);
+    if (s == -1) {
+        if (errno == EPIPE) {
+            stream_status |= STREAM_SEND_CLOSED;
+            return {0, EPIPE};
+        }
+        return {-1, errno};
+    }
+
+    if (s == 0)
+        stream_status |= STREAM_SEND_CLOSED;
+
+    return {s, 0};
+}
+
 int Socket::recvall(
         void *data,
         unsigned int sz
@@ -343,7 +1057,17 @@ int Socket::recvall(
                 (char*)data + received,
                 sz - received);
 
-        if (s <= 0) {
+        if (s == WOULD_BLOCK) {
+            /*
+             * Socket en modo no-bloqueante: no podemos esperar a que
+             * lleguen los bytes que faltan sin bloquearnos.
+             * */
+            throw LibError(
+                    EAGAIN,
+                    "socket received only %d of %d bytes (non-blocking)",
+                    received,
+                    sz);
+        } else if (s <= 0) {
             /*
              * Si el socket fue cerrado (`s == 0`) o hubo un error
              * `Socket::recvsome` ya debería haber seteado `stream_status`
@@ -378,17 +1102,25 @@ int Socket::recvall(
 
 int Socket::sendall(
         const void *data,
-        unsigned int sz
+        unsigned int sz,
+        bool more
     ) {
     unsigned int sent = 0;
 
     while (sent < sz) {
         int s = sendsome(
                 (char*)data + sent,
-                sz - sent);
+                sz - sent,
+                more);
 
         /* Véase los comentarios de `Socket::recvall` */
-        if (s <= 0) {
+        if (s == WOULD_BLOCK) {
+            throw LibError(
+                    EAGAIN,
+                    "socket sent only %d of %d bytes (non-blocking)",
+                    sent,
+                    sz);
+        } else if (s <= 0) {
             assert(s == 0);
             if (sent)
                 throw LibError(
@@ -406,38 +1138,1131 @@ int Socket::sendall(
     return sz;
 }
 
-Socket::Socket(int skt) {
-    this->skt = skt;
-    this->closed = false;
-    this->stream_status = STREAM_BOTH_OPEN;
-}
-
-Socket Socket::accept() {
+int Socket::sendv(
+        const struct iovec *iov,
+        int iovcnt
+    ) {
     chk_skt_or_fail();
+
     /*
-     * `accept` nos bloqueara hasta que algún cliente se conecte a nosotros
-     * y la conexión se establezca.
-     *
-     * Una vez que eso suceda, `accept` retornara el file descriptor
-     * de un *nuevo* socket (`peer_skt`) que representara a la
-     * conexión establecida con *ese* cliente.
-     *
-     * En todo momento podemos seguir usando *nuestro* file descriptor
-     * (`this->skt`) para seguir haciendo más llamadas a `accept`
-     * independientemente de que enviemos/recibamos del socket `peer`.
+     * `writev` seria lo más directo pero no acepta `MSG_NOSIGNAL`
+     * (véase `Socket::sendsome`). `sendmsg` hace lo mismo y si lo acepta.
      * */
-    int peer_skt = ::accept(this->skt, nullptr, nullptr);
-    if (peer_skt == -1)
-        throw LibError(errno, "socket accept failed");
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
 
     /*
-     * `peer_skt` es un file descriptor crudo y no queremos
-     * que nuestro cliente manipule recursos crudos sino que
-     * los use a través de un TDA.
-     *
-     * Por eso creamos un `Socket` y lo pasamos por movimiento
+     * Sin nada para enviar ni hacemos la syscall: así un 0 de `sendmsg`
+     * significa lo mismo que en `Socket::sendsome`.
      * */
-    return Socket(peer_skt);
+    size_t total = iov_size(iov, iovcnt);
+    if (total == 0)
+        return 0;
+
+    int64_t t0 = ts_now();
+    int s = sendmsg(this->skt, &msg, MSG_NOSIGNAL);
+    on_sent(s, total, t0);
+    if (s == -1) {
+        /* Véase los comentarios de `Socket::sendsome` */
+        if (errno == EPIPE) {
+            stream_status |= STREAM_SEND_CLOSED;
+            return 0;
+        }
+
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+
+        throw LibError(errno, "socket sendmsg failed");
+    } else if (s == 0) {
+        /*
+         * Jamas debería pasar (véase `Socket::sendsome`).
+         * */
+        stream_status |= STREAM_SEND_CLOSED;
+        return 0;
+    } else {
+        return s;
+    }
+}
+
+int Socket::send_sockets(
+        const void *data,
+        unsigned int sz,
+        const std::vector<Socket*>& skts
+    ) {
+    chk_skt_or_fail();
+
+    /*
+     * En un socket stream los file descriptors "viajan" pegados
+     * a los datos: hay que enviar al menos 1 byte.
+     * */
+    if (sz == 0)
+        throw std::invalid_argument("send_sockets requires at least 1 byte of data");
+
+    struct iovec iov = {const_cast<void*>(data), sz};
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    /*
+     * Los file descriptors van en un mensaje de control (`cmsg`)
+     * de tipo `SCM_RIGHTS`. El buffer debe estar alineado como
+     * un `struct cmsghdr`: por eso es un vector de ellos.
+     * */
+    std::vector<struct cmsghdr> control;
+    if (not skts.empty()) {
+        const size_t fds_sz = skts.size() * sizeof(int);
+        control.resize(CMSG_SPACE(fds_sz) / sizeof(struct cmsghdr) + 1);
+
+        msg.msg_control = control.data();
+        msg.msg_controllen = CMSG_SPACE(fds_sz);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fds_sz);
+
+        int *fds = (int*)CMSG_DATA(cmsg);
+        for (size_t i = 0; i < skts.size(); ++i) {
+            skts[i]->chk_skt_or_fail();
+            fds[i] = skts[i]->skt;
+        }
+    }
+
+    /*
+     * Es un envío más: lo contamos como tal (así los ids de las marcas
+     * de tiempo siguen coincidiendo con los bytes enviados).
+     * */
+    int64_t t0 = ts_now();
+    int s = sendmsg(this->skt, &msg, MSG_NOSIGNAL);
+    on_sent(s, sz, t0);
+    if (s == -1) {
+        /* Véase los comentarios de `Socket::sendsome` */
+        if (errno == EPIPE) {
+            stream_status |= STREAM_SEND_CLOSED;
+            return 0;
+        }
+
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+
+        throw LibError(errno, "socket sendmsg(SCM_RIGHTS) failed");
+    }
+
+    return s;
+}
+
+int Socket::recv_sockets(
+        void *data,
+        unsigned int sz,
+        std::vector<Socket>& skts,
+        unsigned int max_sockets
+    ) {
+    chk_skt_or_fail();
+
+    struct iovec iov = {data, sz};
+
+    std::vector<struct cmsghdr> control(
+            CMSG_SPACE(max_sockets * sizeof(int)) / sizeof(struct cmsghdr) + 1);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = CMSG_SPACE(max_sockets * sizeof(int));
+
+    /*
+     * `MSG_CMSG_CLOEXEC`: los file descriptors recibidos nacen con
+     * `FD_CLOEXEC`, como todos los que crea `Socket`.
+     * */
+    int s = recvmsg(this->skt, &msg, MSG_CMSG_CLOEXEC);
+    on_received(s, sz);
+    if (s == -1) {
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+
+        throw LibError(errno, "socket recvmsg(SCM_RIGHTS) failed");
+    }
+
+    if (s == 0)
+        stream_status |= STREAM_RECV_CLOSED;
+
+    /*
+     * Tomamos posesión de todos los file descriptors recibidos *antes*
+     * de chequear errores: así, si lanzamos una excepción, se cierran
+     * y no quedan "perdidos".
+     * */
+    std::vector<Socket> received;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET or cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        const int *fds = (const int*)CMSG_DATA(cmsg);
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; ++i) {
+            Socket peer(fds[i]);
+
+            /*
+             * El modo no-bloqueante es del file descriptor "compartido":
+             * si quien lo envío lo tenia no-bloqueante, sigue así.
+             * */
+            int flags = fcntl(fds[i], F_GETFL);
+            peer.nonblocking = flags != -1 and (flags & O_NONBLOCK);
+            received.push_back(std::move(peer));
+        }
+    }
+
+    /*
+     * Si llegaron más file descriptors de los que entraban en nuestro
+     * buffer el kernel descarta (cierra) el resto: no podemos saber
+     * cuales se perdieron así que lo tratamos como un error.
+     * */
+    if (msg.msg_flags & MSG_CTRUNC)
+        throw LibError(EMSGSIZE, "socket received more than %u sockets", max_sockets);
+
+    for (auto& peer : received)
+        skts.push_back(std::move(peer));
+
+    return s;
+}
+
+int Socket::recvv(
+        const struct iovec *iov,
+        int iovcnt
+    ) {
+    chk_skt_or_fail();
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+
+    int s = recvmsg(this->skt, &msg, 0);
+    on_received(s, iov_size(iov, iovcnt));
+    if (s == 0) {
+        /* Véase los comentarios de `Socket::recvsome` */
+        stream_status |= STREAM_RECV_CLOSED;
+        return 0;
+    } else if (s == -1) {
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+
+        throw LibError(errno, "socket recvmsg failed");
+    } else {
+        return s;
+    }
+}
+
+/*
+ * A diferencia de `send`, `sendfile` no acepta `MSG_NOSIGNAL` y un
+ * broken pipe nos enviaría la señal `SIGPIPE` (véase `Socket::sendsome`).
+ *
+ * Lo que podemos hacer es bloquear la señal en este thread mientras
+ * dura la llamada y, si llego a generarse, "consumirla" con `sigtimedwait`
+ * antes de desbloquearla.
+ * */
+class SigPipeBlocker {
+    private:
+    sigset_t pipe_set;
+    sigset_t old_set;
+
+    public:
+    SigPipeBlocker() {
+        sigemptyset(&pipe_set);
+        sigaddset(&pipe_set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    }
+
+    void consume_pending() {
+        struct timespec zero = {0, 0};
+        while (sigtimedwait(&pipe_set, nullptr, &zero) == SIGPIPE) {}
+    }
+
+    ~SigPipeBlocker() {
+        pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    }
+};
+
+size_t Socket::sendfile(
+        int fd,
+        off_t offset,
+        size_t len
+    ) {
+    chk_skt_or_fail();
+    size_t sent = 0;
+
+    SigPipeBlocker blocker;
+    while (sent < len) {
+        /*
+         * `::sendfile` avanza `offset` por nosotros.
+         * */
+        ssize_t s = ::sendfile(this->skt, fd, &offset, len - sent);
+        on_sent(s, len - sent, 0);
+        if (s == -1) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN or errno == EWOULDBLOCK)
+                throw LibError(
+                        EAGAIN,
+                        "socket sendfile sent only %zu of %zu bytes (non-blocking)",
+                        sent,
+                        len);
+
+            if (errno != EPIPE)
+                throw LibError(errno, "socket sendfile failed");
+
+            blocker.consume_pending();
+            stream_status |= STREAM_SEND_CLOSED;
+            s = 0;
+        }
+
+        if (s == 0) {
+            /*
+             * Cerraron la conexión o el archivo es más corto
+             * de lo esperado.
+             * */
+            if (sent)
+                throw LibError(
+                        EPIPE,
+                        "socket sendfile sent only %zu of %zu bytes",
+                        sent,
+                        len);
+            else
+                return 0;
+        }
+
+        sent += s;
+    }
+
+    return len;
+}
+
+/*
+ * Un pipe con RAII para que se cierre aun si hay una excepción.
+ * */
+class Pipe {
+    public:
+    int rd;
+    int wr;
+
+    Pipe() {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1)
+            throw LibError(errno, "pipe2 failed");
+        rd = fds[0];
+        wr = fds[1];
+    }
+
+    Pipe(const Pipe&) = delete;
+    Pipe& operator=(const Pipe&) = delete;
+
+    ~Pipe() {
+        ::close(rd);
+        ::close(wr);
+    }
+};
+
+size_t Socket::recvfile(
+        int fd,
+        off_t offset,
+        size_t len
+    ) {
+    chk_skt_or_fail();
+    size_t received = 0;
+
+    Pipe pipe;
+    while (received < len) {
+        /*
+         * socket -> pipe. Un pipe tiene capacidad limitada (64KB por
+         * default) así que movemos de a pedazos.
+         * */
+        size_t chunk = len - received;
+        if (chunk > 65536)
+            chunk = 65536;
+
+        ssize_t s = splice(this->skt, nullptr, pipe.wr, nullptr, chunk,
+                SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (s == -1) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN or errno == EWOULDBLOCK)
+                throw LibError(
+                        EAGAIN,
+                        "socket recvfile received only %zu of %zu bytes (non-blocking)",
+                        received,
+                        len);
+
+            throw LibError(errno, "socket splice (socket to pipe) failed");
+        }
+
+        if (s == 0) {
+            /* Véase los comentarios de `Socket::recvall` */
+            stream_status |= STREAM_RECV_CLOSED;
+            if (received)
+                throw LibError(
+                        EPIPE,
+                        "socket recvfile received only %zu of %zu bytes",
+                        received,
+                        len);
+            else
+                return 0;
+        }
+
+        /*
+         * pipe -> archivo. Lo que entro al pipe tiene que salir
+         * completamente antes de volver a leer del socket.
+         * */
+        ssize_t in_pipe = s;
+        while (in_pipe > 0) {
+            ssize_t w = splice(pipe.rd, nullptr, fd, &offset, in_pipe, SPLICE_F_MOVE);
+            if (w == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw LibError(errno, "socket splice (pipe to file) failed");
+            }
+
+            /*
+             * El archivo no acepto nada (típicamente se lleno el disco):
+             * volver a intentar daría lo mismo, para siempre.
+             * */
+            if (w == 0)
+                throw LibError(
+                        ENOSPC,
+                        "socket recvfile wrote only %zu of %zu bytes to the file",
+                        received + (s - in_pipe),
+                        len);
+
+            in_pipe -= w;
+        }
+
+        received += s;
+    }
+
+    return len;
+}
+
+void Socket::enable_zerocopy() {
+    chk_skt_or_fail();
+    int optval = 1;
+    if (setsockopt(this->skt, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval)) == -1) {
+        /*
+         * Kernel viejo o tipo de socket sin soporte: no es un error,
+         * simplemente seguiremos copiando.
+         * */
+        if (errno == ENOPROTOOPT or errno == EOPNOTSUPP or errno == EINVAL)
+            return;
+        throw LibError(errno, "socket setsockopt(SO_ZEROCOPY) failed");
+    }
+
+    this->zc_enabled = true;
+}
+
+bool Socket::is_zerocopy_enabled() const {
+    return this->zc_enabled;
+}
+
+int Socket::sendsome_zerocopy(
+        const void *data,
+        unsigned int sz,
+        uint32_t *id
+    ) {
+    chk_skt_or_fail();
+
+    /*
+     * Un envío que no usa zero-copy (porque esta deshabilitado o
+     * porque el mensaje es chico) no consume un id del kernel. Le asignamos
+     * el id del ultimo envío zero-copy: el caller lo vera completado
+     * cuando se completen todos los envíos anteriores, lo cual
+     * es conservador pero correcto.
+     * */
+    *id = this->zc_next - 1;
+    if (not this->zc_enabled or sz < ZEROCOPY_MIN_SIZE)
+        return sendsome(data, sz);
+
+    int s = send(this->skt, (char*)data, sz, MSG_NOSIGNAL | MSG_ZEROCOPY);
+    on_sent(s, sz, 0);
+    if (s == -1) {
+        /* Véase los comentarios de `Socket::sendsome` */
+        if (errno == EPIPE) {
+            stream_status |= STREAM_SEND_CLOSED;
+            return 0;
+        }
+
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            return WOULD_BLOCK;
+
+        /*
+         * `ENOBUFS`: el kernel se quedo sin memoria para registrar
+         * nuestro buffer (límite `optmem_max`). Copiamos.
+         * */
+        if (errno == ENOBUFS)
+            return sendsome(data, sz);
+
+        throw LibError(errno, "socket send (zerocopy) failed");
+    } else if (s == 0) {
+        stream_status |= STREAM_SEND_CLOSED;
+        return 0;
+    }
+
+    /*
+     * El kernel numera los envíos zero-copy exitosos empezando en 0.
+     * */
+    *id = this->zc_next++;
+    return s;
+}
+
+int Socket::sendall_zerocopy(
+        const void *data,
+        unsigned int sz,
+        uint32_t *id
+    ) {
+    unsigned int sent = 0;
+    *id = this->zc_next - 1;
+
+    while (sent < sz) {
+        int s = sendsome_zerocopy(
+                (char*)data + sent,
+                sz - sent,
+                id);
+
+        /* Véase los comentarios de `Socket::recvall` */
+        if (s == WOULD_BLOCK) {
+            throw LibError(
+                    EAGAIN,
+                    "socket sent only %d of %d bytes (non-blocking)",
+                    sent,
+                    sz);
+        } else if (s <= 0) {
+            assert(s == 0);
+            if (sent)
+                throw LibError(
+                        EPIPE,
+                        "socket sent only %d of %d bytes",
+                        sent,
+                        sz);
+            else
+                return 0;
+        } else {
+            sent += s;
+        }
+    }
+
+    return sz;
+}
+
+int Socket::process_zerocopy_notifications() {
+    int zerocopy = 0, timestamps = 0;
+    drain_error_queue(zerocopy, timestamps);
+    return zerocopy;
+}
+
+void Socket::drain_error_queue(int& zerocopy, int& timestamps) {
+    chk_skt_or_fail();
+    zerocopy = timestamps = 0;
+
+    while (true) {
+        /*
+         * Las notificaciones vienen como "mensajes de control"
+         * (`cmsg`) de `recvmsg` con el flag `MSG_ERRQUEUE`.
+         * No hay datos, solo el mensaje de control.
+         *
+         * Las notificaciones de zero-copy y las marcas de tiempo de los
+         * envíos comparten la cola: leemos ambas acá, sino quien lea
+         * una descartaría a las otras.
+         *
+         * El buffer de control debe estar alineado como un `struct
+         * cmsghdr` (véase `Socket::send_sockets`); la union lo garantiza
+         * sin reservar memoria del heap.
+         * */
+        union {
+            char buf[256];
+            struct cmsghdr align;
+        } control;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        int s = recvmsg(this->skt, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (s == -1) {
+            if (errno == EAGAIN or errno == EWOULDBLOCK)
+                break;
+            throw LibError(errno, "socket recvmsg(MSG_ERRQUEUE) failed");
+        }
+
+        /*
+         * Una marca de tiempo viene en *dos* mensajes de control: la
+         * hora (`SCM_TIMESTAMPING`) y de que envío y de que tipo es
+         * (`IP_RECVERR`, con origen `SO_EE_ORIGIN_TIMESTAMPING`).
+         * */
+        const struct scm_timestamping *stamp = nullptr;
+        const struct sock_extended_err *stamp_err = nullptr;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET and cm->cmsg_type == SCM_TIMESTAMPING) {
+                stamp = (const struct scm_timestamping*) CMSG_DATA(cm);
+                continue;
+            }
+
+            bool is_recverr =
+                (cm->cmsg_level == SOL_IP and cm->cmsg_type == IP_RECVERR) or
+                (cm->cmsg_level == SOL_IPV6 and cm->cmsg_type == IPV6_RECVERR);
+            if (not is_recverr)
+                continue;
+
+            struct sock_extended_err *serr = (struct sock_extended_err*) CMSG_DATA(cm);
+            if (serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                stamp_err = serr;
+                continue;
+            }
+
+            if (serr->ee_errno != 0 or serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            /*
+             * Cada notificación completa un rango de ids `[ee_info, ee_data]`.
+             * */
+            zc_complete(serr->ee_info, serr->ee_data);
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                this->zc_enabled = false;
+
+            ++zerocopy;
+        }
+
+        if (stamp and stamp_err and ts) {
+            ts->received(stamp_err->ee_info, stamp_err->ee_data, timespec_ns(stamp->ts[0]));
+            ++timestamps;
+        }
+    }
+}
+
+void Socket::zc_complete(uint32_t lo, uint32_t hi) {
+    /*
+     * Los ids son `uint32_t` y pueden dar la vuelta; comparamos
+     * siempre por diferencia.
+     * */
+    if ((int32_t)(lo - this->zc_done) > 0) {
+        this->zc_pending.emplace_back(lo, hi);
+        return;
+    }
+
+    if ((int32_t)(hi + 1 - this->zc_done) > 0)
+        this->zc_done = hi + 1;
+
+    /*
+     * Puede que algún rango que llego antes de tiempo ahora
+     * sea contiguo.
+     * */
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (auto it = this->zc_pending.begin(); it != this->zc_pending.end(); ++it) {
+            if ((int32_t)(it->first - this->zc_done) <= 0) {
+                if ((int32_t)(it->second + 1 - this->zc_done) > 0)
+                    this->zc_done = it->second + 1;
+                this->zc_pending.erase(it);
+                merged = true;
+                break;
+            }
+        }
+    }
+}
+
+bool Socket::is_zerocopy_done(uint32_t id) const {
+    return (int32_t)(id - this->zc_done) < 0;
+}
+
+void Socket::wait_zerocopy(uint32_t id) {
+    chk_skt_or_fail();
+    process_zerocopy_notifications();
+
+    while (not is_zerocopy_done(id)) {
+        /*
+         * La cola de errores no vacía se reporta como `POLLERR`
+         * (no hace falta pedirlo en `events`).
+         * */
+        struct pollfd pfd;
+        pfd.fd = this->skt;
+        pfd.events = 0;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) == -1 and errno != EINTR)
+            throw LibError(errno, "socket poll failed");
+
+        process_zerocopy_notifications();
+    }
+}
+
+void Socket::enable_timestamping() {
+    chk_skt_or_fail();
+    if (ts)
+        return;
+
+    /*
+     * - `RX_SOFTWARE`/`TX_*`: que marcas queremos que el kernel genere.
+     * - `SOFTWARE`: que nos reporte las marcas por software (sin esto
+     *   se generan pero no nos llegan).
+     * - `OPT_ID`: que cada marca de envío diga de que envío es.
+     * - `OPT_TSONLY`: que no nos devuelva una copia del paquete
+     *   enviado junto con la marca (solo la marca).
+     * */
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE
+        | SOF_TIMESTAMPING_SOFTWARE
+        | SOF_TIMESTAMPING_TX_SCHED
+        | SOF_TIMESTAMPING_TX_SOFTWARE
+        | SOF_TIMESTAMPING_TX_ACK
+        | SOF_TIMESTAMPING_OPT_ID
+        | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    if (setsockopt(this->skt, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1)
+        throw LibError(errno, "socket setsockopt(SO_TIMESTAMPING) failed");
+
+    ts.reset(new TimestampState);
+}
+
+bool Socket::is_timestamping_enabled() const {
+    return ts != nullptr;
+}
+
+int64_t Socket::ts_now() const {
+    return ts ? realtime_ns() : 0;
+}
+
+void Socket::on_sent(ssize_t s, size_t sz, int64_t t0) {
+    /*
+     * Se llama justo luego de la syscall: leemos `errno` pero no
+     * lo tocamos (el caller todavía tiene que mirarlo).
+     * */
+    ++io.send_calls;
+    if (s > 0) {
+        io.bytes_sent += s;
+        if ((size_t)s < sz)
+            ++io.short_sends;
+
+        if (ts)
+            ts->sent(s, t0);
+    } else if (s == -1) {
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            ++io.send_would_block;
+        else if (errno == EPIPE)
+            ++io.epipe;
+        else if (errno != EINTR)
+            ++io.send_errors;
+    }
+}
+
+void Socket::on_received(ssize_t s, size_t sz) {
+    ++io.recv_calls;
+    if (s > 0) {
+        io.bytes_received += s;
+        if ((size_t)s < sz)
+            ++io.short_recvs;
+
+        /*
+         * El índice del balde es la posición del bit más significativo.
+         * */
+        unsigned int bucket = 63 - __builtin_clzll((unsigned long long)s);
+        ++io.recv_sizes[std::min(bucket, SocketCounters::RECV_SIZE_BUCKETS - 1)];
+    } else if (s == 0) {
+        ++io.eof;
+    } else {
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+            ++io.recv_would_block;
+        else if (errno != EINTR)
+            ++io.recv_errors;
+    }
+}
+
+ssize_t Socket::recv_fd(void *data, unsigned int sz) {
+    if (not ts) {
+        ssize_t s = recv(this->skt, (char*)data, sz, 0);
+        on_received(s, sz);
+        return s;
+    }
+
+    /*
+     * Con timestamping usamos `recvmsg` en vez de `recv`: la marca
+     * de tiempo viene como mensaje de control (`SCM_TIMESTAMPING`),
+     * en un buffer alineado como un `struct cmsghdr`.
+     * */
+    struct iovec iov = { data, sz };
+    union {
+        char buf[CMSG_SPACE(sizeof(struct scm_timestamping)) + 64];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t s = recvmsg(this->skt, &msg, 0);
+    on_received(s, sz);
+    if (s <= 0)
+        return s;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET or cm->cmsg_type != SCM_TIMESTAMPING)
+            continue;
+
+        const struct scm_timestamping *stamp = (const struct scm_timestamping*) CMSG_DATA(cm);
+        int64_t ns = timespec_ns(stamp->ts[0]);
+        if (ns != 0) {
+            ts->last_rx_ns = ns;
+            ts->latency.rx.record(realtime_ns() - ns);
+        }
+    }
+
+    return s;
+}
+
+int64_t Socket::last_recv_timestamp_ns() const {
+    return ts ? ts->last_rx_ns : 0;
+}
+
+uint32_t Socket::last_send_id() const {
+    return ts ? ts->last_id : 0;
+}
+
+int Socket::process_timestamps() {
+    int zerocopy = 0, timestamps = 0;
+    drain_error_queue(zerocopy, timestamps);
+    return timestamps;
+}
+
+bool Socket::take_tx_timestamps(TxTimestamps& out) {
+    if (not ts or ts->done.empty())
+        return false;
+
+    out = ts->done.front();
+    ts->done.pop_front();
+    return true;
+}
+
+const SocketLatency& Socket::latency() const {
+    static const SocketLatency none;
+    return ts ? ts->latency : none;
+}
+
+const SocketCounters& Socket::counters() const {
+    return io;
+}
+
+SocketCounters Socket::process_counters() {
+    std::unique_lock<std::mutex> lock(process_io_mtx);
+    return process_io;
+}
+
+TCPInfo Socket::tcp_info() const {
+    chk_skt_or_fail();
+
+    /*
+     * Usamos el `struct tcp_info` de `linux/tcp.h` y no el de
+     * `netinet/tcp.h`: el de la libc no siempre tiene los campos más
+     * nuevos (como `tcpi_delivery_rate`).
+     *
+     * El kernel copia solo los campos que conoce y nos dice cuantos
+     * bytes escribió: el resto queda en 0.
+     * */
+    struct tcp_info ti;
+    memset(&ti, 0, sizeof(ti));
+    socklen_t len = sizeof(ti);
+
+    if (getsockopt(this->skt, IPPROTO_TCP, TCP_INFO, &ti, &len) == -1)
+        throw LibError(errno, "socket getsockopt(TCP_INFO) failed");
+
+    TCPInfo info;
+    info.state = ti.tcpi_state;
+    info.rtt_us = ti.tcpi_rtt;
+    info.rttvar_us = ti.tcpi_rttvar;
+    info.snd_mss = ti.tcpi_snd_mss;
+    info.snd_cwnd = ti.tcpi_snd_cwnd;
+    info.snd_ssthresh = ti.tcpi_snd_ssthresh;
+    info.unacked = ti.tcpi_unacked;
+    info.lost = ti.tcpi_lost;
+    info.retransmits = ti.tcpi_retransmits;
+    info.total_retrans = ti.tcpi_total_retrans;
+    info.delivery_rate = ti.tcpi_delivery_rate;
+    info.delivery_rate_app_limited = ti.tcpi_delivery_rate_app_limited;
+    info.bytes_acked = ti.tcpi_bytes_acked;
+    info.bytes_received = ti.tcpi_bytes_received;
+    info.busy_time_us = ti.tcpi_busy_time;
+    info.rwnd_limited_us = ti.tcpi_rwnd_limited;
+    info.sndbuf_limited_us = ti.tcpi_sndbuf_limited;
+    return info;
+}
+
+/*
+ * Cantidad máxima de buffers que le pasamos a `sendmsg` de una vez.
+ * El sistema operativo tiene su propio límite (`IOV_MAX`, típicamente 1024)
+ * pero nosotros necesitamos una copia local del array (véase más abajo)
+ * y preferimos que viva en el stack.
+ * */
+#define SENDALL_IOV_WINDOW 64
+
+int Socket::sendall(
+        const struct iovec *iov,
+        int iovcnt
+    ) {
+    unsigned int total = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        total += iov[i].iov_len;
+
+    /*
+     * `idx` y `off` indican el primer byte aun no enviado:
+     * el byte `off` del buffer `iov[idx]`.
+     *
+     * No podemos modificar el array del caller así que en cada
+     * iteración armamos una "ventana" local que empieza en ese byte.
+     * */
+    int idx = 0;
+    size_t off = 0;
+    unsigned int sent = 0;
+
+    while (sent < total) {
+        struct iovec window[SENDALL_IOV_WINDOW];
+        int n = 0;
+        for (int i = idx; i < iovcnt and n < SENDALL_IOV_WINDOW; ++i) {
+            size_t skip = (i == idx) ? off : 0;
+            window[n].iov_base = (char*)iov[i].iov_base + skip;
+            window[n].iov_len = iov[i].iov_len - skip;
+            ++n;
+        }
+
+        int s = sendv(window, n);
+
+        /* Véase los comentarios de `Socket::recvall` */
+        if (s == WOULD_BLOCK) {
+            throw LibError(
+                    EAGAIN,
+                    "socket sent only %d of %d bytes (non-blocking)",
+                    sent,
+                    total);
+        } else if (s <= 0) {
+            assert(s == 0);
+            if (sent)
+                throw LibError(
+                        EPIPE,
+                        "socket sent only %d of %d bytes",
+                        sent,
+                        total);
+            else
+                return 0;
+        }
+
+        sent += s;
+
+        /*
+         * Avanzamos `idx`/`off` tantos bytes como se enviaron:
+         * un envío parcial puede dejarnos en el medio de un buffer.
+         * */
+        size_t advance = s;
+        while (advance > 0) {
+            size_t left = iov[idx].iov_len - off;
+            if (advance < left) {
+                off += advance;
+                advance = 0;
+            } else {
+                advance -= left;
+                ++idx;
+                off = 0;
+            }
+        }
+    }
+
+    return total;
+}
+
+Socket::Socket(int skt) {
+    this->skt = skt;
+    this->closed = false;
+    this->stream_status = STREAM_BOTH_OPEN;
+    this->nonblocking = false;
+    this->zc_enabled = false;
+    this->zc_next = this->zc_done = 0;
+}
+
+int Socket::accept_fd(struct sockaddr_storage *peer_addr) {
+    chk_skt_or_fail();
+
+    socklen_t addrlen = sizeof(struct sockaddr_storage);
+
+    /*
+     * `accept4` es como `accept` pero permite crear el nuevo socket
+     * directamente con ciertos flags en vez de tener que hacer un `fcntl`
+     * por cada socket aceptado:
+     *
+     *  - `SOCK_CLOEXEC`: el file descriptor no se hereda en un `exec`.
+     *  - `SOCK_NONBLOCK`: el socket nace en modo no-bloqueante. En Linux
+     *    el socket aceptado *no* hereda el flag `O_NONBLOCK` del socket
+     *    aceptador así que lo pedimos explícitamente.
+     * */
+    int flags = SOCK_CLOEXEC;
+    if (this->nonblocking)
+        flags |= SOCK_NONBLOCK;
+
+    return ::accept4(
+            this->skt,
+            (struct sockaddr*)peer_addr,
+            peer_addr ? &addrlen : nullptr,
+            flags);
+}
+
+Socket Socket::accept(struct sockaddr_storage *peer_addr) {
+    /*
+     * `accept` nos bloqueara hasta que algún cliente se conecte a nosotros
+     * y la conexión se establezca.
+     *
+     * Una vez que eso suceda, `accept` retornara el file descriptor
+     * de un *nuevo* socket (`peer_skt`) que representara a la
+     * conexión establecida con *ese* cliente.
+     *
+     * En todo momento podemos seguir usando *nuestro* file descriptor
+     * (`this->skt`) para seguir haciendo más llamadas a `accept`
+     * independientemente de que enviemos/recibamos del socket `peer`.
+     * */
+    int peer_skt = accept_fd(peer_addr);
+    if (peer_skt == -1)
+        throw LibError(errno, "socket accept failed");
+
+    /*
+     * `peer_skt` es un file descriptor crudo y no queremos
+     * que nuestro cliente manipule recursos crudos sino que
+     * los use a través de un TDA.
+     *
+     * Por eso creamos un `Socket` y lo pasamos por movimiento
+     * */
+    Socket peer(peer_skt);
+    peer.nonblocking = this->nonblocking;
+    return peer;
+}
+
+std::optional<Socket> Socket::try_accept(struct sockaddr_storage *peer_addr) {
+    int peer_skt = accept_fd(peer_addr);
+    if (peer_skt == -1) {
+        /*
+         * No hay conexiones pendientes: no es un error.
+         *
+         * `ECONNABORTED` tampoco lo es: el cliente se fue
+         * antes de que lo aceptáramos.
+         * */
+        if (errno == EAGAIN or errno == EWOULDBLOCK or errno == ECONNABORTED)
+            return std::nullopt;
+        throw LibError(errno, "socket accept failed");
+    }
+
+    Socket peer(peer_skt);
+    peer.nonblocking = this->nonblocking;
+    return peer;
+}
+
+std::optional<Socket> Socket::try_accept(int& error, struct sockaddr_storage *peer_addr) {
+    if (skt == -1) {
+        error = EBADF;
+        return std::nullopt;
+    }
+
+    int peer_skt = accept_fd(peer_addr);
+    if (peer_skt == -1) {
+        error = errno;
+        return std::nullopt;
+    }
+
+    error = 0;
+    Socket peer(peer_skt);
+    peer.nonblocking = this->nonblocking;
+    return peer;
+}
+
+int Socket::accept_batch(std::vector<Socket>& peers, int max) {
+    int accepted = 0;
+    while (accepted < max) {
+        int peer_skt = accept_fd(nullptr);
+        if (peer_skt == -1) {
+            if (errno == ECONNABORTED)
+                continue;
+
+            /*
+             * La cola quedo vacía: terminamos.
+             * */
+            if (errno == EAGAIN or errno == EWOULDBLOCK)
+                break;
+
+            /*
+             * Si ya aceptamos algunas conexiones no queremos perderlas
+             * por una excepción: las retornamos y el error volverá
+             * a aparecer en la próxima llamada.
+             * */
+            if (accepted)
+                break;
+            throw LibError(errno, "socket accept failed");
+        }
+
+        Socket peer(peer_skt);
+        peer.nonblocking = this->nonblocking;
+        peers.push_back(std::move(peer));
+        ++accepted;
+    }
+
+    return accepted;
+}
+
+void Socket::set_nonblocking(bool on) {
+    chk_skt_or_fail();
+    int flags = fcntl(this->skt, F_GETFL);
+    if (flags == -1)
+        throw LibError(errno, "socket fcntl(F_GETFL) failed");
+
+    flags = on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (fcntl(this->skt, F_SETFL, flags) == -1)
+        throw LibError(errno, "socket fcntl(F_SETFL) failed");
+
+    this->nonblocking = on;
+}
+
+bool Socket::is_nonblocking() const {
+    return this->nonblocking;
+}
+
+void Socket::apply(const SocketOptions& opts) {
+    chk_skt_or_fail();
+
+    const char *failed = set_socket_options(this->skt, opts);
+    if (failed)
+        throw LibError(errno, "socket setsockopt(%s) failed", failed);
+}
+
+SocketOptions Socket::options() const {
+    chk_skt_or_fail();
+
+    SocketOptions opts;
+    auto get = [this](int level, int optname, const char *name) {
+        int optval = 0;
+        socklen_t len = sizeof(optval);
+        if (getsockopt(this->skt, level, optname, &optval, &len) == -1)
+            throw LibError(errno, "socket getsockopt(%s) failed", name);
+        return optval;
+    };
+
+    opts.nodelay = get(IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY") != 0;
+    opts.cork = get(IPPROTO_TCP, TCP_CORK, "TCP_CORK") != 0;
+    opts.quickack = get(IPPROTO_TCP, TCP_QUICKACK, "TCP_QUICKACK") != 0;
+    opts.sndbuf = get(SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF");
+    opts.rcvbuf = get(SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF");
+    opts.notsent_lowat = get(IPPROTO_TCP, TCP_NOTSENT_LOWAT, "TCP_NOTSENT_LOWAT");
+    opts.keepalive = get(SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE") != 0;
+    opts.keepidle_secs = get(IPPROTO_TCP, TCP_KEEPIDLE, "TCP_KEEPIDLE");
+    opts.keepintvl_secs = get(IPPROTO_TCP, TCP_KEEPINTVL, "TCP_KEEPINTVL");
+    opts.keepcnt = get(IPPROTO_TCP, TCP_KEEPCNT, "TCP_KEEPCNT");
+    opts.priority = get(SOL_SOCKET, SO_PRIORITY, "SO_PRIORITY");
+
+    return opts;
 }
 
 void Socket::shutdown(int how) {
@@ -481,6 +2306,7 @@ Socket::~Socket() {
         ::shutdown(this->skt, 2);
         ::close(this->skt);
     }
+    add_to_process_counters(this->io);
 }
 
 void Socket::chk_skt_or_fail() const {
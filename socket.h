@@ -1,16 +1,465 @@
 #ifndef SOCKET_H
 #define SOCKET_H
 
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "latency_histogram.h"
+
+/*
+ * Opciones de "tuning" de un socket TCP. Véase `Socket::apply`.
+ *
+ * Cada opción es un `std::optional`: las que no tengan valor no se tocan
+ * (quedan como el sistema operativo las configure por default).
+ *
+ * Lease manpage de `socket(7)` y `tcp(7)`.
+ * */
+struct SocketOptions {
+    /*
+     * `TCP_NODELAY`: deshabilita el algoritmo de Nagle.
+     *
+     * Por default el kernel retiene los envíos chicos hasta que el peer
+     * confirme (ACK) lo anterior para juntarlos en un único segmento.
+     * Para tráfico pedido/respuesta eso agrega latencia.
+     * */
+    std::optional<bool> nodelay;
+
+    /*
+     * `TCP_CORK`: lo opuesto. El kernel retiene todo lo enviado hasta que
+     * se saque el "corcho" (o pasen 200ms) y envía segmentos completos.
+     * Para un envío puntual es más cómodo `Socket::sendsome` con `more`
+     * (`MSG_MORE`).
+     * */
+    std::optional<bool> cork;
+
+    /*
+     * `TCP_QUICKACK`: confirma (ACK) inmediatamente lo recibido en vez
+     * de demorar el ACK esperando enviarlo junto con una respuesta.
+     * El kernel puede volver al modo "demorado" por su cuenta así que
+     * no es permanente.
+     * */
+    std::optional<bool> quickack;
+
+    /*
+     * `SO_SNDBUF`/`SO_RCVBUF`: tamaño de los buffers de envío y recepción
+     * del kernel. Linux reserva el *doble* de lo pedido (para su propia
+     * contabilidad) y eso es lo que se lee de vuelta.
+     *
+     * Fijarlos deshabilita el auto-tuning del kernel. El de recepción
+     * conviene fijarlo antes de conectarse: de él depende la escala
+     * de la ventana TCP anunciada en el handshake.
+     * */
+    std::optional<int> sndbuf;
+    std::optional<int> rcvbuf;
+
+    /*
+     * `TCP_NOTSENT_LOWAT`: cuantos bytes aun no enviados a la red se toleran
+     * en el buffer de envío antes de dejar de reportar al socket como
+     * "listo para escribir" (`EPOLLOUT`). Evita encolar megas de datos
+     * que quedarían "viejos" en el kernel.
+     * */
+    std::optional<int> notsent_lowat;
+
+    /*
+     * `SO_KEEPALIVE`: si la conexión queda inactiva `keepidle_secs`
+     * el kernel envía sondas cada `keepintvl_secs` y, si `keepcnt`
+     * seguidas no son respondidas, da la conexión por muerta.
+     * */
+    std::optional<bool> keepalive;
+    std::optional<int> keepidle_secs;
+    std::optional<int> keepintvl_secs;
+    std::optional<int> keepcnt;
+
+    /*
+     * `SO_PRIORITY`: prioridad (0 a 6 sin privilegios) de los paquetes
+     * de este socket en las colas de la interfaz de red.
+     * */
+    std::optional<int> priority;
+};
+
+/*
+ * Opciones para un socket pasivo (el que escucha y acepta conexiones).
+ * Véase `Socket::Socket(const char*, const ListenerOptions&)`.
+ *
+ * Los valores por default reproducen el comportamiento
+ * de `Socket::Socket(const char*)`.
+ * */
+struct ListenerOptions {
+    /*
+     * Cuantas conexiones (ya establecidas) a la espera de ser aceptadas
+     * se toleran. Si la cola se llena, el kernel empieza a descartar
+     * conexiones nuevas. Bajo una "tormenta" de conexiones conviene
+     * un valor alto (el kernel lo limita a `net.core.somaxconn`).
+     * */
+    int backlog;
+
+    /*
+     * `SO_REUSEPORT`: varios sockets pueden escuchar en el mismo puerto
+     * y el kernel reparte las conexiones entre ellos.
+     * */
+    bool reuse_port;
+
+    /*
+     * El socket aceptador queda en modo no-bloqueante y los sockets
+     * aceptados nacen en modo no-bloqueante (`accept4` con `SOCK_NONBLOCK`,
+     * sin un `fcntl` extra por cada uno).
+     * */
+    bool nonblocking;
+
+    /*
+     * `TCP_DEFER_ACCEPT`: el kernel no nos entrega la conexión hasta que
+     * el cliente haya enviado datos (o hayan pasado estos segundos).
+     * Nos ahorramos despertarnos por conexiones que aun no tienen nada
+     * para leer. 0 para deshabilitarlo.
+     * */
+    int defer_accept_secs;
+
+    /*
+     * `TCP_FASTOPEN` del lado del servidor: largo de la cola de conexiones
+     * que pueden enviar datos ya en el SYN (ahorrándose un round trip).
+     * 0 para deshabilitarlo.
+     * */
+    int fastopen_qlen;
+
+    /*
+     * Opciones aplicadas al socket que escucha. En Linux los sockets
+     * aceptados las heredan (salvo `TCP_QUICKACK`, que es efímera).
+     * */
+    SocketOptions tuning;
+
+    ListenerOptions() :
+        backlog(20),
+        reuse_port(false),
+        nonblocking(false),
+        defer_accept_secs(0),
+        fastopen_qlen(0) {}
+};
+
+/*
+ * Opciones para un socket activo (el que se conecta a un servidor).
+ * Véase `Socket::Socket(const char*, const char*, const ConnectOptions&)`.
+ * */
+struct ConnectOptions {
+    /*
+     * Familia de direcciones a probar: `AF_INET` (IPv4), `AF_INET6` (IPv6)
+     * o `AF_UNSPEC` (ambas).
+     * */
+    int family;
+
+    /*
+     * Cuanto esperar a que un intento de conexión progrese antes de lanzar
+     * el siguiente *en paralelo* (el RFC 8305 recomienda 250ms).
+     * */
+    int attempt_delay_ms;
+
+    /*
+     * Tiempo máximo para conectarse, considerando todos los intentos.
+     * Negativo para esperar indefinidamente.
+     * */
+    int timeout_ms;
+
+    /*
+     * Opciones aplicadas a cada intento de conexión *antes* del `connect`.
+     * */
+    SocketOptions tuning;
+
+    ConnectOptions() :
+        family(AF_UNSPEC),
+        attempt_delay_ms(250),
+        timeout_ms(-1) {}
+};
+
+/*
+ * Dirección de un socket Unix (`AF_UNIX`): un socket "local" que solo
+ * conecta procesos de la misma máquina.
+ *
+ * Para procesos de la misma máquina TCP sobre loopback (`127.0.0.1`)
+ * funciona pero paga todo el costo del stack de red (checksums,
+ * segmentación, control de congestión...) sin necesitarlo: un socket
+ * Unix simplemente copia los datos de un proceso al otro.
+ *
+ * La dirección puede ser:
+ *
+ *  - un archivo (`UnixAddress::file("/tmp/app.sock")`) que se crea al
+ *    hacer el `bind` y cuyo acceso se controla con permisos de archivo;
+ *  - un nombre "abstracto" (`UnixAddress::abstract("app")`, solo Linux)
+ *    que no existe en el filesystem y desaparece solo al cerrarse
+ *    el socket.
+ *
+ * Lease manpage de `unix(7)`.
+ * */
+struct UnixAddress {
+    std::string name;
+    bool is_abstract;
+
+    static UnixAddress file(const std::string& path) { return {path, false}; }
+    static UnixAddress abstract(const std::string& name) { return {name, true}; }
+};
+
+/*
+ * Resultado de las operaciones "sin excepciones" de `Socket`
+ * (`Socket::try_sendsome`, `Socket::try_recvsome`, ...).
+ *
+ * `value` es lo que retornaría la versión con excepciones (bytes
+ * enviados/recibidos) y `error` el `errno` (0 si no hubo error).
+ *
+ *  - éxito:                  `value > 0`,  `error == 0`
+ *  - conexión cerrada:       `value == 0`, `error == 0` (o `EPIPE` al enviar)
+ *  - operación bloquearía:   `value == -1`, `would_block()`
+ *  - error:                  `value == -1`, `error != 0`
+ * */
+struct IOResult {
+    int value;
+    int error;
+
+    bool ok() const { return error == 0; }
+    bool would_block() const { return error == EAGAIN or error == EWOULDBLOCK; }
+};
+
+/*
+ * Marcas de tiempo de un envío (véase `Socket::enable_timestamping`).
+ *
+ * Todas son en nanosegundos desde la época (`CLOCK_REALTIME`, el reloj
+ * que usa el kernel para las marcas) o 0 si el kernel no la reporto:
+ *
+ *  - `sent_ns`: cuando llamamos a `Socket::sendsome`.
+ *  - `sched_ns`: cuando el kernel encolo el último byte del envío
+ *    en la cola de la interfaz de red (queueing discipline).
+ *  - `software_ns`: cuando lo paso al driver de la placa de red.
+ *  - `ack_ns`: cuando el otro extremo confirmo (ACK) haberlo recibido.
+ *
+ * `ack_ns - sent_ns` es lo que tardo el envío de punta a punta;
+ * las demás muestran en que tramo se fue el tiempo.
+ * */
+struct TxTimestamps {
+    uint32_t id;
+    int64_t sent_ns;
+    int64_t sched_ns;
+    int64_t software_ns;
+    int64_t ack_ns;
+};
+
+/*
+ * Histogramas de latencias de un socket (véase `Socket::latency`).
+ *
+ *  - `rx`: desde que el kernel recibió los datos hasta que
+ *    `Socket::recvsome` nos los entrego (cuanto esperaron en la cola
+ *    de recepción del socket a que los leyéramos).
+ *  - `tx_sched`, `tx_software` y `tx_ack`: desde que llamamos
+ *    a `Socket::sendsome` hasta cada una de las marcas de `TxTimestamps`.
+ * */
+struct SocketLatency {
+    LatencyHistogram rx;
+    LatencyHistogram tx_sched;
+    LatencyHistogram tx_software;
+    LatencyHistogram tx_ack;
+};
+
+/*
+ * Contadores de I/O de un socket (véase `Socket::counters`).
+ *
+ * ¿Estamos limitados por las syscalls, por la ventana de TCP o por las
+ * perdidas? Muchas syscalls con pocos bytes cada una (`bytes / calls`
+ * bajo, muchas lecturas chicas en `recv_sizes`, muchos `would_block`)
+ * indican lo primero; para lo demás véase `Socket::tcp_info`.
+ *
+ *  - `send_calls` / `recv_calls`: syscalls de envío y recepción hechas
+ *    (incluidas las que fallaron o "bloquearían").
+ *  - `short_sends` / `short_recvs`: syscalls que transfirieron menos
+ *    bytes que los pedidos (pero más que 0).
+ *  - `send_would_block` / `recv_would_block`: en modo no-bloqueante,
+ *    syscalls que retornaron `EAGAIN`.
+ *  - `epipe`: envíos que encontraron la conexión cerrada (broken pipe).
+ *  - `eof`: recepciones que encontraron la conexión cerrada.
+ *  - `send_errors` / `recv_errors`: cualquier otro error al enviar
+ *    o al recibir.
+ *  - `recv_sizes[i]`: recepciones de entre `2^i` y `2^(i+1) - 1` bytes
+ *    (la última cuenta también todas las más grandes).
+ *
+ * Son simples enteros, sin atomics ni locks: incrementarlos cuesta
+ * mucho menos que la syscall que cuentan.
+ *
+ * Los de envío y los de recepción son campos distintos (ninguno se
+ * toca desde ambos lados) así un thread puede enviar y otro recibir
+ * por el mismo socket a la vez. Leerlos mientras tanto desde un tercer
+ * thread no es seguro.
+ * */
+struct SocketCounters {
+    static const unsigned int RECV_SIZE_BUCKETS = 17;
+
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_received = 0;
+
+    uint64_t send_calls = 0;
+    uint64_t recv_calls = 0;
+
+    uint64_t short_sends = 0;
+    uint64_t short_recvs = 0;
+
+    uint64_t send_would_block = 0;
+    uint64_t recv_would_block = 0;
+
+    uint64_t epipe = 0;
+    uint64_t eof = 0;
+
+    uint64_t send_errors = 0;
+    uint64_t recv_errors = 0;
+
+    uint64_t recv_sizes[RECV_SIZE_BUCKETS] = {};
+
+    /*
+     * Acumula los contadores de `other` (para sumar los de varios
+     * sockets).
+     * */
+    SocketCounters& operator+=(const SocketCounters& other);
+
+    void print(std::ostream& out) const;
+};
+
+std::ostream& operator<<(std::ostream& out, const SocketCounters& c);
+
+/*
+ * Una muestra de `TCP_INFO` (véase `Socket::tcp_info`).
+ *
+ *  - `rtt_us` / `rttvar_us`: el round trip time suavizado que estima
+ *    el kernel y su variación, en microsegundos.
+ *  - `snd_cwnd`: la ventana de congestión, en segmentos de `snd_mss`
+ *    bytes; `snd_ssthresh` el umbral de "slow start".
+ *  - `unacked`: segmentos enviados aun no confirmados; `lost` los que
+ *    el kernel cree perdidos.
+ *  - `retransmits`: retransmisiones consecutivas del segmento actual
+ *    (un timeout en curso); `total_retrans` todas las de la conexión.
+ *  - `delivery_rate`: la velocidad de entrega medida por el kernel,
+ *    en bytes por segundo. Si `delivery_rate_app_limited` es `true`
+ *    la medición estuvo limitada por nosotros (no teníamos nada para
+ *    enviar), no por la red.
+ *  - `busy_time_us`, `rwnd_limited_us` y `sndbuf_limited_us`: cuanto
+ *    tiempo estuvo la conexión enviando y, de ese, cuanto estuvo
+ *    frenada por la ventana del receptor o por el buffer de envío.
+ *
+ * Los campos que el kernel no reporte (uno viejo) quedan en 0.
+ * */
+struct TCPInfo {
+    uint8_t state;
+
+    uint32_t rtt_us;
+    uint32_t rttvar_us;
+
+    uint32_t snd_mss;
+    uint32_t snd_cwnd;
+    uint32_t snd_ssthresh;
+
+    uint32_t unacked;
+    uint32_t lost;
+    uint32_t retransmits;
+    uint32_t total_retrans;
+
+    uint64_t delivery_rate;
+    bool delivery_rate_app_limited;
+
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+
+    uint64_t busy_time_us;
+    uint64_t rwnd_limited_us;
+    uint64_t sndbuf_limited_us;
+};
+
 /*
  * TDA Socket.
  * Por simplificación este TDA se enfocará solamente
- * en sockets IPv4 para TCP.
+ * en sockets TCP (IPv4 salvo que se pida explícitamente IPv6).
  * */
 class Socket {
     private:
     int skt;
     bool closed;
-    int stream_status;
+
+    /*
+     * Se modifica tanto al enviar como al recibir (al encontrar la
+     * conexión cerrada): es atómico para que un thread pueda enviar
+     * mientras otro recibe.
+     * */
+    std::atomic<int> stream_status;
+    bool nonblocking;
+
+    /*
+     * Estado del envío zero-copy (véase `Socket::enable_zerocopy`).
+     *
+     * `zc_next` es el id que el kernel le asignara al próximo envío
+     * zero-copy y `zc_done` el primer id aun no completado: todos los
+     * ids menores a él ya fueron completados.
+     *
+     * Si el kernel completa ids fuera de orden, los rangos que aun no
+     * son contiguos a `zc_done` esperan en `zc_pending`.
+     * */
+    bool zc_enabled;
+    uint32_t zc_next;
+    uint32_t zc_done;
+    std::vector<std::pair<uint32_t, uint32_t>> zc_pending;
+
+    void zc_complete(uint32_t lo, uint32_t hi);
+
+    /*
+     * Estado del timestamping (véase `Socket::enable_timestamping`);
+     * nulo si no esta habilitado. Es opaco: esta definido en `socket.cpp`.
+     * */
+    struct TimestampState;
+    std::unique_ptr<TimestampState> ts;
+
+    /*
+     * Véase `Socket::counters`.
+     * */
+    SocketCounters io;
+
+    int64_t ts_now() const;
+    ssize_t recv_fd(void *data, unsigned int sz);
+
+    /*
+     * Se llaman justo luego de cada syscall de envío y de recepción
+     * (con lo que retorno y los bytes pedidos) y actualizan los
+     * contadores y el timestamping. No modifican `errno`.
+     * */
+    void on_sent(ssize_t s, size_t sz, int64_t t0);
+    void on_received(ssize_t s, size_t sz);
+
+    /*
+     * Lee la cola de errores (notificaciones de zero-copy y marcas de
+     * tiempo de envíos) y retorna cuantas notificaciones de cada tipo
+     * se procesaron.
+     * */
+    void drain_error_queue(int& zerocopy, int& timestamps);
+
+    /*
+     * `accept4` con los flags que correspondan. Retorna el file
+     * descriptor o -1 (con `errno` seteado).
+     * */
+    int accept_fd(struct sockaddr_storage *peer_addr);
+
+    /*
+     * `Reactor` necesita el file descriptor para registrarlo en `epoll`
+     * y `URing` para hacer pedidos a `io_uring` (y construir sockets
+     * a partir de los file descriptors aceptados).
+     * `AsyncSocket` construye sockets con un `connect` no-bloqueante
+     * en curso y `SharedPoller` también usa `epoll`.
+     * No queremos exponerlo a cualquiera así que solo a ellos
+     * les damos acceso.
+     * */
+    friend class Reactor;
+    friend class URing;
+    friend class AsyncSocket;
+    friend class SharedPoller;
 
     /*
      * Construye el socket pasándole directamente el file descriptor.
@@ -71,6 +520,58 @@ Socket(
 
 explicit Socket(const char *servname);
 
+/*
+ * Como `Socket::Socket(const char*, const char*)` pero en vez de probar
+ * cada dirección de a una (con un `connect` bloqueante y sin timeout,
+ * donde una única dirección "muerta" nos puede trabar por minutos)
+ * implementa "Happy Eyeballs" (RFC 8305):
+ *
+ *  - las direcciones IPv6 e IPv4 se intercalan,
+ *  - se lanza un `connect` no-bloqueante a la primera dirección,
+ *  - si no se conecto luego de `attempt_delay_ms` (o si fallo) se lanza
+ *    uno a la siguiente *sin abandonar el anterior*,
+ *  - gana el primero en conectarse; el resto se cierran.
+ *
+ * Si no se logra conectar antes de `timeout_ms` se lanza una excepción.
+ *
+ * El socket resultante queda en modo bloqueante.
+ * */
+Socket(
+        const char *hostname,
+        const char *servname,
+        const ConnectOptions& opts);
+
+/*
+ * Como `Socket::Socket(const char*)` pero configurable (véase
+ * `ListenerOptions`).
+ * */
+Socket(const char *servname, const ListenerOptions& opts);
+
+/*
+ * Constructores para sockets Unix (`AF_UNIX`, véase `UnixAddress`).
+ *
+ * `Socket::Socket(const UnixAddress&)` se conecta a `peer` y
+ * `Socket::Socket(const UnixAddress&, const ListenerOptions&)` escucha
+ * en `local`. De `ListenerOptions` solo se usan `backlog` y `nonblocking`:
+ * el resto son opciones de TCP.
+ *
+ * Si `local` es un archivo y ya existe un socket ahí (por ejemplo de
+ * una ejecución anterior que no lo borro) se lo reemplaza. El archivo
+ * *no* se borra al destruir el socket.
+ *
+ * Fuera de la construcción un socket Unix se usa igual que uno TCP.
+ * */
+explicit Socket(const UnixAddress& peer);
+Socket(const UnixAddress& local, const ListenerOptions& opts);
+
+/*
+ * Crea un par de sockets Unix ya conectados entre si (`socketpair`).
+ *
+ * Típicamente se crea el par antes de un `fork`: el proceso padre se
+ * queda con uno y el hijo con el otro, sin necesidad de una dirección.
+ * */
+static std::pair<Socket, Socket> pair();
+
 /*
  * Deshabilitamos el constructor por copia y operador asignación por copia
  * ya que no queremos que se puedan copiar objetos `Socket`.
@@ -115,19 +616,67 @@ Socket& operator=(Socket&&);
  * Retorna 0 si se cerro el socket,
  * o positivo que indicara cuantos bytes realmente se enviaron/recibieron.
  *
+ * Si el socket esta en modo no-bloqueante (véase `Socket::set_nonblocking`)
+ * y la operación "bloquearía" (`EAGAIN`/`EWOULDBLOCK`) se retorna
+ * `Socket::WOULD_BLOCK` (-1). No es un error: simplemente hay que
+ * reintentar más tarde, cuando el socket este listo (véase `Reactor`).
+ *
  * Si hay un error se lanza una excepción.
  *
+ * Con `more` se le avisa al kernel que enseguida enviaremos más
+ * datos (`MSG_MORE`): los retendrá para armar segmentos completos,
+ * como `TCP_CORK` pero solo para este envío.
+ *
  * Lease manpage de `send` y `recv`
  * */
+static const int WOULD_BLOCK = -1;
+
 int sendsome(
         const void *data,
-        unsigned int sz
+        unsigned int sz,
+        bool more = false
         );
 int recvsome(
         void *data,
         unsigned int sz
         );
 
+/*
+ * Versiones de `Socket::sendsome` y `Socket::recvsome` que no lanzan
+ * excepciones: cualquier error se retorna en un `IOResult`.
+ *
+ * En un servidor no-bloqueante con miles de conexiones, `EAGAIN`,
+ * `ECONNRESET` o `EPIPE` no son excepcionales sino el pan de cada día
+ * y lanzar (y atrapar) una excepción por cada uno es caro:
+ * el "unwinding" del stack recorre tablas y reserva memoria.
+ * */
+IOResult try_sendsome(
+        const void *data,
+        unsigned int sz,
+        bool more = false
+        ) noexcept;
+IOResult try_recvsome(
+        void *data,
+        unsigned int sz
+        ) noexcept;
+
+/*
+ * Mira (sin consumirlos) hasta `sz` bytes recibidos, sin bloquearse
+ * aunque el socket este en modo bloqueante: `recv` con `MSG_PEEK`
+ * y `MSG_DONTWAIT`.
+ *
+ * Retorna lo mismo que `Socket::recvsome` en modo no-bloqueante
+ * (0 si el otro extremo cerró, `Socket::WOULD_BLOCK` si no hay nada).
+ *
+ * A diferencia de `Socket::set_nonblocking`, que cambia un flag del
+ * file descriptor (compartido por todos los threads que lo usen),
+ * esto solo afecta a esta llamada.
+ * */
+int peek_nonblocking(
+        void *data,
+        unsigned int sz
+        );
+
 /*
  * `Socket::sendall` envía exactamente `sz` bytes leídos del buffer, ni más,
  * ni menos. `Socket::recvall` recibe exactamente sz bytes.
@@ -147,23 +696,353 @@ int recvsome(
  * En caso de éxito se retorna la misma cantidad de bytes pedidos
  * para envio/recibo, lease `sz`.
  *
+ * Estos métodos están pensados para sockets bloqueantes. En modo
+ * no-bloqueante, si la operación bloquearía a mitad de camino
+ * se lanza una excepción (no hay forma de "retomar" desde donde
+ * quedo).
  * */
 int sendall(
         const void *data,
-        unsigned int sz
+        unsigned int sz,
+        bool more = false
         );
 int recvall(
         void *data,
         unsigned int sz
         );
 
+/*
+ * Versiones "scatter/gather" de `Socket::sendsome` y `Socket::recvsome`.
+ *
+ * En vez de un único buffer contiguo reciben un array de `iovcnt`
+ * buffers (`struct iovec`, un puntero y un largo cada uno).
+ *
+ * `Socket::sendv` envía los buffers uno a continuación del otro
+ * (como si fueran uno solo) y `Socket::recvv` llena los buffers
+ * en orden.
+ *
+ * Así un protocolo puede enviar, por ejemplo, los headers y el body
+ * que están en buffers distintos con una única syscall y sin tener
+ * que copiarlos a un buffer intermedio.
+ *
+ * Retornan lo mismo que `Socket::sendsome` y `Socket::recvsome`.
+ *
+ * Lease manpage de `sendmsg`, `recvmsg` y `writev`.
+ * */
+int sendv(
+        const struct iovec *iov,
+        int iovcnt
+        );
+int recvv(
+        const struct iovec *iov,
+        int iovcnt
+        );
+
+/*
+ * Pasaje de file descriptors (solo sockets Unix, `SCM_RIGHTS`).
+ *
+ * `Socket::send_sockets` envía a lo sumo `sz` bytes de `data`
+ * (al menos 1) y, junto con ellos, *los sockets* `skts`: el proceso
+ * que los reciba (`Socket::recv_sockets`) obtiene sus propios file
+ * descriptors que apuntan a las mismas conexiones.
+ *
+ * Así un proceso puede aceptar conexiones y pasárselas a procesos
+ * "workers" pre-forkeados que las atienden directamente.
+ *
+ * Los sockets enviados siguen siendo validos en el proceso que los
+ * envío: típicamente se los cierra luego de enviarlos con `Socket::close`
+ * y *no* dejando que se destruyan: el destructor hace un `shutdown`
+ * que corta la conexión (la conexión es una sola) también para el
+ * proceso que los recibió.
+ *
+ * `Socket::recv_sockets` recibe a lo sumo `sz` bytes en `data` y
+ * agrega a `skts` los sockets recibidos junto con esos bytes
+ * (a lo sumo `max_sockets`; si llegaron más se cierran todos y se
+ * lanza una excepción).
+ *
+ * Ambos retornan lo mismo que `Socket::sendsome` y `Socket::recvsome`.
+ *
+ * Lease manpage de `unix(7)` y `cmsg(3)`.
+ * */
+int send_sockets(
+        const void *data,
+        unsigned int sz,
+        const std::vector<Socket*>& skts);
+
+int recv_sockets(
+        void *data,
+        unsigned int sz,
+        std::vector<Socket>& skts,
+        unsigned int max_sockets = 16);
+
+/*
+ * Versión "scatter/gather" de `Socket::sendall`: envía exactamente todos
+ * los bytes de los `iovcnt` buffers, ni más, ni menos, manejando los
+ * envíos parciales que puedan cortar a un buffer por la mitad.
+ *
+ * El array `iov` no es modificado.
+ *
+ * Retorna lo mismo que `Socket::sendall`: la suma de los largos de todos
+ * los buffers en caso de éxito.
+ * */
+int sendall(
+        const struct iovec *iov,
+        int iovcnt
+        );
+
+/*
+ * Transferencia entre un archivo y el socket sin pasar por
+ * buffers del usuario.
+ *
+ * `Socket::sendfile` envía `len` bytes del archivo `fd` empezando
+ * en `offset` (lease manpage de `sendfile`).
+ *
+ * `Socket::recvfile` recibe `len` bytes y los escribe en el archivo `fd`
+ * empezando en `offset`. Como no existe un "recvfile" en Linux, los bytes
+ * van del socket a un pipe y del pipe al archivo con `splice`: en ambos
+ * casos el kernel solo mueve referencias a páginas de memoria,
+ * no copia (lease manpage de `splice`).
+ *
+ * En ambos casos la posición actual del archivo (la de `read`/`write`)
+ * no cambia.
+ *
+ * El comportamiento ante un cierre es el mismo que el de
+ * `Socket::sendall`/`Socket::recvall`: si se envío/recibió algo pero no
+ * todo se lanza una excepción; si no se envío/recibió nada se retorna 0.
+ * En caso de éxito se retorna `len`.
+ *
+ * Si hay un error se lanza una excepción.
+ * */
+size_t sendfile(
+        int fd,
+        off_t offset,
+        size_t len
+        );
+size_t recvfile(
+        int fd,
+        off_t offset,
+        size_t len
+        );
+
+/*
+ * Envío "zero-copy" (`SO_ZEROCOPY`/`MSG_ZEROCOPY`).
+ *
+ * Un `send` normal copia los bytes del buffer del usuario al kernel.
+ * Para mensajes grandes esa copia es cara; con zero-copy el kernel
+ * en cambio envía directamente desde la memoria del usuario.
+ *
+ * El precio es que el buffer *no* puede ser modificado ni liberado
+ * hasta que el kernel nos avise que termino de usarlo. Esos avisos
+ * llegan por la "cola de errores" del socket (`MSG_ERRQUEUE`).
+ *
+ * `Socket::enable_zerocopy` habilita el modo. Si el sistema operativo
+ * no lo soporta, el socket sigue funcionando: los envíos se hacen
+ * copiando y se consideran completados inmediatamente.
+ *
+ * Lease la documentación de Linux `msg_zerocopy.rst`.
+ * */
+void enable_zerocopy();
+bool is_zerocopy_enabled() const;
+
+/*
+ * Como `Socket::sendsome` y `Socket::sendall` pero sin copiar los bytes.
+ *
+ * En `id` se guarda el identificador del envío: el buffer puede
+ * reusarse recién cuando `Socket::is_zerocopy_done(id)` sea `true`.
+ * Para `Socket::sendall_zerocopy` es el id del *ultimo* envío hecho
+ * (los envíos se completan en orden).
+ *
+ * Mensajes chicos (menos de `ZEROCOPY_MIN_SIZE` bytes) se envían
+ * copiando: para ellos el costo de la notificación supera al de la copia.
+ * */
+static const unsigned int ZEROCOPY_MIN_SIZE = 16384;
+
+int sendsome_zerocopy(
+        const void *data,
+        unsigned int sz,
+        uint32_t *id
+        );
+int sendall_zerocopy(
+        const void *data,
+        unsigned int sz,
+        uint32_t *id
+        );
+
+/*
+ * Lee (sin bloquearse) las notificaciones pendientes de la cola de errores
+ * y retorna cuantas se procesaron.
+ *
+ * Si el kernel nos avisa que igualmente tuvo que copiar los bytes
+ * (por ejemplo en conexiones por loopback), zero-copy no nos da ningún
+ * beneficio y lo deshabilitamos: los próximos envíos copiaran.
+ * */
+int process_zerocopy_notifications();
+
+/*
+ * Retorna si el envío `id` ya fue completado (sin leer nuevas
+ * notificaciones).
+ * */
+bool is_zerocopy_done(uint32_t id) const;
+
+/*
+ * Bloquea hasta que el envío `id` haya sido completado.
+ * */
+void wait_zerocopy(uint32_t id);
+
+/*
+ * Timestamping por software (`SO_TIMESTAMPING`).
+ *
+ * ¿La latencia se va en nuestro código, en las colas del socket o en
+ * la red? Habilitando el timestamping el kernel marca con la hora
+ * distintos momentos en la vida de los datos:
+ *
+ *  - al recibir: cuando el paquete llego al stack de red. Se lee en cada
+ *    `Socket::recvsome` (que pasa a usar `recvmsg`).
+ *  - al enviar: cuando el último byte de cada `Socket::sendsome` se
+ *    encola, cuando se pasa al driver y cuando el otro extremo
+ *    lo confirma (ACK). Llegan más tarde, por la cola de errores
+ *    (como las notificaciones de zero-copy).
+ *
+ * Las marcas son por software (no requieren una placa de red especial)
+ * y funcionan también sobre loopback.
+ *
+ * Cada marca se acumula en los histogramas de `Socket::latency` y ademas
+ * puede consultarse individualmente:
+ *
+ *  - `Socket::last_recv_timestamp_ns`: la marca del último recibido.
+ *  - `Socket::last_send_id`: el id del último envío.
+ *  - `Socket::process_timestamps`: lee (sin bloquearse) las marcas
+ *    de envío pendientes.
+ *  - `Socket::take_tx_timestamps`: retorna, en orden, los envíos ya
+ *    confirmados con todas sus marcas.
+ *
+ * Solo `Socket::sendsome` y `Socket::recvsome` (y las funciones que se
+ * basan en ellas, como `Socket::sendall`, o sus versiones `try_`) toman
+ * las marcas del lado del usuario. El resto de los envíos se cuentan
+ * para que los ids sigan siendo correctos.
+ *
+ * El estado del timestamping es compartido por ambos lados: con el
+ * timestamping habilitado no se puede enviar desde un thread y recibir
+ * desde otro a la vez.
+ *
+ * Lease la documentación de Linux `timestamping.rst`.
+ * */
+void enable_timestamping();
+bool is_timestamping_enabled() const;
+
+int64_t last_recv_timestamp_ns() const;
+uint32_t last_send_id() const;
+
+int process_timestamps();
+bool take_tx_timestamps(TxTimestamps& out);
+
+const SocketLatency& latency() const;
+
+/*
+ * Contadores de I/O de este socket (véase `SocketCounters`).
+ *
+ * Los cuentan `Socket::sendsome`, `Socket::recvsome`, sus versiones
+ * `try_`, `Socket::sendv`, `Socket::recvv`, `Socket::sendfile` y los
+ * envíos zero-copy (y todo lo que se basa en ellos, como
+ * `Socket::sendall`).
+ *
+ * Al destruirse, un socket suma sus contadores a los del proceso
+ * (véase `Socket::process_counters`).
+ * */
+const SocketCounters& counters() const;
+
+/*
+ * Los contadores sumados de todos los sockets del proceso *ya
+ * destruidos*. Para incluir a los que siguen vivos sumales
+ * sus `Socket::counters`.
+ *
+ * Puede llamarse desde cualquier thread.
+ * */
+static SocketCounters process_counters();
+
+/*
+ * Toma una muestra del estado de la conexión TCP según el kernel
+ * (`getsockopt(TCP_INFO)`, véase `TCPInfo`).
+ *
+ * Cada llamada es una syscall: pensado para muestrear cada tanto
+ * (por ejemplo, al cerrar la conexión o cada algunos segundos),
+ * no en cada envío.
+ *
+ * Si el socket no es TCP (por ejemplo un socket Unix) se lanza
+ * una excepción.
+ *
+ * Lease manpage de `tcp` (`TCP_INFO`) y `linux/tcp.h`.
+ * */
+TCPInfo tcp_info() const;
+
 /*
  * Acepta una conexión entrante y retorna un nuevo socket
  * construido a partir de ella.
  *
+ * Si `peer_addr` no es `nullptr`, se guarda ahí la dirección del cliente
+ * (sin necesidad de llamar luego a `getpeername`).
+ *
  * En caso de error, se lanza una excepción.
  * */
-Socket accept();
+Socket accept(struct sockaddr_storage *peer_addr = nullptr);
+
+/*
+ * Versión de `Socket::accept` para un socket en modo no-bloqueante.
+ *
+ * Si no hay ninguna conexión a la espera de ser aceptada,
+ * en vez de bloquearse (o lanzar una excepción), retorna `std::nullopt`.
+ *
+ * El socket retornado hereda el modo no-bloqueante del socket aceptador.
+ * */
+std::optional<Socket> try_accept(struct sockaddr_storage *peer_addr = nullptr);
+
+/*
+ * Como la anterior pero sin excepciones: si no se acepto ninguna
+ * conexión se retorna `std::nullopt` y en `error` queda el motivo
+ * (`EAGAIN` si simplemente no había conexiones pendientes).
+ * */
+std::optional<Socket> try_accept(int& error, struct sockaddr_storage *peer_addr = nullptr);
+
+/*
+ * Acepta hasta `max` conexiones pendientes y las agrega a `peers`.
+ * Retorna cuantas se aceptaron.
+ *
+ * Pensado para un socket en modo no-bloqueante: vacía la cola de
+ * conexiones pendientes de una sola vez (en vez de despertarnos
+ * una vez por cada una) y se detiene apenas la cola queda vacía.
+ * */
+int accept_batch(std::vector<Socket>& peers, int max);
+
+/*
+ * Pone al socket en modo no-bloqueante (`true`) o bloqueante (`false`).
+ *
+ * En modo no-bloqueante ninguna operación bloqueara al programa:
+ * si no hay datos para recibir o no hay espacio para enviar,
+ * las operaciones retornan `Socket::WOULD_BLOCK` inmediatamente.
+ *
+ * Es la base para atender miles de conexiones desde un solo thread
+ * (véase `Reactor`).
+ *
+ * Lease manpage de `fcntl` y `O_NONBLOCK`
+ * */
+void set_nonblocking(bool on);
+bool is_nonblocking() const;
+
+/*
+ * Aplica las opciones de `opts` que tengan valor (véase `SocketOptions`).
+ * Se puede llamar en cualquier momento.
+ *
+ * Si alguna no se puede aplicar se lanza una excepción (las anteriores
+ * a ella quedan aplicadas).
+ * */
+void apply(const SocketOptions& opts);
+
+/*
+ * Lee los valores *efectivos* de todas las opciones de `SocketOptions`
+ * (que pueden no ser los pedidos: el kernel redondea, duplica o limita
+ * algunos valores).
+ * */
+SocketOptions options() const;
 
 /*
  * Cierra la conexión ya sea parcial o completamente.
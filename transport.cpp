@@ -0,0 +1,107 @@
+#include "transport.h"
+#include "liberror.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+SocketPairTransport::SocketPairTransport() :
+    SocketPairTransport(Socket::pair()) {}
+
+SocketPairTransport::SocketPairTransport(std::pair<Socket, Socket>&& ends) :
+    Socket(std::move(ends.first)),
+    remote(std::move(ends.second)) {}
+
+Socket SocketPairTransport::take_peer() {
+    return std::move(remote);
+}
+
+MemoryTransport::MemoryTransport(unsigned int chunk_sz) :
+    in_off(0),
+    in_closed(false),
+    chunk_sz(chunk_sz),
+    nonblocking(false) {}
+
+void MemoryTransport::feed(std::string_view data) {
+    inbound.append(data.data(), data.size());
+}
+
+void MemoryTransport::close_inbound() {
+    in_closed = true;
+}
+
+void MemoryTransport::rewind() {
+    in_off = 0;
+    in_closed = false;
+}
+
+const std::string& MemoryTransport::written() const {
+    return outbound;
+}
+
+void MemoryTransport::clear_written() {
+    outbound.clear();
+}
+
+int MemoryTransport::recvsome(void *data, unsigned int sz) {
+    size_t available = inbound.size() - in_off;
+    if (available == 0) {
+        if (in_closed)
+            return 0;
+
+        if (nonblocking)
+            return Socket::WOULD_BLOCK;
+
+        throw LibError(EDEADLK, "memory transport recv would block forever (nothing fed)");
+    }
+
+    size_t n = std::min<size_t>(sz, available);
+    if (chunk_sz)
+        n = std::min<size_t>(n, chunk_sz);
+
+    memcpy(data, inbound.data() + in_off, n);
+    in_off += n;
+    return n;
+}
+
+int MemoryTransport::sendall(const void *data, unsigned int sz) {
+    outbound.append((const char*)data, sz);
+    return sz;
+}
+
+int MemoryTransport::sendall(const struct iovec *iov, int iovcnt) {
+    int total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        outbound.append((const char*)iov[i].iov_base, iov[i].iov_len);
+        total += iov[i].iov_len;
+    }
+
+    return total;
+}
+
+/*
+ * Del lado de envío no hay nadie que pueda cerrar la conexión.
+ * */
+bool MemoryTransport::is_stream_send_closed() const {
+    return false;
+}
+
+bool MemoryTransport::is_stream_recv_closed() const {
+    return in_closed and in_off == inbound.size();
+}
+
+void MemoryTransport::set_nonblocking(bool on) {
+    nonblocking = on;
+}
+
+int MemoryTransport::peek_nonblocking(void *data, unsigned int sz) {
+    size_t available = inbound.size() - in_off;
+    if (available == 0)
+        return in_closed ? 0 : Socket::WOULD_BLOCK;
+
+    size_t n = std::min<size_t>(sz, available);
+    memcpy(data, inbound.data() + in_off, n);
+    return n;
+}
@@ -0,0 +1,135 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <sys/uio.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "socket.h"
+
+/*
+ * Un "transporte" es cualquier clase que se pueda usar como el `Socket`
+ * de un `BasicBufferedSocket` (y por ende de un `BasicHTTPProtocol`).
+ *
+ * No hay una clase base ni métodos virtuales: los protocolos son
+ * templates y el compilador genera una versión para cada transporte
+ * (polimorfismo "estático"). Llamar a un método del transporte cuesta
+ * lo mismo que llamar a uno de `Socket` directamente.
+ *
+ * A cambio el transporte tiene que tener, con la misma semántica que
+ * los de `Socket`, los métodos:
+ *
+ *  int recvsome(void *data, unsigned int sz);
+ *  int sendall(const void *data, unsigned int sz);
+ *  int sendall(const struct iovec *iov, int iovcnt);
+ *  bool is_stream_send_closed() const;
+ *  bool is_stream_recv_closed() const;
+ *  void set_nonblocking(bool on);
+ *  int peek_nonblocking(void *data, unsigned int sz);
+ *
+ * y ser movible. Si falta alguno el error es de compilación.
+ *
+ * Los transportes disponibles son:
+ *
+ *  - `Socket`: TCP (o Unix) de verdad.
+ *  - `SocketPairTransport`: un extremo de un `Socket::pair`; el otro
+ *    extremo hace de servidor en el mismo proceso (por ejemplo
+ *    en otro thread).
+ *  - `MemoryTransport`: todo en memoria, sin syscalls. Para probar o
+ *    medir el costo de un protocolo (el parser) sin el stack de red
+ *    del kernel de por medio.
+ * */
+
+/*
+ * Un extremo de un par de sockets Unix conectados entre si (véase
+ * `Socket::pair`). Es un `Socket` más: solo agrega el otro extremo.
+ * */
+class SocketPairTransport : public Socket {
+    private:
+    Socket remote;
+
+    explicit SocketPairTransport(std::pair<Socket, Socket>&& ends);
+
+    public:
+    SocketPairTransport();
+
+    /*
+     * Retorna el otro extremo del par (el "servidor"). Solo puede
+     * llamarse una vez y antes de mover el transporte a un protocolo.
+     * */
+    Socket take_peer();
+};
+
+/*
+ * Transporte en memoria.
+ *
+ * Lo que se "recibe" es lo que se haya cargado con `MemoryTransport::feed`
+ * (lo que enviaría el servidor) y lo que se "envía" se acumula
+ * y puede verse con `MemoryTransport::written`.
+ *
+ * Con `chunk_sz` cada `MemoryTransport::recvsome` retorna a lo sumo
+ * `chunk_sz` bytes, simulando los datos llegando de a pedazos (como
+ * pasa con TCP): un parser correcto debe funcionar igual con cualquier
+ * `chunk_sz`, incluso de a 1 byte.
+ *
+ * Como no hay nadie del otro lado, si no hay nada para recibir
+ * un `MemoryTransport::recvsome` bloqueante se bloquearía para siempre:
+ * en vez de eso se lanza una excepción. En modo no-bloqueante
+ * se retorna `Socket::WOULD_BLOCK`.
+ * */
+class MemoryTransport {
+    private:
+    std::string inbound;
+    size_t in_off;
+    bool in_closed;
+
+    std::string outbound;
+
+    unsigned int chunk_sz;
+    bool nonblocking;
+
+    public:
+    /*
+     * `chunk_sz` 0 significa sin límite.
+     * */
+    explicit MemoryTransport(unsigned int chunk_sz = 0);
+
+    /*
+     * Agrega `data` a lo que hay para recibir.
+     * */
+    void feed(std::string_view data);
+
+    /*
+     * El "servidor" cierra la conexión: una vez recibido todo lo
+     * cargado, `MemoryTransport::recvsome` retornara 0.
+     * */
+    void close_inbound();
+
+    /*
+     * Vuelve a servir todo lo cargado desde el principio (y reabre
+     * la conexión): permite repetir la misma respuesta muchas veces
+     * sin volver a cargarla, por ejemplo en un benchmark.
+     * */
+    void rewind();
+
+    /*
+     * Lo enviado hasta ahora (y `MemoryTransport::clear_written`
+     * para descartarlo).
+     * */
+    const std::string& written() const;
+    void clear_written();
+
+    /*
+     * La interfaz de transporte (véase más arriba).
+     * */
+    int recvsome(void *data, unsigned int sz);
+    int sendall(const void *data, unsigned int sz);
+    int sendall(const struct iovec *iov, int iovcnt);
+    bool is_stream_send_closed() const;
+    bool is_stream_recv_closed() const;
+    void set_nonblocking(bool on);
+    int peek_nonblocking(void *data, unsigned int sz);
+};
+
+#endif
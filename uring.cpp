@@ -0,0 +1,514 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+
+#include "uring.h"
+#include "liberror.h"
+
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+/*
+ * Las colas son compartidas con el kernel: al leer el índice que escribe
+ * el kernel (`cq_tail`, `sq_head`) necesitamos semántica *acquire*
+ * y al publicar nuestro índice (`sq_tail`, `cq_head`) semántica *release*
+ * para que el kernel vea los SQE completos (o sepa que ya leímos los CQE).
+ * */
+static unsigned load_acquire(const unsigned *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(unsigned *p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+URing::URing(unsigned entries) :
+    ring_fd(-1),
+    stopped(false),
+    sq_ptr(MAP_FAILED),
+    sq_ptr_sz(0),
+    cq_ptr(MAP_FAILED),
+    cq_ptr_sz(0),
+    sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+    sqes_sz(0),
+    to_submit(0),
+    sqe_tail(0),
+    next_id(1),
+    enter_calls(0)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    this->ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (this->ring_fd == -1)
+        throw LibError(errno, "io_uring_setup failed");
+
+    /*
+     * El kernel nos dice (`params.sq_off` y `params.cq_off`) en que
+     * offsets de la memoria compartida están los índices y los arrays
+     * de cada cola. Nosotros tenemos que mapear esa memoria con `mmap`.
+     *
+     * En kernels modernos (`IORING_FEAT_SINGLE_MMAP`) ambas colas
+     * comparten un único mapeo.
+     * */
+    this->sq_ptr_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_ptr_sz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        if (this->cq_ptr_sz > this->sq_ptr_sz)
+            this->sq_ptr_sz = this->cq_ptr_sz;
+        this->cq_ptr_sz = this->sq_ptr_sz;
+    }
+
+    this->sq_ptr = mmap(nullptr, this->sq_ptr_sz, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQ_RING);
+    if (this->sq_ptr == MAP_FAILED) {
+        int saved_errno = errno;
+        release();
+        throw LibError(saved_errno, "io_uring mmap (sq ring) failed");
+    }
+
+    if (single_mmap) {
+        this->cq_ptr = this->sq_ptr;
+    } else {
+        this->cq_ptr = mmap(nullptr, this->cq_ptr_sz, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_CQ_RING);
+        if (this->cq_ptr == MAP_FAILED) {
+            int saved_errno = errno;
+            release();
+            throw LibError(saved_errno, "io_uring mmap (cq ring) failed");
+        }
+    }
+
+    this->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    this->sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, this->sqes_sz,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                this->ring_fd, IORING_OFF_SQES));
+    if (this->sqes == MAP_FAILED) {
+        int saved_errno = errno;
+        release();
+        throw LibError(saved_errno, "io_uring mmap (sqes) failed");
+    }
+
+    char *sq = static_cast<char*>(this->sq_ptr);
+    this->sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    this->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    this->sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    this->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    this->sqe_tail = *this->sq_tail;
+
+    char *cq = static_cast<char*>(this->cq_ptr);
+    this->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    this->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    this->cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    this->cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+void URing::reserve(unsigned n) {
+    chk_ring_or_fail();
+
+    unsigned entries = *this->sq_mask + 1;
+    if (n > entries)
+        throw std::runtime_error("io_uring submission queue too small");
+
+    /*
+     * Si no hay lugar en la cola de envío le pasamos al kernel lo que
+     * tenemos encolado (sin esperar resultados) para hacer lugar.
+     *
+     * Pero si la cola de completitud esta llena el kernel no acepta
+     * nuevos pedidos (`EBUSY`) hasta que saquemos resultados. No podemos
+     * despacharlos acá (el caller esta a mitad de encolar un pedido,
+     * quizás en medio de una cadena) así que los guardamos para que
+     * los despache `URing::run_once`.
+     *
+     * Si no hay ninguno todavía esperamos a que termine al menos un
+     * pedido (`min_complete` 1): esperar 0 retornaría enseguida y este
+     * loop giraría consumiendo CPU hasta que el kernel termine alguno.
+     *
+     * Eso sí, solo si hay algún pedido en el kernel (registrado, ya
+     * enviado y sin resultado guardado): si no, nadie nos despertaría.
+     * */
+    while (this->sqe_tail - load_acquire(this->sq_head) + n > entries) {
+        if (enter(this->to_submit, 0, 0) > 0)
+            continue;
+
+        bool in_kernel = this->completions.size() > this->to_submit + this->stashed.size();
+        enter(0, in_kernel ? 1 : 0, IORING_ENTER_GETEVENTS);
+        stash_completions();
+    }
+}
+
+struct io_uring_sqe* URing::get_sqe(Completion on_complete) {
+    reserve(1);
+
+    unsigned idx = this->sqe_tail & *this->sq_mask;
+    struct io_uring_sqe *sqe = &this->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    uint64_t id = this->next_id++;
+    sqe->user_data = id;
+    this->completions.emplace(id, std::move(on_complete));
+
+    /*
+     * El caller todavía tiene que completar el SQE: no lo publicamos
+     * (`sq_tail`) hasta `URing::enter`.
+     * */
+    this->sq_array[idx] = idx;
+    ++this->sqe_tail;
+    ++this->to_submit;
+
+    return sqe;
+}
+
+int URing::enter(unsigned submit, unsigned min_complete, unsigned flags) {
+    /*
+     * Publicamos los SQEs preparados: a esta altura ya están completos
+     * y el *release* garantiza que el kernel los vea así.
+     * */
+    store_release(this->sq_tail, this->sqe_tail);
+
+    ++this->enter_calls;
+    int s = syscall(__NR_io_uring_enter, this->ring_fd, submit, min_complete,
+            flags, nullptr, 0);
+    if (s == -1) {
+        /*
+         * Una señal interrumpió la espera o el kernel no tiene recursos
+         * momentáneamente: no es un error, se reintentara en la
+         * próxima llamada.
+         * */
+        if (errno == EINTR or errno == EAGAIN or errno == EBUSY)
+            return 0;
+        throw LibError(errno, "io_uring_enter failed");
+    }
+
+    this->to_submit -= (unsigned)s < this->to_submit ? s : this->to_submit;
+    return s;
+}
+
+void URing::async_accept(Socket& srv, bool multishot, Completion on_complete) {
+    srv.chk_skt_or_fail();
+    struct io_uring_sqe *sqe = get_sqe(std::move(on_complete));
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = srv.skt;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (multishot)
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+}
+
+void URing::async_recv(Socket& skt, void *data, unsigned int sz, Completion on_complete) {
+    skt.chk_skt_or_fail();
+    struct io_uring_sqe *sqe = get_sqe(std::move(on_complete));
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = skt.skt;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = sz;
+}
+
+void URing::async_recv_multishot(Socket& skt, BufferRing& buffers, Completion on_complete) {
+    skt.chk_skt_or_fail();
+    struct io_uring_sqe *sqe = get_sqe(std::move(on_complete));
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = skt.skt;
+    sqe->ioprio |= IORING_RECV_MULTISHOT;
+
+    /*
+     * Sin buffer propio (`addr`/`len` en 0): le pedimos al kernel que
+     * elija uno del grupo `buf_group`.
+     * */
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffers.bgid;
+}
+
+void URing::async_send(
+        Socket& skt,
+        const void *data,
+        unsigned int sz,
+        bool link,
+        Completion on_complete) {
+    skt.chk_skt_or_fail();
+    struct io_uring_sqe *sqe = get_sqe(std::move(on_complete));
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = skt.skt;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = sz;
+
+    /*
+     * `MSG_NOSIGNAL` por las mismas razones que en `Socket::sendsome`.
+     *
+     * `MSG_WAITALL` hace que el kernel reintente hasta enviar
+     * todo (o fallar): un envío parcial rompería la cadena.
+     * */
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    if (link)
+        sqe->flags |= IOSQE_IO_LINK;
+}
+
+/*
+ * Estado compartido por todos los envíos de una cadena.
+ * */
+struct SendChain {
+    int remaining;
+    int total;
+    int error;
+    URing::Completion on_complete;
+};
+
+void URing::async_send_chain(
+        Socket& skt,
+        const struct iovec *iov,
+        int iovcnt,
+        Completion on_complete) {
+    /*
+     * Sin nada para enviar no hay ningún CQE que vaya a llamar
+     * a `on_complete`: terminamos ya.
+     * */
+    if (iovcnt <= 0) {
+        on_complete(0, 0);
+        return;
+    }
+
+    auto chain = std::make_shared<SendChain>();
+    chain->remaining = iovcnt;
+    chain->total = 0;
+    chain->error = 0;
+    chain->on_complete = std::move(on_complete);
+
+    reserve(iovcnt);
+    for (int i = 0; i < iovcnt; ++i) {
+        bool link = (i + 1 < iovcnt);
+        async_send(skt, iov[i].iov_base, iov[i].iov_len, link,
+                [chain](int res, uint32_t) {
+            if (res < 0) {
+                /*
+                 * Nos quedamos con el primer error "real": los que le
+                 * siguen son `-ECANCELED` por el link.
+                 * */
+                if (chain->error == 0 or chain->error == -ECANCELED)
+                    chain->error = res;
+            } else {
+                chain->total += res;
+            }
+
+            if (--chain->remaining == 0)
+                chain->on_complete(chain->error ? chain->error : chain->total, 0);
+        });
+    }
+}
+
+void URing::async_timeout(unsigned int ms, Completion on_complete) {
+    /*
+     * El kernel lee el `timespec` recién cuando procesa el pedido
+     * así que debe seguir vivo hasta entonces: lo atamos al callback.
+     * */
+    auto ts = std::make_shared<struct __kernel_timespec>();
+    ts->tv_sec = ms / 1000;
+    ts->tv_nsec = (ms % 1000) * 1000000LL;
+
+    struct io_uring_sqe *sqe = get_sqe([ts, on_complete](int res, uint32_t flags) {
+        on_complete(res, flags);
+    });
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(ts.get());
+    sqe->len = 1;
+}
+
+/*
+ * Saca de la cola de completitud todos los resultados disponibles (así
+ * el kernel tiene lugar para los próximos) y los guarda, sin despacharlos.
+ * */
+void URing::stash_completions() {
+    unsigned head = *this->cq_head;
+    while (head != load_acquire(this->cq_tail)) {
+        struct io_uring_cqe *cqe = &this->cqes[head & *this->cq_mask];
+        this->stashed.push_back({ cqe->user_data, cqe->res, cqe->flags });
+        ++head;
+    }
+
+    /*
+     * Copiados los CQEs, se los devolvemos al kernel.
+     * */
+    store_release(this->cq_head, head);
+}
+
+int URing::dispatch_stashed() {
+    /*
+     * Un callback puede encolar pedidos y con ello (`URing::reserve`)
+     * guardar más resultados: despachamos desde otro vector.
+     * */
+    this->dispatching.swap(this->stashed);
+
+    int dispatched = 0;
+    for (const PendingCQE& c : this->dispatching) {
+        auto it = this->completions.find(c.id);
+        if (it == this->completions.end())
+            continue;
+
+        it->second(c.res, c.flags);
+        ++dispatched;
+
+        /*
+         * Un pedido multishot sigue vivo mientras traiga
+         * `IORING_CQE_F_MORE`; cualquier otro termino.
+         * */
+        if (not (c.flags & IORING_CQE_F_MORE))
+            this->completions.erase(c.id);
+    }
+
+    this->dispatching.clear();
+    return dispatched;
+}
+
+int URing::run_once() {
+    chk_ring_or_fail();
+
+    /*
+     * Una única syscall envía todo lo encolado y espera
+     * al menos un resultado (salvo que ya tengamos resultados
+     * guardados para despachar).
+     * */
+    enter(this->to_submit, this->stashed.empty() ? 1 : 0, IORING_ENTER_GETEVENTS);
+
+    stash_completions();
+    return dispatch_stashed();
+}
+
+void URing::run() {
+    this->stopped = false;
+    while (not this->stopped) {
+        run_once();
+    }
+}
+
+void URing::stop() {
+    this->stopped = true;
+}
+
+unsigned long long URing::syscalls() const {
+    return this->enter_calls;
+}
+
+Socket URing::adopt(int fd) {
+    return Socket(fd);
+}
+
+void URing::release() {
+    if (this->sqes != MAP_FAILED)
+        munmap(this->sqes, this->sqes_sz);
+    if (this->cq_ptr != MAP_FAILED and this->cq_ptr != this->sq_ptr)
+        munmap(this->cq_ptr, this->cq_ptr_sz);
+    if (this->sq_ptr != MAP_FAILED)
+        munmap(this->sq_ptr, this->sq_ptr_sz);
+    if (this->ring_fd != -1)
+        ::close(this->ring_fd);
+
+    this->sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    this->cq_ptr = this->sq_ptr = MAP_FAILED;
+    this->ring_fd = -1;
+}
+
+URing::~URing() {
+    release();
+}
+
+void URing::chk_ring_or_fail() const {
+    if (ring_fd == -1) {
+        throw std::runtime_error("io_uring with invalid file descriptor (-1)");
+    }
+}
+
+BufferRing::BufferRing(URing& ring, uint16_t bgid, unsigned entries, unsigned int buf_sz) :
+    ring(ring),
+    bgid(bgid),
+    entries(entries),
+    buf_sz(buf_sz),
+    br(nullptr),
+    br_sz(entries * sizeof(struct io_uring_buf)),
+    mem(nullptr),
+    mem_sz((size_t)entries * buf_sz)
+{
+    if (entries == 0 or (entries & (entries - 1)) != 0)
+        throw std::runtime_error("buffer ring entries must be a power of 2");
+
+    /*
+     * El anillo en sí (los descriptores `io_uring_buf`) debe estar
+     * alineado a página: `mmap` nos da eso gratis.
+     * */
+    void *p = mmap(nullptr, this->br_sz, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        throw LibError(errno, "buffer ring mmap failed");
+    this->br = static_cast<struct io_uring_buf_ring*>(p);
+
+    p = mmap(nullptr, this->mem_sz, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        int saved_errno = errno;
+        munmap(this->br, this->br_sz);
+        throw LibError(saved_errno, "buffer ring mmap (buffers) failed");
+    }
+    this->mem = static_cast<char*>(p);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(this->br);
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+
+    ring.chk_ring_or_fail();
+    if (syscall(__NR_io_uring_register, ring.ring_fd,
+                IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        int saved_errno = errno;
+        munmap(this->mem, this->mem_sz);
+        munmap(this->br, this->br_sz);
+        throw LibError(saved_errno, "io_uring_register(PBUF_RING) failed");
+    }
+
+    for (unsigned i = 0; i < entries; ++i)
+        recycle(i);
+}
+
+uint16_t BufferRing::buffer_id(uint32_t flags) {
+    return flags >> IORING_CQE_BUFFER_SHIFT;
+}
+
+char* BufferRing::buffer(uint16_t bid) const {
+    return this->mem + (size_t)bid * this->buf_sz;
+}
+
+void BufferRing::recycle(uint16_t bid) {
+    /*
+     * Somos los únicos que escribimos `tail`; el kernel solo lo lee.
+     * */
+    uint16_t tail = this->br->tail;
+
+    /*
+     * En C++ el `__DECLARE_FLEX_ARRAY` del header del kernel no deja
+     * a `bufs` en el offset 0 (como si lo hace en C), así que calculamos
+     * la dirección de los descriptores a mano.
+     * */
+    struct io_uring_buf *bufs = reinterpret_cast<struct io_uring_buf*>(this->br);
+    struct io_uring_buf *buf = &bufs[tail & (this->entries - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf->len = this->buf_sz;
+    buf->bid = bid;
+
+    __atomic_store_n(&this->br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+BufferRing::~BufferRing() {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = this->bgid;
+    if (this->ring.ring_fd != -1)
+        syscall(__NR_io_uring_register, this->ring.ring_fd,
+                IORING_UNREGISTER_PBUF_RING, &reg, 1);
+
+    munmap(this->mem, this->mem_sz);
+    munmap(this->br, this->br_sz);
+}
@@ -0,0 +1,272 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <cstddef>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "socket.h"
+
+class BufferRing;
+
+/*
+ * Motor de completitud (completion engine) basado en `io_uring`.
+ *
+ * Con `epoll` (véase `Reactor`) el sistema operativo nos avisa cuando
+ * un socket esta *listo* y luego nosotros hacemos el `recv`/`send`:
+ * al menos dos syscalls por operación.
+ *
+ * Con `io_uring` en cambio le *pedimos* al kernel que haga la operación
+ * por nosotros y nos avise cuando *termino*. Los pedidos (SQE, submission
+ * queue entries) y los resultados (CQE, completion queue entries) se
+ * intercambian a través de dos colas en memoria compartida con el kernel.
+ *
+ * Una única syscall (`io_uring_enter`) puede entonces enviar decenas de
+ * pedidos y recolectar decenas de resultados.
+ *
+ * Ademas `io_uring` soporta operaciones "multishot": un único pedido
+ * de `accept` o `recv` que genera un resultado por cada conexión
+ * aceptada o cada bloque de datos recibidos.
+ *
+ * No usamos `liburing` sino las syscalls directamente: no es mucho
+ * código y así se ve que no hay magia.
+ *
+ * Lease manpage de `io_uring`, `io_uring_setup` y `io_uring_enter`.
+ * */
+class URing {
+    public:
+    /*
+     * Callback de completitud. `res` es el resultado de la operación
+     * (como el retorno de la syscall equivalente pero con `-errno`
+     * en caso de error) y `flags` son los flags del CQE
+     * (`IORING_CQE_F_MORE`, `IORING_CQE_F_BUFFER`, ...).
+     * */
+    typedef std::function<void(int res, uint32_t flags)> Completion;
+
+    private:
+    int ring_fd;
+    bool stopped;
+
+    void *sq_ptr;
+    size_t sq_ptr_sz;
+    void *cq_ptr;
+    size_t cq_ptr_sz;
+    struct io_uring_sqe *sqes;
+    size_t sqes_sz;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /*
+     * SQEs preparados pero aun no enviados al kernel.
+     *
+     * `sqe_tail` es nuestra copia del final de la cola de envío: avanza
+     * al pedir un SQE pero el kernel la ve (`sq_tail`) recién al enviar,
+     * en `URing::enter`, cuando los SQEs ya están completos.
+     * */
+    unsigned to_submit;
+    unsigned sqe_tail;
+
+    /*
+     * Resultados ya sacados de la cola de completitud pero aun no
+     * despachados (véase `URing::reserve`). `URing::run_once` los
+     * despacha antes que los nuevos.
+     * */
+    struct PendingCQE {
+        uint64_t id;
+        int res;
+        uint32_t flags;
+    };
+    std::vector<PendingCQE> stashed;
+    std::vector<PendingCQE> dispatching;
+
+    /*
+     * Cada pedido lleva un `user_data` que el kernel nos devuelve
+     * tal cual en su CQE. Lo usamos como clave para encontrar
+     * el callback.
+     *
+     * Las referencias a los elementos de un `std::unordered_map` no se
+     * invalidan al insertar otros así que un callback puede encolar
+     * nuevos pedidos sin problemas.
+     * */
+    uint64_t next_id;
+    std::unordered_map<uint64_t, Completion> completions;
+
+    unsigned long long enter_calls;
+
+    void reserve(unsigned n);
+    struct io_uring_sqe* get_sqe(Completion on_complete);
+    int enter(unsigned submit, unsigned min_complete, unsigned flags);
+    void stash_completions();
+    int dispatch_stashed();
+    void release();
+    void chk_ring_or_fail() const;
+
+    friend class BufferRing;
+
+    public:
+    /*
+     * Crea un `io_uring` con lugar para `entries` pedidos simultáneos
+     * en la cola de envío (la de completitud es el doble).
+     *
+     * En caso de error (por ejemplo un kernel sin soporte para
+     * `io_uring`) se lanza una excepción.
+     * */
+    explicit URing(unsigned entries = 256);
+
+    /*
+     * Acepta conexiones en `srv`. Si `multishot` es `true`, el mismo pedido
+     * sigue aceptando conexiones (un CQE por cada una) mientras el CQE traiga
+     * el flag `IORING_CQE_F_MORE`; si no lo trae hay que volver a pedirlo.
+     *
+     * `res` es el file descriptor del nuevo socket (véase `URing::adopt`)
+     * o `-errno`.
+     * */
+    void async_accept(Socket& srv, bool multishot, Completion on_complete);
+
+    /*
+     * Recibe hasta `sz` bytes en `data`, el cual debe seguir siendo valido
+     * hasta que se llame a `on_complete`.
+     * */
+    void async_recv(Socket& skt, void *data, unsigned int sz, Completion on_complete);
+
+    /*
+     * Recepción multishot: cada vez que lleguen datos el kernel elije
+     * un buffer del `BufferRing` (véase más abajo), escribe ahí y nos
+     * genera un CQE con el flag `IORING_CQE_F_BUFFER` y el id del buffer
+     * usado (véase `BufferRing::buffer_id`).
+     *
+     * Si se quedo sin buffers el pedido termina con `-ENOBUFS`
+     * (sin el flag `IORING_CQE_F_MORE`) y hay que volver a pedirlo.
+     * */
+    void async_recv_multishot(Socket& skt, BufferRing& buffers, Completion on_complete);
+
+    /*
+     * Envía `sz` bytes de `data`, el cual debe seguir siendo valido
+     * hasta que se llame a `on_complete`.
+     *
+     * Si `link` es `true` el *siguiente* pedido encolado no empezara
+     * hasta que este termine (y se cancelara con `-ECANCELED` si este
+     * falla): así se encadenan envíos preservando el orden.
+     * */
+    void async_send(
+            Socket& skt,
+            const void *data,
+            unsigned int sz,
+            bool link,
+            Completion on_complete);
+
+    /*
+     * Encadena (`link`) un envío por cada uno de los `iovcnt` buffers.
+     * `on_complete` se llama una única vez, cuando terminaron todos,
+     * con el total de bytes enviados o con el primer error encontrado.
+     *
+     * `iovcnt` no puede superar la cantidad de entradas de la cola
+     * de envío: una cadena no puede partirse entre dos `io_uring_enter`.
+     * */
+    void async_send_chain(
+            Socket& skt,
+            const struct iovec *iov,
+            int iovcnt,
+            Completion on_complete);
+
+    /*
+     * Llama a `on_complete` luego de `ms` milisegundos.
+     * */
+    void async_timeout(unsigned int ms, Completion on_complete);
+
+    /*
+     * Envía los pedidos encolados, espera a que haya al menos un resultado
+     * y despacha todos los resultados disponibles.
+     *
+     * Retorna la cantidad de resultados despachados.
+     * */
+    int run_once();
+
+    /*
+     * Despacha resultados hasta que alguien llame a `URing::stop`.
+     * */
+    void run();
+    void stop();
+
+    /*
+     * Cantidad de syscalls `io_uring_enter` hechas hasta ahora.
+     * */
+    unsigned long long syscalls() const;
+
+    /*
+     * Construye un `Socket` a partir del file descriptor retornado
+     * por un `URing::async_accept`.
+     * */
+    static Socket adopt(int fd);
+
+    URing(const URing&) = delete;
+    URing& operator=(const URing&) = delete;
+    URing(URing&&) = delete;
+    URing& operator=(URing&&) = delete;
+
+    ~URing();
+};
+
+/*
+ * Anillo de buffers provistos al kernel ("provided buffers").
+ *
+ * En vez de darle a cada `recv` su propio buffer (que quedaría reservado
+ * aunque la conexión este inactiva), le damos al kernel un conjunto
+ * de buffers compartido y él elije uno recién cuando llegan datos.
+ *
+ * Una vez procesados los datos, el buffer debe devolverse con
+ * `BufferRing::recycle` para que el kernel lo pueda volver a usar.
+ * */
+class BufferRing {
+    private:
+    URing& ring;
+    uint16_t bgid;
+    unsigned entries;
+    unsigned int buf_sz;
+
+    struct io_uring_buf_ring *br;
+    size_t br_sz;
+    char *mem;
+    size_t mem_sz;
+
+    friend class URing;
+
+    public:
+    /*
+     * Registra `entries` (potencia de 2) buffers de `buf_sz` bytes cada uno
+     * bajo el grupo `bgid`.
+     * */
+    BufferRing(URing& ring, uint16_t bgid, unsigned entries, unsigned int buf_sz);
+
+    /*
+     * Id del buffer usado en un CQE (`flags` debe tener `IORING_CQE_F_BUFFER`)
+     * y su dirección.
+     * */
+    static uint16_t buffer_id(uint32_t flags);
+    char* buffer(uint16_t bid) const;
+
+    /*
+     * Devuelve el buffer al kernel.
+     * */
+    void recycle(uint16_t bid);
+
+    BufferRing(const BufferRing&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+    BufferRing(BufferRing&&) = delete;
+    BufferRing& operator=(BufferRing&&) = delete;
+
+    ~BufferRing();
+};
+#endif
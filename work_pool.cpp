@@ -0,0 +1,178 @@
+#include "work_pool.h"
+
+#include <exception>
+#include <iostream>
+#include <utility>
+
+/*
+ * Que pool y que worker (si alguno) esta corriendo en el thread actual.
+ * */
+static thread_local const WorkStealingPool *current_pool = nullptr;
+static thread_local int current_id = -1;
+
+WorkStealingPool::WorkStealingPool(unsigned int n) :
+    queued(0),
+    stopping(false),
+    executed(0),
+    stolen(0) {
+    if (n == 0)
+        n = std::thread::hardware_concurrency();
+    if (n == 0)
+        n = 1;
+
+    /*
+     * Primero creamos todas las colas y recién después lanzamos los
+     * threads: un worker puede querer robarle a cualquier otro apenas
+     * arranca.
+     * */
+    for (unsigned int i = 0; i < n; ++i)
+        workers.emplace_back(new Worker);
+
+    for (unsigned int i = 0; i < n; ++i)
+        workers[i]->th = std::thread(&WorkStealingPool::run, this, i);
+}
+
+unsigned int WorkStealingPool::size() const {
+    return workers.size();
+}
+
+void WorkStealingPool::submit(unsigned int worker, Job job) {
+    /*
+     * Contamos el trabajo *antes* de encolarlo y con `sleep_mtx`
+     * tomado: así un worker que esta por dormirse o ve el trabajo
+     * o recibe el `notify`, nunca se lo pierde.
+     * */
+    {
+        std::unique_lock<std::mutex> lock(sleep_mtx);
+        ++queued;
+    }
+
+    Worker& w = *workers[worker % workers.size()];
+    {
+        std::unique_lock<std::mutex> lock(w.mtx);
+        w.jobs.push_back(std::move(job));
+    }
+
+    idle.notify_one();
+}
+
+bool WorkStealingPool::pop_own(unsigned int id, Job& job) {
+    Worker& w = *workers[id];
+    std::unique_lock<std::mutex> lock(w.mtx);
+    if (w.jobs.empty())
+        return false;
+
+    job = std::move(w.jobs.back());
+    w.jobs.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(unsigned int thief, Job& job) {
+    /*
+     * Empezamos por el vecino y damos la vuelta: si todos los workers
+     * empezaran a robar por el mismo (el 0) se pelearían por su mutex.
+     * */
+    const unsigned int n = workers.size();
+    bool contended = false;
+    for (unsigned int i = 1; i < n; ++i) {
+        Worker& victim = *workers[(thief + i) % n];
+
+        /*
+         * Si la cola de la victima esta tomada por alguien más seguimos
+         * de largo: hay otras victimas y no queremos esperar.
+         * */
+        std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+        if (not lock.owns_lock()) {
+            contended = true;
+            continue;
+        }
+        if (victim.jobs.empty())
+            continue;
+
+        job = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        ++stolen;
+        return true;
+    }
+
+    /*
+     * Si alguna cola estaba tomada no sabemos si tenia trabajo. Mientras
+     * haya trabajo encolado (`queued > 0`) el worker no se duerme, así
+     * que volver a intentar sin esperar seria girar en vacío gastando
+     * CPU: esta vez esperamos cada mutex.
+     * */
+    if (not contended)
+        return false;
+
+    for (unsigned int i = 1; i < n; ++i) {
+        Worker& victim = *workers[(thief + i) % n];
+
+        std::unique_lock<std::mutex> lock(victim.mtx);
+        if (victim.jobs.empty())
+            continue;
+
+        job = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        ++stolen;
+        return true;
+    }
+
+    return false;
+}
+
+void WorkStealingPool::run(unsigned int id) {
+    current_pool = this;
+    current_id = id;
+
+    while (true) {
+        Job job;
+        if (pop_own(id, job) or steal(id, job)) {
+            --queued;
+            try {
+                job();
+            } catch (const std::exception& err) {
+                /*
+                 * Una excepción que escapa de un thread termina el
+                 * programa (`std::terminate`): la reportamos y seguimos.
+                 * */
+                std::cerr << "Job on worker " << id << " failed: " << err.what() << "\n";
+            }
+            ++executed;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mtx);
+        idle.wait(lock, [this] { return queued > 0 or stopping; });
+
+        if (stopping and queued == 0)
+            return;
+    }
+}
+
+int WorkStealingPool::current_worker() const {
+    return current_pool == this ? current_id : -1;
+}
+
+size_t WorkStealingPool::jobs_executed() const {
+    return executed;
+}
+
+size_t WorkStealingPool::jobs_stolen() const {
+    return stolen;
+}
+
+void WorkStealingPool::stop() {
+    {
+        std::unique_lock<std::mutex> lock(sleep_mtx);
+        stopping = true;
+    }
+    idle.notify_all();
+
+    for (auto& w : workers)
+        if (w->th.joinable())
+            w->th.join();
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stop();
+}
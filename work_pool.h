@@ -0,0 +1,114 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Pool de threads ("workers") con "work stealing".
+ *
+ * Un pool con una única cola compartida es simple pero con muchos threads
+ * y trabajos cortos (como atender una conexión lista para leer) esa cola
+ * y su mutex se vuelven el cuello de botella: todos los threads se pelean
+ * por ella.
+ *
+ * Acá cada worker tiene su *propia* cola (un `std::deque` con su propio
+ * mutex): normalmente cada worker solo toca la suya y no compite con nadie.
+ *
+ *  - El dueño de la cola saca trabajos del final (LIFO): el último trabajo
+ *    encolado es el que tiene los datos más "calientes" en la cache.
+ *
+ *  - Un worker sin trabajo le "roba" al resto, del principio (FIFO):
+ *    los trabajos más viejos, así dueño y ladrón tocan extremos
+ *    distintos de la cola.
+ *
+ * Si algunos trabajos son pesados y otros triviales, los workers que
+ * terminan antes les roban trabajo a los que están ocupados y la carga
+ * se reparte sola entre todos los cores.
+ *
+ * Por simplicidad las colas son un `std::deque` con un mutex y no una
+ * cola lock-free (como la de Chase-Lev): como cada mutex lo usa casi
+ * siempre un único thread, tomarlo es barato.
+ * */
+class WorkStealingPool {
+    public:
+    typedef std::function<void()> Job;
+
+    private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Job> jobs;
+        std::thread th;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    /*
+     * Los workers sin trabajo (ni propio ni para robar) duermen en `idle`.
+     * `queued` cuenta los trabajos encolados en todas las colas y evita
+     * que un worker se duerma habiendo trabajos pendientes.
+     * */
+    std::mutex sleep_mtx;
+    std::condition_variable idle;
+    std::atomic<size_t> queued;
+    bool stopping;
+
+    std::atomic<size_t> executed;
+    std::atomic<size_t> stolen;
+
+    bool pop_own(unsigned int id, Job& job);
+    bool steal(unsigned int thief, Job& job);
+    void run(unsigned int id);
+
+    public:
+    /*
+     * Lanza `n` workers (uno por core si `n` es 0).
+     * */
+    explicit WorkStealingPool(unsigned int n = 0);
+
+    unsigned int size() const;
+
+    /*
+     * Encola `job` en la cola del worker `worker` (módulo `size()`):
+     * lo correra ese worker salvo que otro, sin trabajo, se lo robe.
+     *
+     * Encolar siempre al mismo worker los trabajos relacionados (por
+     * ejemplo los de una misma conexión) mantiene sus datos en la cache
+     * de un mismo core ("afinidad").
+     * */
+    void submit(unsigned int worker, Job job);
+
+    /*
+     * El id del worker que esta corriendo el trabajo actual
+     * o -1 si el thread actual no es un worker de este pool.
+     * */
+    int current_worker() const;
+
+    /*
+     * Trabajos corridos en total y cuantos de ellos fueron robados.
+     * */
+    size_t jobs_executed() const;
+    size_t jobs_stolen() const;
+
+    /*
+     * Espera a que los workers terminen los trabajos encolados
+     * y los detiene.
+     * */
+    void stop();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    WorkStealingPool(WorkStealingPool&&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+
+    ~WorkStealingPool();
+};
+
+#endif